@@ -23,6 +23,7 @@
 #include <clanton/flash.h>
 #include <clanton/mfh.h>
 #include <clanton/sbh.h>
+#include <clanton/spi_xfer.h>
 #include <clanton/test_module.h>
 #include <grub/types.h>
 #include <shared.h>
@@ -74,8 +75,8 @@ cln_flash_item_is_sane (grub_uint32_t min_size)
      1. minimum size is satisfied
      2. extent of the asset doesn't wrap around the address space.  */
   if (cln_flash_item_len < min_size
-      || (grub_uint32_t) cln_flash_item_addr + cln_flash_item_len
-         < (grub_uint32_t) cln_flash_item_addr)
+      || (grub_uint32_t) (grub_addr_t) cln_flash_item_addr + cln_flash_item_len
+         < (grub_uint32_t) (grub_addr_t) cln_flash_item_addr)
     {
       grub_printf ("flash item size is outside the accepted range\n");
       errnum = ERR_FILELENGTH;
@@ -219,6 +220,18 @@ grub_cln_asset_open (grub_cln_asset_type type, char *filename)
   return ret;
 }
 
+/* Copy LEN bytes of the flash item, starting OFFS bytes into it, to BUF.
+   Return the number of bytes read.  */
+static int
+spi_read (void *buf, unsigned int offs, int len)
+{
+  if (! grub_cln_spi_read ((grub_addr_t) (cln_flash_item_addr + offs), buf,
+                           len))
+    return 0;
+
+  return len;
+}
+
 int
 grub_cln_asset_read (grub_cln_asset_type type, void *buf, int len)
 {
@@ -229,10 +242,7 @@ grub_cln_asset_read (grub_cln_asset_type type, void *buf, int len)
   case GRUB_CLN_ASSET_KERNEL:
     if (grub_cln_linux_spi)
       {
-        grub_memcpy (buf,
-                     cln_flash_item_addr
-                     + spi_offs_intra_module, len);
-        read = len;
+        read = spi_read (buf, spi_offs_intra_module, len);
         spi_offs_intra_module += read;
       }
     else
@@ -240,20 +250,14 @@ grub_cln_asset_read (grub_cln_asset_type type, void *buf, int len)
     break;
   case GRUB_CLN_ASSET_KERNEL_CSBH:
     if (grub_cln_linux_spi)
-      {
-        grub_memcpy (buf, cln_flash_item_addr, len);
-        read = len;
-      }
+      read = spi_read (buf, 0, len);
     else
       read = grub_read (buf, len);
     break;
   case GRUB_CLN_ASSET_INITRD:
     if (grub_cln_initrd_spi)
       {
-        grub_memcpy (buf,
-                     cln_flash_item_addr + spi_offs_intra_module,
-                     len);
-        read = len;
+        read = spi_read (buf, spi_offs_intra_module, len);
         spi_offs_intra_module += read;
       }
     else
@@ -261,20 +265,14 @@ grub_cln_asset_read (grub_cln_asset_type type, void *buf, int len)
     break;
   case GRUB_CLN_ASSET_INITRD_CSBH:
     if (grub_cln_initrd_spi)
-      {
-        grub_memcpy (buf, cln_flash_item_addr, len);
-        read = len;
-      }
+      read = spi_read (buf, 0, len);
     else
       read = grub_read (buf, len);
     break;
   case GRUB_CLN_ASSET_CONFIG:
     if (grub_cln_loaded_from_spi)
       {
-        grub_memcpy (buf,
-                     cln_flash_item_addr + spi_offs_intra_module,
-                     len);
-        read = len;
+        read = spi_read (buf, spi_offs_intra_module, len);
         spi_offs_intra_module += read;
       }
     else
@@ -283,10 +281,7 @@ grub_cln_asset_read (grub_cln_asset_type type, void *buf, int len)
   default:
     /* case GRUB_CLN_ASSET_CONFIG_CSBH  */
     if (grub_cln_loaded_from_spi)
-      {
-        grub_memcpy (buf, cln_flash_item_addr, len);
-        read = len;
-      }
+      read = spi_read (buf, 0, len);
     else
       read = grub_read (buf, len);
     break;
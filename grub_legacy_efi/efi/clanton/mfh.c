@@ -21,6 +21,7 @@
 #include <clanton/clanton.h>
 #include <clanton/flash.h>
 #include <clanton/mfh.h>
+#include <clanton/spi_xfer.h>
 #include <shared.h>
 
 #define offsetof(st, m) \
@@ -32,8 +33,8 @@ static int cln_mfh_loaded = 0;
 void
 grub_cln_mfh_load (const struct grub_cln_mfh *mfh)
 {
-  grub_memcpy (&cln_mfh, (grub_uint8_t *) mfh, sizeof (cln_mfh));
-  cln_mfh_loaded = 1;
+  if (grub_cln_spi_read ((grub_addr_t) mfh, &cln_mfh, sizeof (cln_mfh)))
+    cln_mfh_loaded = 1;
 }
 
 grub_error_t
@@ -53,7 +54,11 @@ grub_cln_mfh_entry_lookup (const grub_uint8_t *mfh_addr, unsigned int entry_type
 
   /* Fetch the MFH if not done yet.  */
   if (! cln_mfh_loaded)
-    grub_cln_mfh_load ((grub_cln_mfh_t) mfh_addr);
+    {
+      grub_cln_mfh_load ((grub_cln_mfh_t) mfh_addr);
+      if (! cln_mfh_loaded)
+        return errnum;
+    }
 
   /* Sanity check.  */
   if (GRUB_CLN_MFH_IDENTIFIER != cln_mfh.identifier)
@@ -73,7 +78,7 @@ grub_cln_mfh_entry_lookup (const grub_uint8_t *mfh_addr, unsigned int entry_type
       if (item->type == entry_type)
         {
           *len = item->flash_item_len;
-          *addr = (grub_uint8_t *) item->flash_item_addr;
+          *addr = (grub_uint8_t *) (grub_addr_t) item->flash_item_addr;
           if (grub_cln_debug)
             grub_printf ("%s: found entry 0x%x @addr=0x%x, len=0x%x\n",
                          __func__, item->type, *addr, *len);
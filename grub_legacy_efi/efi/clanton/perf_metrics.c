@@ -22,7 +22,9 @@
 #include <clanton/target.h>
 #include <shared.h>
 
-/* String to be appended to the Linux command line.  */
+/* String to be appended to the Linux command line.  It is kept apart from
+   the boot profile, whose ring may have dropped the early events by the
+   time the kernel is started.  */
 static char perf_metric_string[GRUB_CLN_PERF_METRIC_STRING_MAXLEN] = "";
 
 void
@@ -44,6 +46,9 @@ grub_cln_event_append (const char *tag)
 
   /* Append entry to performance metric string.  */
   grub_strncat (perf_metric_string, buf, GRUB_CLN_PERF_METRIC_STRING_MAXLEN);
+
+  /* And record it in the boot profile.  */
+  bootprof_mark (tag);
 }
 
 char *
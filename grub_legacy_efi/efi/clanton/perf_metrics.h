@@ -28,7 +28,8 @@
 void grub_cln_event_reset (void);
 
 /* Log an event along with the current timestamp and append it to the
-   performance metric string.
+   performance metric string.  The event is also recorded as a mark in the
+   boot profile.
    Tag is limited to GRUB_CLN_BOOT_EVENT_TAG_MAXLEN.
    Performance metric string is limited to GRUB_CLN_PERF_METRIC_STRING_MAXLEN.
    Any string overrun is dropped and no error code/message is thrown.  */
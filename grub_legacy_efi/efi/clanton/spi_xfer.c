@@ -0,0 +1,322 @@
+/*
+ * Copyright(c) 2013 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Contact Information:
+ * Intel Corporation
+ */
+
+/*
+   Bulk transfers out of SPI flash.
+
+   Reading the memory-mapped flash with the CPU is slow, as every access
+   is an uncached MMIO cycle.  On the board the block aligned middle of a
+   long read is instead DMAed by the PUnit, in batches of up to
+   PUNIT_DMA_BATCH blocks, into a bounce buffer that is then copied from
+   cached memory.  The bounce buffer keeps the destination out of the
+   picture: the kernel is loaded into an IMR that locks the PUnit out.
+   The unaligned edges are still copied by the CPU.
+
+   The grub shell registers a backend that reads a flash image file
+   instead, so that the asset code above this can be exercised on the
+   host.
+ */
+
+#include <clanton/asset.h>
+#include <clanton/clanton.h>
+#include <clanton/flash.h>
+#include <clanton/mfh.h>
+#include <clanton/spi_xfer.h>
+#include <clanton/target.h>
+#ifndef GRUB_UTIL
+#include <clanton/intel_cln_sb.h>
+#endif
+#include <grub/types.h>
+#include <shared.h>
+
+struct grub_cln_spi_stats grub_cln_spi_stats;
+
+#ifndef GRUB_UTIL
+
+/* PUnit DMA registers over side-band.  */
+#define PUNIT_SPI_DMA_COUNT_REG (0x60)
+#define PUNIT_SPI_DMA_DEST_REG  (0x61)
+#define PUNIT_SPI_DMA_SRC_REG   (0x62)
+
+/* Blocks DMAed per transaction, which is also the bounce buffer size.  */
+#define PUNIT_DMA_BATCH         32
+
+static grub_uint32_t punit_bounce[PUNIT_DMA_BATCH * GRUB_CLN_SPI_BLOCK_SIZE
+                                  / sizeof (grub_uint32_t)];
+
+/* Read from SPI via PUnit DMA engine.  */
+void
+grub_cln_spi_dma_read (grub_uint32_t src, void *dst, grub_uint32_t count)
+{
+  if (grub_cln_debug)
+    {
+      grub_printf ("%s: src=0x%x, dst=%p, count=%u\n", __func__, src, dst,
+                   count);
+    }
+
+  /* Setup source and destination addresses.  */
+  intel_cln_sb_write_reg (SB_ID_PUNIT, CFG_WRITE_OPCODE, PUNIT_SPI_DMA_SRC_REG,
+                          src);
+  intel_cln_sb_write_reg (SB_ID_PUNIT, CFG_WRITE_OPCODE, PUNIT_SPI_DMA_DEST_REG,
+                          (grub_uint32_t) (grub_addr_t) dst);
+
+  if (grub_cln_debug)
+    {
+      grub_printf ("%s: starting transaction\n", __func__);
+    }
+
+  /*
+     Setup the number of block to be copied over.  Transaction will start as
+     soon as the register is filled with value.
+   */
+  intel_cln_sb_write_reg (SB_ID_PUNIT, CFG_WRITE_OPCODE, PUNIT_SPI_DMA_COUNT_REG,
+                          count);
+
+  /* Poll for completion.  */
+  while (count > 0)
+    {
+      intel_cln_sb_read_reg (SB_ID_PUNIT, CFG_READ_OPCODE,
+                             PUNIT_SPI_DMA_COUNT_REG, &count);
+    }
+
+  if (grub_cln_debug)
+    {
+      grub_printf ("%s: transaction completed\n", __func__);
+    }
+}
+
+static int
+punit_read_blocks (grub_addr_t src, void *dst, grub_uint32_t count)
+{
+  grub_cln_spi_dma_read ((grub_uint32_t) src, punit_bounce, count);
+  grub_memmove (dst, punit_bounce, count * GRUB_CLN_SPI_BLOCK_SIZE);
+  return 1;
+}
+
+static int
+mmio_read_bytes (grub_addr_t src, void *dst, grub_uint32_t len)
+{
+  grub_memmove (dst, (void *) src, len);
+  return 1;
+}
+
+static struct grub_cln_spi_xfer punit_xfer =
+{
+  .name = "PUnit DMA",
+  .read_blocks = punit_read_blocks,
+  .read_bytes = mmio_read_bytes,
+  .max_blocks = PUNIT_DMA_BATCH,
+};
+
+static struct grub_cln_spi_xfer *spi_xfer = &punit_xfer;
+
+#else /* GRUB_UTIL */
+
+/* The grub shell has no flash until an image is registered.  */
+static struct grub_cln_spi_xfer *spi_xfer = 0;
+
+#endif /* GRUB_UTIL */
+
+void
+grub_cln_spi_xfer_register (struct grub_cln_spi_xfer *xfer)
+{
+  spi_xfer = xfer;
+}
+
+struct grub_cln_spi_xfer *
+grub_cln_spi_xfer_get (void)
+{
+  return spi_xfer;
+}
+
+int
+grub_cln_spi_read (grub_addr_t src, void *dst, grub_uint32_t len)
+{
+  grub_uint8_t *p = dst;
+  unsigned long long start = grub_rdtsc ();
+  grub_uint32_t head, count;
+  int ok = 1;
+
+  if (! spi_xfer)
+    {
+      errnum = ERR_READ;
+      return 0;
+    }
+
+  grub_cln_spi_stats.reads++;
+
+  head = (GRUB_CLN_SPI_BLOCK_SIZE - (src & (GRUB_CLN_SPI_BLOCK_SIZE - 1)))
+         & (GRUB_CLN_SPI_BLOCK_SIZE - 1);
+  if (! spi_xfer->read_blocks || len < head + GRUB_CLN_SPI_BULK_MIN)
+    head = len;
+
+  /* Bring the source up to a block boundary.  */
+  if (head)
+    {
+      ok = spi_xfer->read_bytes (src, p, head);
+      grub_cln_spi_stats.cpu_bytes += head;
+      src += head;
+      p += head;
+      len -= head;
+    }
+
+  /* Move whole blocks in as few transactions as the engine allows.  */
+  while (ok && len >= GRUB_CLN_SPI_BLOCK_SIZE)
+    {
+      count = len / GRUB_CLN_SPI_BLOCK_SIZE;
+      if (count > spi_xfer->max_blocks)
+        count = spi_xfer->max_blocks;
+
+      ok = spi_xfer->read_blocks (src, p, count);
+      grub_cln_spi_stats.batches++;
+      grub_cln_spi_stats.block_bytes += count * GRUB_CLN_SPI_BLOCK_SIZE;
+      src += count * GRUB_CLN_SPI_BLOCK_SIZE;
+      p += count * GRUB_CLN_SPI_BLOCK_SIZE;
+      len -= count * GRUB_CLN_SPI_BLOCK_SIZE;
+    }
+
+  /* And the tail.  */
+  if (ok && len)
+    {
+      ok = spi_xfer->read_bytes (src, p, len);
+      grub_cln_spi_stats.cpu_bytes += len;
+    }
+
+  grub_cln_spi_stats.cycles += grub_rdtsc () - start;
+
+  if (! ok)
+    {
+      errnum = ERR_READ;
+      return 0;
+    }
+
+  return 1;
+}
+
+/* spibench [--kernel | --initrd | --config] [--chunk=SIZE] */
+int
+grub_cln_spi_bench (char *arg, int flags)
+{
+  grub_cln_asset_type type = GRUB_CLN_ASSET_KERNEL;
+  unsigned short int *in_spi = &grub_cln_linux_spi;
+  unsigned short int saved;
+  const char *what = "kernel";
+  int chunk = 0, size, done, len, ret = 0;
+  grub_uint32_t chunks = 0;
+  struct grub_cln_spi_stats *st = &grub_cln_spi_stats;
+  char *buf;
+
+  /* Deal with GNU-style long options.  */
+  while (1)
+    {
+      if (grub_memcmp (arg, "--kernel", 8) == 0)
+        {
+          type = GRUB_CLN_ASSET_KERNEL;
+          in_spi = &grub_cln_linux_spi;
+          what = "kernel";
+        }
+      else if (grub_memcmp (arg, "--initrd", 8) == 0)
+        {
+          type = GRUB_CLN_ASSET_INITRD;
+          in_spi = &grub_cln_initrd_spi;
+          what = "initrd";
+        }
+      else if (grub_memcmp (arg, "--config", 8) == 0)
+        {
+          type = GRUB_CLN_ASSET_CONFIG;
+          in_spi = &grub_cln_loaded_from_spi;
+          what = "config";
+        }
+      else if (grub_memcmp (arg, "--chunk=", 8) == 0)
+        {
+          char *p = arg + 8;
+
+          if (! safe_parse_maxint (&p, &chunk))
+            return 1;
+        }
+      else
+        break;
+
+      arg = skip_to (0, arg);
+    }
+
+  if (! spi_xfer)
+    {
+      grub_printf ("No SPI flash to read from\n");
+      errnum = ERR_DEV_VALUES;
+      return 1;
+    }
+
+  /* The asset always comes from flash here.  */
+  saved = *in_spi;
+  *in_spi = 1;
+
+  if (! grub_cln_asset_open (type, 0))
+    {
+      *in_spi = saved;
+      return 1;
+    }
+
+  size = grub_cln_asset_size (type);
+  if (chunk <= 0 || chunk > size)
+    chunk = size;
+
+  grub_printf (" %s: %d bytes in flash, read through %s\n", what, size,
+               spi_xfer->name);
+
+  buf = chunk ? grub_alloc_pages (chunk) : 0;
+  if (chunk && ! buf)
+    {
+      errnum = ERR_WONT_FIT;
+      ret = 1;
+      goto out;
+    }
+
+  grub_memset (st, 0, sizeof (*st));
+  for (done = 0; done < size; done += len, chunks++)
+    {
+      len = size - done < chunk ? size - done : chunk;
+      if (grub_cln_asset_read (type, buf, len) != len)
+        {
+          ret = 1;
+          break;
+        }
+    }
+
+  if (! ret)
+    {
+      grub_printf (" Read in %u chunks of up to %d bytes, %u flash reads\n",
+                   chunks, chunk, st->reads);
+      grub_printf (" %llu bytes in %u batches of blocks, %llu by the CPU\n",
+                   (unsigned long long) st->block_bytes, st->batches,
+                   (unsigned long long) st->cpu_bytes);
+      grub_printf (" %llu cycles, %llu bytes per 1000 cycles\n",
+                   (unsigned long long) st->cycles,
+                   st->cycles ? (unsigned long long) done * 1000 / st->cycles
+                   : 0ULL);
+    }
+
+  if (buf)
+    grub_free_pages (buf, chunk);
+
+ out:
+  *in_spi = saved;
+  return ret;
+}
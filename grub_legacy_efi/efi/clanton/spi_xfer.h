@@ -0,0 +1,74 @@
+/*
+ * Copyright(c) 2013 Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Contact Information:
+ * Intel Corporation
+ */
+
+#ifndef GRUB_CLANTON_SPI_XFER_HEADER
+#define GRUB_CLANTON_SPI_XFER_HEADER     1
+
+#include <grub/types.h>
+
+/* PUnit DMA block transfer size, in bytes.  */
+#define GRUB_CLN_SPI_BLOCK_SIZE                 512
+
+/* Spans shorter than this are always copied by the CPU.  */
+#define GRUB_CLN_SPI_BULK_MIN                   (4 * GRUB_CLN_SPI_BLOCK_SIZE)
+
+/* A way of moving data out of SPI flash.  Addresses are flash MMIO
+   addresses, as found in the MFH.  */
+struct grub_cln_spi_xfer
+{
+  const char *name;
+  /* Copy COUNT blocks from the block aligned address SRC to DST.
+     COUNT is at most MAX_BLOCKS.  Return 0 on failure.  */
+  int (*read_blocks) (grub_addr_t src, void *dst, grub_uint32_t count);
+  /* Copy LEN bytes from SRC to DST, with no alignment requirement.
+     Return 0 on failure.  */
+  int (*read_bytes) (grub_addr_t src, void *dst, grub_uint32_t len);
+  grub_uint32_t max_blocks;
+};
+
+/* Transfer accounting, since the last reset.  */
+struct grub_cln_spi_stats
+{
+  grub_uint32_t reads;                  /* grub_cln_spi_read calls */
+  grub_uint32_t batches;                /* read_blocks calls */
+  grub_uint64_t block_bytes;            /* bytes moved by read_blocks */
+  grub_uint64_t cpu_bytes;              /* bytes moved by read_bytes */
+  grub_uint64_t cycles;                 /* TSC cycles spent in both */
+};
+
+extern struct grub_cln_spi_stats grub_cln_spi_stats;
+
+/* Route all flash reads through XFER.  */
+void grub_cln_spi_xfer_register (struct grub_cln_spi_xfer *xfer);
+
+/* Return the transfer engine in use.  */
+struct grub_cln_spi_xfer *grub_cln_spi_xfer_get (void);
+
+/* Copy LEN bytes of flash at SRC to DST.  The block aligned middle of a
+   long span goes through read_blocks, the edges through read_bytes.
+   Return 1 on success, or 0 with errnum set.  */
+int grub_cln_spi_read (grub_addr_t src, void *dst, grub_uint32_t len);
+
+/* DMA COUNT blocks from flash at SRC to DST using the PUnit.  DST must not
+   be in an IMR that locks the PUnit out.  */
+void grub_cln_spi_dma_read (grub_uint32_t src, void *dst,
+                            grub_uint32_t count);
+
+#endif /* ! GRUB_CLANTON_SPI_XFER_HEADER */
@@ -19,7 +19,7 @@
  */
 
 #include <clanton/flash.h>
-#include <clanton/intel_cln_sb.h>
+#include <clanton/spi_xfer.h>
 #include <clanton/test_module.h>
 #include <grub/cpu/linux.h>
 #include <shared.h>
@@ -46,58 +46,9 @@ struct __cln_error_trigger_struct __cln_err = {
   .state_sign_verify = 0,
 };
 
-/* PUnit DMA registers over side-band.  */
-#define PUNIT_SPI_DMA_COUNT_REG (0x60)
-#define PUNIT_SPI_DMA_DEST_REG  (0x61)
-#define PUNIT_SPI_DMA_SRC_REG   (0x62)
-
-/* PUnit DMA block transfer size, in bytes.  */
-#define SPI_DMA_BLOCK_SIZE 512
-
 /* Buffer to DMA 1 block from SPI */
-static grub_uint32_t spi_buffer[SPI_DMA_BLOCK_SIZE / sizeof (grub_uint32_t)];
-
-/* Read from SPI via PUnit DMA engine.  */
-static void
-spi_dma_read (grub_uint32_t *src, grub_uint32_t *dst,
-              grub_uint32_t dma_block_count)
-{
-  if (grub_cln_debug)
-    {
-      grub_printf ("%s: src=%p, dst=%p, count=%u\n", __func__, src, dst,
-                  dma_block_count);
-    }
-
-  /* Setup source and destination addresses.  */
-  intel_cln_sb_write_reg (SB_ID_PUNIT, CFG_WRITE_OPCODE, PUNIT_SPI_DMA_SRC_REG,
-                          (grub_uint32_t) src);
-  intel_cln_sb_write_reg (SB_ID_PUNIT, CFG_WRITE_OPCODE, PUNIT_SPI_DMA_DEST_REG,
-                          (grub_uint32_t) dst);
-
-  if (grub_cln_debug)
-    {
-      grub_printf ("%s: starting transaction\n", __func__);
-    }
-
-  /*
-     Setup the number of block to be copied over.  Transaction will start as
-     soon as the register is filled with value.
-   */
-  intel_cln_sb_write_reg (SB_ID_PUNIT, CFG_WRITE_OPCODE, PUNIT_SPI_DMA_COUNT_REG,
-                          dma_block_count);
-
-  /* Poll for completion.  */
-  while (dma_block_count > 0)
-    {
-      intel_cln_sb_read_reg (SB_ID_PUNIT, CFG_READ_OPCODE, PUNIT_SPI_DMA_COUNT_REG,
-                             &dma_block_count); 
-    }
-
-  if (grub_cln_debug)
-    {
-      grub_printf ("%s: transaction completed\n", __func__);
-    }
-}
+static grub_uint32_t spi_buffer[GRUB_CLN_SPI_BLOCK_SIZE
+                                / sizeof (grub_uint32_t)];
 
 /*
    Parse kernel command line for test-specific directives and set up test state
@@ -144,13 +95,13 @@ __cln_test_imr (void)
   if (! __cln_err.bad_imr)
     return;
 
-  spi_dma_read ((grub_uint32_t *) GRUB_CLN_MFH_ADDR, spi_buffer, 1);
+  grub_cln_spi_dma_read (GRUB_CLN_MFH_ADDR, spi_buffer, 1);
   grub_printf ("%s: PUnit DMAing %uB into temp buffer passed\n", __func__,
-               SPI_DMA_BLOCK_SIZE);
+               GRUB_CLN_SPI_BLOCK_SIZE);
 
   grub_printf ("%s: PUnit DMAing %uB into non-PUnit IMR @%p\n", __func__,
-               SPI_DMA_BLOCK_SIZE, p);
-  spi_dma_read ((grub_uint32_t *) GRUB_CLN_MFH_ADDR, p, 1);
+               GRUB_CLN_SPI_BLOCK_SIZE, p);
+  grub_cln_spi_dma_read (GRUB_CLN_MFH_ADDR, p, 1);
   grub_printf ("%s: BUG: PUnit DMA to non-PUnit IMR didn't fail!\n", __func__);
 }
 
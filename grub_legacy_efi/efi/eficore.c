@@ -209,10 +209,12 @@ grub_efi_exit_boot_services (grub_efi_uintn_t map_key)
   grub_efi_boot_services_t *b;
   grub_efi_status_t status;
 
+  bootprof_begin (BOOTPROF_EXIT_BOOT, 0);
   b = grub_efi_system_table->boot_services;
   status = Call_Service_2 (b->exit_boot_services ,
 				grub_efi_image_handle,
 				map_key);
+  bootprof_end (0);
   return status == GRUB_EFI_SUCCESS;
 }
 
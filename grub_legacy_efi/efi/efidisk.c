@@ -382,8 +382,42 @@ get_device_from_drive (int drive)
     return get_device (fd_devices, drive);
 }
 
-/* Low-level disk I/O.  Our stubbed version just returns a file
-   descriptor, not the actual geometry. */
+/* Set the unit GEOMETRY is best read in from the medium of D: its
+   optimal transfer granularity if it has one, or else its physical
+   block, aligned as the physical blocks are.  One that will not fit
+   the track buffer is no use to us.  */
+static void
+get_io_unit (struct grub_efidisk_data *d, struct geometry *geometry)
+{
+  grub_efi_block_io_media_t *m = d->block_io->media;
+  unsigned long max = BUFFERLEN / m->block_size;
+  unsigned long physical = 1;
+  unsigned long optimal = 0;
+
+  geometry->io_sectors = 1;
+  geometry->io_first = 0;
+
+  if (d->block_io->revision < GRUB_EFI_BLOCK_IO_REVISION2)
+    return;
+
+  if (m->logical_blocks_per_physical_block > 1
+      && m->logical_blocks_per_physical_block <= max)
+    physical = m->logical_blocks_per_physical_block;
+
+  if (d->block_io->revision >= GRUB_EFI_BLOCK_IO_REVISION3)
+    optimal = m->optimal_transfer_length_granularity;
+
+  if (optimal > 1 && optimal <= max && optimal % physical == 0)
+    geometry->io_sectors = optimal;
+  else
+    geometry->io_sectors = physical;
+
+  if (geometry->io_sectors > 1)
+    geometry->io_first = m->lowest_aligned_lba % geometry->io_sectors;
+}
+
+/* Low-level disk I/O.  The CHS geometry is made up, for the partition
+   tables; the reads themselves go by LBA, in units from get_io_unit.  */
 int
 get_diskinfo (int drive, struct geometry *geometry)
 {
@@ -395,6 +429,7 @@ get_diskinfo (int drive, struct geometry *geometry)
   geometry->total_sectors = d->block_io->media->last_block+1;
   geometry->sector_size = d->block_io->media->block_size;
   geometry->flags = BIOSDISK_FLAG_LBA_EXTENSION;
+  get_io_unit (d, geometry);
   geometry->sectors = 63;
   if (geometry->total_sectors / 63 < 255)
     geometry->heads = 1;
@@ -404,18 +439,27 @@ get_diskinfo (int drive, struct geometry *geometry)
   return 0;
 }
 
+unsigned long
+get_media_id (int drive)
+{
+  struct grub_efidisk_data *d;
+
+  d = get_device_from_drive (drive);
+  if (!d)
+    return 0;
+  return d->block_io->media->media_id;
+}
+
 int
-biosdisk (int subfunc, int drive, struct geometry *geometry,
-	  int sector, int nsec, int segment)
+biosdisk_direct (int subfunc, int drive, struct geometry *geometry,
+		 int sector, int nsec, char *buf)
 {
-  char *buf;
   struct grub_efidisk_data *d;
   int ret;
 
   d = get_device_from_drive (drive);
   if (!d)
     return -1;
-  buf = (char *) ((unsigned long) segment << 4);
   switch (subfunc)
     {
     case BIOSDISK_READ:
@@ -428,7 +472,15 @@ biosdisk (int subfunc, int drive, struct geometry *geometry,
       return -1;
     }
 
-  return 0;
+  return ret;
+}
+
+int
+biosdisk (int subfunc, int drive, struct geometry *geometry,
+	  int sector, int nsec, int segment)
+{
+  return biosdisk_direct (subfunc, drive, geometry, sector, nsec,
+			  (char *) ((unsigned long) segment << 4));
 }
 
 /* Some utility functions to map GRUB devices with EFI devices.  */
@@ -59,13 +59,20 @@ grub_efi_fini (void)
 void *
 grub_malloc (grub_size_t size)
 {
-  return grub_efi_allocate_pool (size);
+  return grub_efi_heap_alloc (size, 0);
+}
+
+/* Allocate SIZE bytes at a multiple of ALIGN, which is a power of two.  */
+void *
+grub_memalign (grub_size_t align, grub_size_t size)
+{
+  return grub_efi_heap_alloc (size, align);
 }
 
 void
 grub_free (void *p)
 {
-  grub_efi_free_pool (p);
+  grub_efi_heap_free (p);
 }
 
 char *
@@ -404,6 +411,12 @@ currticks (void)
   return grub_get_rtc ();
 }
 
+void
+microdelay (unsigned long usecs)
+{
+  grub_efi_stall (usecs);
+}
+
 static char *
 fix_path_name (char *path_name)
 {
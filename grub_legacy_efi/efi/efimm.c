@@ -233,6 +233,406 @@ grub_efi_free_pages (grub_efi_physical_address_t address,
   Call_Service_2 (b->free_pages ,address, pages);
 }
 
+/* Allocate pages for SIZE bytes below 2GB, for stage2's own buffers.  */
+void *
+grub_alloc_pages (unsigned long size)
+{
+  return grub_efi_allocate_pages (0, BYTES_TO_PAGES (size + 0xfff));
+}
+
+void
+grub_free_pages (void *addr, unsigned long size)
+{
+  grub_efi_free_pages ((grub_addr_t) addr, BYTES_TO_PAGES (size + 0xfff));
+}
+
+/* The heap behind grub_malloc.  Pages are taken from the firmware an
+   arena at a time, and only when the arenas so far are full, so that
+   most allocations and frees do not call the firmware at all.
+
+   Requests of up to HEAP_SLAB_MAX bytes are served from slabs, pages
+   cut into objects of one size class.  The rest, and the slab pages
+   themselves, are blocks taken first-fit from the free list of an
+   arena, which is kept in address order so that a freed block merges
+   with its neighbours.  A request that the heap cannot hold goes to
+   the firmware pool as before.  */
+
+#define HEAP_PAGE_SIZE		0x1000
+#define HEAP_MAX_ARENAS		8
+
+/* Blocks are multiples of this, and what they hold is aligned to it.  */
+#define HEAP_ALIGN		16
+
+/* The size classes of the slabs are HEAP_SLAB_MIN << N.  */
+#define HEAP_SLAB_MIN		16
+#define HEAP_SLAB_MAX		512
+#define HEAP_CLASSES		6
+
+#define HEAP_ALIGN_UP(x, align)	(((x) + (align) - 1) & ~((align) - 1))
+
+struct heap_block
+{
+  /* The size of the block, this header included.  */
+  grub_size_t size;
+  /* The next free block, or HEAP_BLOCK_USED.  */
+  struct heap_block *next;
+} __attribute__ ((aligned (HEAP_ALIGN)));
+
+#define HEAP_BLOCK_USED		((struct heap_block *) 1)
+#define HEAP_MIN_BLOCK		(sizeof (struct heap_block) + HEAP_ALIGN)
+
+/* The header at the start of a slab page.  */
+struct heap_slab
+{
+  /* The next slab of the class with a free object.  */
+  struct heap_slab *next;
+  /* The first free object, each of which holds the next.  */
+  void *free;
+  int used;
+  int count;
+} __attribute__ ((aligned (HEAP_ALIGN)));
+
+struct heap_arena
+{
+  char *base;
+  grub_size_t size;
+  /* For each page, one more than the size class of the slab in it, or
+     zero if it is not a slab.  Kept at the start of the arena.  */
+  grub_uint8_t *page_class;
+  struct heap_block *free;
+};
+
+static struct heap_arena heap_arenas[HEAP_MAX_ARENAS];
+static int heap_num_arenas;
+
+/* The slabs of each class that have a free object.  */
+static struct heap_slab *heap_slabs[HEAP_CLASSES];
+
+static struct grub_heap_stats heap_stats;
+
+/* Take a free block of SIZE bytes, the header included, out of ARENA,
+   placing what it holds at a multiple of ALIGN.  */
+static struct heap_block *
+arena_alloc (struct heap_arena *arena, grub_size_t size, grub_size_t align)
+{
+  struct heap_block **link, *b;
+
+  for (link = &arena->free; (b = *link) != 0; link = &b->next)
+    {
+      grub_addr_t start = (grub_addr_t) b;
+      grub_addr_t data = HEAP_ALIGN_UP (start + sizeof (*b), align);
+      grub_size_t lead;
+
+      /* A gap in front is left as a free block, so it must be big
+	 enough for one.  */
+      while (data - sizeof (*b) != start
+	     && data - sizeof (*b) - start < HEAP_MIN_BLOCK)
+	data += align;
+
+      lead = data - sizeof (*b) - start;
+      if (lead + size > b->size)
+	continue;
+
+      if (lead)
+	{
+	  struct heap_block *nb = (struct heap_block *) (data - sizeof (*b));
+
+	  nb->size = b->size - lead;
+	  nb->next = b->next;
+	  b->size = lead;
+	  b->next = nb;
+	  link = &b->next;
+	  b = nb;
+	}
+
+      if (b->size - size >= HEAP_MIN_BLOCK)
+	{
+	  struct heap_block *rest = (struct heap_block *) ((char *) b + size);
+
+	  rest->size = b->size - size;
+	  rest->next = b->next;
+	  b->size = size;
+	  b->next = rest;
+	}
+
+      *link = b->next;
+      b->next = HEAP_BLOCK_USED;
+      return b;
+    }
+
+  return 0;
+}
+
+/* Put the block B back into the free list of ARENA.  */
+static void
+arena_free (struct heap_arena *arena, struct heap_block *b)
+{
+  struct heap_block **link = &arena->free, *prev = 0;
+
+  while (*link && *link < b)
+    {
+      prev = *link;
+      link = &prev->next;
+    }
+
+  b->next = *link;
+  *link = b;
+
+  if (b->next && (char *) b + b->size == (char *) b->next)
+    {
+      b->size += b->next->size;
+      b->next = b->next->next;
+    }
+
+  if (prev && (char *) prev + prev->size == (char *) b)
+    {
+      prev->size += b->size;
+      prev->next = b->next;
+    }
+}
+
+/* Reserve another arena with room for a block of NEED bytes.  Each is
+   as big as all the others together, so that the heap doubles.  */
+static struct heap_arena *
+heap_grow (grub_size_t need)
+{
+  struct heap_arena *arena;
+  grub_size_t size, map;
+  struct heap_block *b;
+
+  if (heap_num_arenas == HEAP_MAX_ARENAS)
+    return 0;
+
+  size = heap_stats.size;
+  if (size < MIN_HEAP_SIZE)
+    size = MIN_HEAP_SIZE;
+  while (size < MAX_HEAP_SIZE
+	 && size < HEAP_ALIGN_UP (size / HEAP_PAGE_SIZE, HEAP_ALIGN) + need)
+    size *= 2;
+  if (size > MAX_HEAP_SIZE - heap_stats.size)
+    size = MAX_HEAP_SIZE - heap_stats.size;
+
+  map = HEAP_ALIGN_UP (size / HEAP_PAGE_SIZE, HEAP_ALIGN);
+  if (size < map + need)
+    return 0;
+
+  arena = &heap_arenas[heap_num_arenas];
+  arena->base = grub_efi_allocate_pages (0, BYTES_TO_PAGES (size));
+  if (! arena->base)
+    return 0;
+
+  arena->size = size;
+  arena->page_class = (grub_uint8_t *) arena->base;
+  grub_memset (arena->page_class, 0, map);
+
+  b = (struct heap_block *) (arena->base + map);
+  b->size = size - map;
+  b->next = 0;
+  arena->free = b;
+
+  heap_num_arenas++;
+  heap_stats.size += size;
+  heap_stats.arenas++;
+  return arena;
+}
+
+/* Take a block for SIZE bytes aligned to ALIGN from any arena, growing
+   the heap if none has room.  */
+static struct heap_block *
+heap_alloc_block (grub_size_t size, grub_size_t align)
+{
+  struct heap_block *b;
+  struct heap_arena *arena;
+  int i;
+
+  if (size > MAX_HEAP_SIZE || align > MIN_HEAP_SIZE)
+    return 0;
+
+  size = HEAP_ALIGN_UP (size + sizeof (*b), HEAP_ALIGN);
+  if (align < HEAP_ALIGN)
+    align = HEAP_ALIGN;
+
+  for (i = 0; i < heap_num_arenas; i++)
+    {
+      b = arena_alloc (&heap_arenas[i], size, align);
+      if (b)
+	return b;
+    }
+
+  arena = heap_grow (size + align + HEAP_MIN_BLOCK);
+  return arena ? arena_alloc (arena, size, align) : 0;
+}
+
+static struct heap_arena *
+heap_find_arena (void *p)
+{
+  int i;
+
+  for (i = 0; i < heap_num_arenas; i++)
+    if ((char *) p >= heap_arenas[i].base
+	&& (char *) p < heap_arenas[i].base + heap_arenas[i].size)
+      return &heap_arenas[i];
+
+  return 0;
+}
+
+static void *
+slab_alloc (int class)
+{
+  struct heap_slab *s = heap_slabs[class];
+  grub_size_t objsize = HEAP_SLAB_MIN << class;
+  char *obj;
+
+  if (! s)
+    {
+      struct heap_block *b;
+      struct heap_arena *arena;
+
+      b = heap_alloc_block (HEAP_PAGE_SIZE, HEAP_PAGE_SIZE);
+      if (! b)
+	return 0;
+
+      s = (struct heap_slab *) (b + 1);
+      arena = heap_find_arena (s);
+      arena->page_class[((char *) s - arena->base) / HEAP_PAGE_SIZE]
+	= class + 1;
+
+      s->next = 0;
+      s->free = 0;
+      s->used = 0;
+      s->count = 0;
+      for (obj = (char *) (s + 1);
+	   obj + objsize <= (char *) s + HEAP_PAGE_SIZE;
+	   obj += objsize)
+	{
+	  *(void **) obj = s->free;
+	  s->free = obj;
+	  s->count++;
+	}
+
+      heap_slabs[class] = s;
+      heap_stats.slabs++;
+    }
+
+  obj = s->free;
+  s->free = *(void **) obj;
+
+  /* A full slab has nothing more to give.  */
+  if (++s->used == s->count)
+    heap_slabs[class] = s->next;
+
+  heap_stats.in_use += objsize;
+  return obj;
+}
+
+static void
+slab_free (struct heap_arena *arena, int class, void *obj)
+{
+  struct heap_slab *s, **link;
+
+  s = (struct heap_slab *) ((grub_addr_t) obj & ~(HEAP_PAGE_SIZE - 1));
+  *(void **) obj = s->free;
+  s->free = obj;
+  heap_stats.in_use -= HEAP_SLAB_MIN << class;
+
+  if (s->used-- == s->count)
+    {
+      s->next = heap_slabs[class];
+      heap_slabs[class] = s;
+    }
+
+  /* Give an empty slab back to the arena, unless it is the only one of
+     its class, which would only be made again on the next request.  */
+  if (s->used || (heap_slabs[class] == s && ! s->next))
+    return;
+
+  for (link = &heap_slabs[class]; *link != s; link = &(*link)->next)
+    ;
+  *link = s->next;
+
+  arena->page_class[((char *) s - arena->base) / HEAP_PAGE_SIZE] = 0;
+  arena_free (arena, (struct heap_block *) s - 1);
+  heap_stats.slabs--;
+}
+
+/* Allocate SIZE bytes at a multiple of ALIGN, or of HEAP_ALIGN if that
+   is more.  ALIGN is zero or a power of two.  */
+void *
+grub_efi_heap_alloc (grub_size_t size, grub_size_t align)
+{
+  struct heap_block *b;
+  void *p;
+
+  if (size <= HEAP_SLAB_MAX && align <= HEAP_ALIGN)
+    {
+      int class = 0;
+
+      while ((grub_size_t) HEAP_SLAB_MIN << class < size)
+	class++;
+
+      p = slab_alloc (class);
+    }
+  else
+    {
+      b = heap_alloc_block (size, align);
+      if (b)
+	heap_stats.in_use += b->size;
+      p = b ? b + 1 : 0;
+    }
+
+  if (! p)
+    {
+      /* The pool only promises 8 bytes of alignment.  */
+      if (align > 8)
+	return 0;
+
+      p = grub_efi_allocate_pool (size);
+      if (p)
+	heap_stats.pool++;
+      return p;
+    }
+
+  if (heap_stats.in_use > heap_stats.peak)
+    heap_stats.peak = heap_stats.in_use;
+
+  return p;
+}
+
+void
+grub_efi_heap_free (void *p)
+{
+  struct heap_arena *arena;
+  struct heap_block *b;
+  int class;
+
+  if (! p)
+    return;
+
+  arena = heap_find_arena (p);
+  if (! arena)
+    {
+      grub_efi_free_pool (p);
+      return;
+    }
+
+  class = arena->page_class[((char *) p - arena->base) / HEAP_PAGE_SIZE];
+  if (class)
+    {
+      slab_free (arena, class - 1, p);
+      return;
+    }
+
+  b = (struct heap_block *) p - 1;
+  heap_stats.in_use -= b->size;
+  arena_free (arena, b);
+}
+
+void
+grub_heap_stats (struct grub_heap_stats *stats)
+{
+  *stats = heap_stats;
+}
+
 /* Get the memory map as defined in the EFI spec. Return 1 if successful,
    return 0 if partial, or return -1 if an error occurs.
 
@@ -514,12 +914,21 @@ grub_efi_mm_init (void)
 
   grub_memset (allocated_pages, 0, ALLOCATED_PAGES_SIZE);
 
+  /* Reserve the first arena of the heap now, before anything else has
+     cut up the memory below 2GB.  */
+  heap_grow (0);
+
   update_e820_map (grub_e820_map, &grub_e820_nr_map);
 }
 
 void
 grub_efi_mm_fini (void)
 {
+  /* The arenas are among the pages freed below.  */
+  heap_num_arenas = 0;
+  grub_memset (heap_slabs, 0, sizeof (heap_slabs));
+  grub_memset (&heap_stats, 0, sizeof (heap_stats));
+
   if (allocated_pages)
     {
       unsigned i;
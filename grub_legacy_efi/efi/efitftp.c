@@ -11,7 +11,8 @@ struct tftp_info tftp_info = {
 	.LoadedImage = NULL,
 	.Pxe = NULL,
 	.ServerIp = NULL,
-	.BasePath = NULL
+	.BasePath = NULL,
+	.BlockSize = TFTP_BLKSIZE_DEFAULT
 };
 
 /*
@@ -29,18 +30,145 @@ struct tftp_info tftp_info = {
  * BootpBootFile: X86PC/UNDI/pxelinux/bootx64.efi
  */
 
+/*
+ * Return the path of Filename on the server, in memory from grub_malloc.
+ */
+char *tftp_full_path(char *Filename)
+{
+	char *FullPath;
+
+	if (tftp_info.BasePath) {
+		int PathSize = 0;
+		PathSize = strlen(tftp_info.BasePath) + 2 + strlen(Filename);
+		FullPath = grub_malloc(PathSize);
+		if (FullPath)
+			grub_sprintf(FullPath, "%s/%s", tftp_info.BasePath,
+				     Filename);
+	} else {
+		FullPath = grub_malloc(strlen(Filename) + 1);
+		if (FullPath)
+			strcpy(FullPath, Filename);
+	}
+	return FullPath;
+}
+
+/*
+ * Return true if the failure RC of an Mtftp call could be the fault of
+ * the block size: the server refused the option, the firmware would
+ * not ask for it, or the fragmented packets never arrived.  A missing
+ * file is not.
+ */
+static int tftp_blksize_failure(grub_efi_status_t rc)
+{
+	EFI_PXE_BASE_CODE_MODE *Mode = tftp_info.Pxe->Mode;
+
+	if (rc == GRUB_EFI_SUCCESS || rc == GRUB_EFI_BUFFER_TOO_SMALL ||
+	    rc == GRUB_EFI_NOT_FOUND)
+		return 0;
+	if (rc == GRUB_EFI_TFTP_ERROR)
+		return Mode->TftpErrorReceived &&
+		       Mode->TftpError.ErrorCode == TFTP_ERR_OPTION;
+	return 1;
+}
+
+/*
+ * Run one Mtftp operation, asking for blocks of tftp_info.BlockSize
+ * bytes.  Each block is a round trip, so the fewer the better.  If the
+ * larger blocks fail, try again with the 512-byte blocks every server
+ * has, and if that works, keep to them.
+ */
+grub_efi_status_t tftp_mtftp(
+	EFI_PXE_BASE_CODE_TFTP_OPCODE OpCode,
+	char *Buffer,
+	grub_efi_uint64_t *BufferSize,
+	char *Filename)
+{
+	grub_efi_boolean_t Overwrite = 0;
+	grub_efi_boolean_t DontUseBuffer = 0;
+	grub_efi_uint64_t Size = *BufferSize;
+	grub_efi_uintn_t BlockSize = tftp_info.BlockSize;
+	grub_efi_status_t rc;
+	char *FullPath;
+
+	FullPath = tftp_full_path(Filename);
+	if (!FullPath)
+		return GRUB_EFI_OUT_OF_RESOURCES;
+
+	rc = Call_Service_10(tftp_info.Pxe->Mtftp, tftp_info.Pxe, OpCode,
+		Buffer, Overwrite, BufferSize, &BlockSize, tftp_info.ServerIp,
+		FullPath, NULL, DontUseBuffer);
+	if (tftp_info.BlockSize != TFTP_BLKSIZE_MIN &&
+	    tftp_blksize_failure(rc)) {
+		*BufferSize = Size;
+		BlockSize = TFTP_BLKSIZE_MIN;
+		rc = Call_Service_10(tftp_info.Pxe->Mtftp, tftp_info.Pxe,
+			OpCode, Buffer, Overwrite, BufferSize, &BlockSize,
+			tftp_info.ServerIp, FullPath, NULL, DontUseBuffer);
+		if (rc == GRUB_EFI_SUCCESS || rc == GRUB_EFI_BUFFER_TOO_SMALL) {
+			grub_printf("TFTP block size %d refused, using %d\n",
+				    tftp_info.BlockSize, TFTP_BLKSIZE_MIN);
+			tftp_info.BlockSize = TFTP_BLKSIZE_MIN;
+		}
+	}
+	grub_free(FullPath);
+	return rc;
+}
+
+/*
+ * The files the server has said it does not have.  Nothing is put on
+ * the server while we run, so asking again would only cost another
+ * round trip.  When the list is full, the oldest is forgotten.
+ */
+#define TFTP_MISSING_MAX	32
+static char *Missing[TFTP_MISSING_MAX];
+static int NextMissing;
+
+int tftp_known_missing(char *Filename)
+{
+	int i;
+
+	for (i = 0; i < TFTP_MISSING_MAX; i++)
+		if (Missing[i] && !strcmp(Missing[i], Filename))
+			return 1;
+	return 0;
+}
+
+void tftp_note_missing(char *Filename)
+{
+	char *Name;
+
+	if (tftp_known_missing(Filename))
+		return;
+	Name = grub_malloc(strlen(Filename) + 1);
+	if (!Name)
+		return;
+	strcpy(Name, Filename);
+
+	grub_free(Missing[NextMissing]);
+	Missing[NextMissing] = Name;
+	NextMissing = (NextMissing + 1) % TFTP_MISSING_MAX;
+}
+
+/* Return true if the failure RC of an Mtftp call means there is no such
+   file.  */
+static int tftp_not_found(grub_efi_status_t rc)
+{
+	EFI_PXE_BASE_CODE_MODE *Mode = tftp_info.Pxe->Mode;
+
+	if (rc == GRUB_EFI_NOT_FOUND)
+		return 1;
+	return rc == GRUB_EFI_TFTP_ERROR && Mode->TftpErrorReceived &&
+	       Mode->TftpError.ErrorCode == TFTP_ERR_NOT_FOUND;
+}
+
 static grub_efi_status_t tftp_get_file_size_defective_buffer_fallback(
 	char *Filename,
 	grub_efi_uintn_t *Size)
 {
 	EFI_PXE_BASE_CODE_TFTP_OPCODE OpCode = EFI_PXE_BASE_CODE_TFTP_READ_FILE;
 	char *Buffer = NULL;
-	grub_efi_boolean_t Overwrite = 0;
-	grub_efi_boolean_t DontUseBuffer = 0;
 	grub_efi_uint64_t BufferSize = 4096;
-	grub_efi_uintn_t BlockSize = 512;
 	grub_efi_status_t rc = GRUB_EFI_BUFFER_TOO_SMALL;
-	char *FullPath = NULL;
 
 	while (rc == GRUB_EFI_BUFFER_TOO_SMALL) {
 		char *NewBuffer;
@@ -55,25 +183,10 @@ static grub_efi_status_t tftp_get_file_size_defective_buffer_fallback(
 			return GRUB_EFI_OUT_OF_RESOURCES;
 		Buffer = NewBuffer;
 
-		if (tftp_info.BasePath) {
-			int PathSize = 0;
-			PathSize = strlen(tftp_info.BasePath) + 2 +
-				   strlen(Filename);
-			FullPath = grub_malloc(PathSize);
-			grub_sprintf(FullPath, "%s/%s", tftp_info.BasePath,
-				     Filename);
-		} else {
-			FullPath = grub_malloc(strlen(Filename));
-			strcpy(FullPath, Filename);
-		}
-
-		rc = Call_Service_10(tftp_info.Pxe->Mtftp, tftp_info.Pxe,
-			OpCode, Buffer, Overwrite, &BufferSize, &BlockSize,
-			tftp_info.ServerIp, FullPath, NULL, DontUseBuffer);
+		rc = tftp_mtftp(OpCode, Buffer, &BufferSize, Filename);
 		if (rc == GRUB_EFI_SUCCESS || rc == GRUB_EFI_BUFFER_TOO_SMALL)
 			*Size = BufferSize;
 	}
-	grub_free(FullPath);
 	grub_free(Buffer);
 	return rc;
 }
@@ -84,31 +197,19 @@ grub_efi_status_t tftp_get_file_size(
 {
 	EFI_PXE_BASE_CODE_TFTP_OPCODE OpCode = EFI_PXE_BASE_CODE_TFTP_GET_FILE_SIZE;
 	char Buffer[8192];
-	grub_efi_boolean_t Overwrite = 0;
-	grub_efi_boolean_t DontUseBuffer = 0;
 	grub_efi_uint64_t BufferSize = 8192;
-	grub_efi_uintn_t BlockSize = 512;
 	grub_efi_status_t rc;
-	char *FullPath = NULL;
 
-	if (tftp_info.BasePath) {
-		int PathSize = 0;
-		PathSize = strlen(tftp_info.BasePath) + 2 + strlen(Filename);
-		FullPath = grub_malloc(PathSize);
-		grub_sprintf(FullPath, "%s/%s", tftp_info.BasePath, Filename);
-	} else {
-		FullPath = grub_malloc(strlen(Filename));
-		strcpy(FullPath, Filename);
-	}
+	if (tftp_known_missing(Filename))
+		return GRUB_EFI_NOT_FOUND;
 
-	rc = Call_Service_10(tftp_info.Pxe->Mtftp, tftp_info.Pxe, OpCode,
-		Buffer, Overwrite, &BufferSize, &BlockSize, tftp_info.ServerIp,
-		FullPath, NULL, DontUseBuffer);
+	rc = tftp_mtftp(OpCode, Buffer, &BufferSize, Filename);
 	if (rc == GRUB_EFI_BUFFER_TOO_SMALL)
 		rc = tftp_get_file_size_defective_buffer_fallback(Filename, Size);
-	if (rc == GRUB_EFI_SUCCESS)
+	else if (rc == GRUB_EFI_SUCCESS)
 		*Size = BufferSize;
-	grub_free(FullPath);
+	else if (tftp_not_found(rc))
+		tftp_note_missing(Filename);
 	return rc;
 }
 
@@ -118,29 +219,33 @@ static grub_efi_status_t tftp_read_file(
 	grub_efi_uint64_t BufferSize)
 {
 	EFI_PXE_BASE_CODE_TFTP_OPCODE OpCode = EFI_PXE_BASE_CODE_TFTP_READ_FILE;
-	grub_efi_boolean_t Overwrite = 0;
-	grub_efi_boolean_t DontUseBuffer = 0;
-	grub_efi_uintn_t BlockSize = 512;
+	unsigned long long Start = bootprof_tsc();
+	unsigned long long Usecs;
 	grub_efi_status_t rc;
-	char *FullPath = NULL;
 
-	if (tftp_info.BasePath) {
-		int PathSize = 0;
-		PathSize = strlen(tftp_info.BasePath) + 2 + strlen(Filename);
-		FullPath = grub_malloc(PathSize);
-		grub_sprintf(FullPath, "%s/%s", tftp_info.BasePath, Filename);
-	} else {
-		FullPath = grub_malloc(strlen(Filename));
-		strcpy(FullPath, Filename);
-	}
+	rc = tftp_mtftp(OpCode, Buffer, &BufferSize, Filename);
 
-	rc = Call_Service_10(tftp_info.Pxe->Mtftp, tftp_info.Pxe, OpCode,
-		Buffer, Overwrite, &BufferSize, &BlockSize, tftp_info.ServerIp,
-		FullPath, NULL, DontUseBuffer);
-	grub_free(FullPath);
+	/* The rate tells whether the block size suits the network.  */
+	Usecs = bootprof_usecs(bootprof_tsc() - Start);
+	if (debug && rc == GRUB_EFI_SUCCESS && Usecs)
+		grub_printf("TFTP: %u bytes in %u ms, %u KiB/s, %d-byte blocks\n",
+			    (unsigned) BufferSize, (unsigned) (Usecs / 1000),
+			    (unsigned) (BufferSize * 1000000 / 1024 / Usecs),
+			    tftp_info.BlockSize);
 	return rc;
 }
 
+/* Ask for blocks of SIZE bytes from now on.  */
+void efi_tftp_set_block_size(int size)
+{
+	tftp_info.BlockSize = size;
+}
+
+int efi_tftp_get_block_size(void)
+{
+	return tftp_info.BlockSize;
+}
+
 int
 efi_tftp_mount (void)
 {
@@ -150,26 +255,91 @@ efi_tftp_mount (void)
 	return 1;
 }
 
+/*
+ * The start of the open file, for the reads that only look at its
+ * header, such as the test for a compressed file.  When the file is
+ * larger than Head, the firmware stores only the whole blocks that fit,
+ * so HeadSize is what is known to be there.
+ */
+static char Head[TFTP_HEAD_SIZE];
+static grub_efi_uint64_t HeadSize;
+static int HeadRead;
+
+static int tftp_read_head(void)
+{
+	EFI_PXE_BASE_CODE_TFTP_OPCODE OpCode = EFI_PXE_BASE_CODE_TFTP_READ_FILE;
+	grub_efi_uint64_t BufferSize = sizeof(Head);
+	grub_efi_status_t rc;
+
+	rc = tftp_mtftp(OpCode, Head, &BufferSize, tftp_info.LastPath);
+	if (rc == GRUB_EFI_SUCCESS)
+		HeadSize = BufferSize;
+	else if (rc == GRUB_EFI_BUFFER_TOO_SMALL)
+		HeadSize = sizeof(Head) / tftp_info.BlockSize *
+			   tftp_info.BlockSize;
+	else
+		return 0;
+
+	HeadRead = 1;
+	return 1;
+}
+
+/*
+ * A read of the whole file, as for a kernel, an initrd or a module, is
+ * downloaded straight to where it is wanted.  A read within the head of
+ * the file is served from the head.  Anything else is served from a
+ * copy of the whole file, downloaded the first time it is needed.
+ */
 int
 efi_tftp_read (char *addr, int size)
 {
-	int rc;
+	grub_efi_status_t rc;
 
 	if (tftp_info.LastPath == NULL) {
 		grub_printf(" = 0 (no path known)\n");
 		return 0;
 	}
-	if (tftp_info.Buffer == NULL) {
-		grub_printf(" = 0 (no file open)\n");
-		return 0;
-	}
 	if (filemax == -1) {
 		grub_printf(" = 0 (file not found)\n");
 		return 0;
 	}
-	if (filepos == 0) {
+
+	if (tftp_info.Buffer == NULL) {
+		if (filepos == 0 && size == filemax) {
+			rc = tftp_read_file(tftp_info.LastPath, addr,
+					    filemax);
+			if (rc != GRUB_EFI_SUCCESS) {
+				errnum = ERR_READ;
+				return 0;
+			}
+			filepos = filemax;
+			return size;
+		}
+
+		if (filepos + size <= TFTP_HEAD_SIZE && ! HeadRead &&
+		    ! tftp_read_head()) {
+			errnum = ERR_READ;
+			return 0;
+		}
+		if (filepos + size <= HeadSize) {
+			grub_memmove(addr, Head + filepos, size);
+			filepos += size;
+			return size;
+		}
+
+		tftp_info.Buffer = grub_malloc(filemax);
+		if (tftp_info.Buffer == NULL) {
+			errnum = ERR_WONT_FIT;
+			return 0;
+		}
 		rc = tftp_read_file(tftp_info.LastPath, tftp_info.Buffer,
 				    filemax);
+		if (rc != GRUB_EFI_SUCCESS) {
+			grub_free(tftp_info.Buffer);
+			tftp_info.Buffer = NULL;
+			errnum = ERR_READ;
+			return 0;
+		}
 	}
 
 	grub_memmove(addr, tftp_info.Buffer+filepos, size);
@@ -204,15 +374,18 @@ efi_tftp_dir (char *dirname)
 
 	rc = tftp_get_file_size(name, &size);
 	if (rc == GRUB_EFI_SUCCESS) {
+		/* Drop what is left of a file that was never closed.  */
+		efi_tftp_close();
+
 		tftp_info.LastPath = grub_malloc(strlen(name) + 1);
 		sprintf(tftp_info.LastPath, "%s", name);
 		filemax = size;
 		filepos = 0;
 
-		tftp_info.Buffer = grub_malloc(filemax);
-
+		grub_free(name);
 		return 1;
 	}
+	grub_free(name);
 	return 0;
 }
 
@@ -225,4 +398,6 @@ efi_tftp_close (void)
 	tftp_info.LastPath = NULL;
 	grub_free(tftp_info.Buffer);
 	tftp_info.Buffer = NULL;
+	HeadSize = 0;
+	HeadRead = 0;
 }
@@ -1113,9 +1113,17 @@ struct grub_efi_block_io_media
   grub_efi_uint32_t io_align;
   grub_efi_uint8_t pad2[4];
   grub_efi_lba_t last_block;
+  /* Revision 2 and later.  */
+  grub_efi_lba_t lowest_aligned_lba;
+  grub_efi_uint32_t logical_blocks_per_physical_block;
+  /* Revision 3 and later.  */
+  grub_efi_uint32_t optimal_transfer_length_granularity;
 };
 typedef struct grub_efi_block_io_media grub_efi_block_io_media_t;
 
+#define GRUB_EFI_BLOCK_IO_REVISION2	0x00020001
+#define GRUB_EFI_BLOCK_IO_REVISION3	((2 << 16) | 31)
+
 struct grub_efi_block_io
 {
   grub_efi_uint64_t revision;
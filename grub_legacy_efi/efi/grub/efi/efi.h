@@ -68,6 +68,8 @@ char *grub_efi_get_filename (grub_efi_device_path_t * dp);
 grub_efi_device_path_t *grub_efi_get_device_path (grub_efi_handle_t handle);
 int grub_efi_exit_boot_services (grub_efi_uintn_t map_key);
 
+void *grub_efi_heap_alloc (grub_size_t size, grub_size_t align);
+void grub_efi_heap_free (void *p);
 void grub_efi_mm_init (void);
 void grub_efi_mm_fini (void);
 void grub_efi_init (void);
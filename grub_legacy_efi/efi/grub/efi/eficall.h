@@ -64,6 +64,12 @@ EFI_STATUS x64_call10(unsigned long func, unsigned long a,
 		      unsigned long f, unsigned long g,
 		      unsigned long h, unsigned long i,
 		      unsigned long j);
+EFI_STATUS x64_call11(unsigned long func, unsigned long a,
+		      unsigned long b, unsigned long c,
+		      unsigned long d, unsigned long e,
+		      unsigned long f, unsigned long g,
+		      unsigned long h, unsigned long i,
+		      unsigned long j, unsigned long k);
 
 #define Call_Service(func)                      x64_call0((unsigned long)func)
 
@@ -143,6 +149,20 @@ EFI_STATUS x64_call10(unsigned long func, unsigned long a,
 							  (unsigned long)i,    \
 							  (unsigned long)j)
 
+#define Call_Service_11(func,a,b,c,d,e,f,g,h,i,j,k) \
+					       x64_call11((unsigned long)func, \
+							  (unsigned long)a,    \
+							  (unsigned long)b,    \
+							  (unsigned long)c,    \
+							  (unsigned long)d,    \
+							  (unsigned long)e,    \
+							  (unsigned long)f,    \
+							  (unsigned long)g,    \
+							  (unsigned long)h,    \
+							  (unsigned long)i,    \
+							  (unsigned long)j,    \
+							  (unsigned long)k)
+
 #else
 
 typedef long EFI_STATUS;
@@ -157,6 +177,8 @@ typedef long EFI_STATUS;
 #define Call_Service_8(func,a,b,c,d,e,f,g,h)    func(a,b,c,d,e,f,g,h)
 #define Call_Service_9(func,a,b,c,d,e,f,g,h,i)  func(a,b,c,d,e,f,g,h,i)
 #define Call_Service_10(func,a,b,c,d,e,f,g,h,i,j)  func(a,b,c,d,e,f,g,h,i,j)
+#define Call_Service_11(func,a,b,c,d,e,f,g,h,i,j,k) \
+					func(a,b,c,d,e,f,g,h,i,j,k)
 #endif
 
 #endif
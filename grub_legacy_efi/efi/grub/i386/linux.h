@@ -55,7 +55,7 @@
 
 #ifndef ASM_FILE
 
-/* For the Linux/i386 boot protocol version 2.07.  */
+/* For the Linux/i386 boot protocol version 2.09.  */
 struct grub_linux_kernel_header
 {
   grub_uint8_t setup_sects;	/* The size of the setup in sectors */
@@ -86,8 +86,20 @@ struct grub_linux_kernel_header
   grub_uint32_t kernel_alignment;
   grub_uint8_t relocatable_kernel;
   grub_uint8_t pad2[3];
+  grub_uint32_t cmdline_size;	/* Maximum size of the command line */
   grub_uint32_t hardware_subarch;
   grub_uint64_t hardware_subarch_data;
+  grub_uint32_t payload_offset;
+  grub_uint32_t payload_length;
+  grub_uint64_t setup_data;	/* List of struct grub_linux_setup_data */
+} __attribute__ ((packed));
+
+/* An entry of the list at setup_data in the kernel header.  */
+struct grub_linux_setup_data
+{
+  grub_uint64_t next;		/* The next entry, or zero */
+  grub_uint32_t type;
+  grub_uint32_t len;		/* The size of the data that follows */
 } __attribute__ ((packed));
 
 /* Boot parameters for Linux based on 2.6.12. This is used by the setup
@@ -44,6 +44,7 @@ grub_uint8_t *grub_utf16_to_utf8 (grub_uint8_t * dest,
 				  grub_uint16_t * src, grub_size_t size);
 
 void *grub_malloc (grub_size_t size);
+void *grub_memalign (grub_size_t align, grub_size_t size);
 void grub_free (void *ptr);
 
 char *grub_strndup (const char *s, int n);
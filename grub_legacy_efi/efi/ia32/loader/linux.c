@@ -78,12 +78,35 @@ static grub_uint32_t sbh_len = 0;
 
 #define grub_file_size()    filemax
 
+/* The most loadable segments a multiboot kernel may have.  */
+#define MULTIBOOT_MAX_SEGMENTS	32
+
+/* The runs of pages that the segments of the multiboot kernel are loaded
+   into, each taken from the firmware on its own.  */
+static struct
+{
+  void *mem;
+  grub_efi_uintn_t pages;
+} mb_spans[MULTIBOOT_MAX_SEGMENTS];
+static int mb_num_spans;
+
 static inline grub_size_t
 page_align (grub_size_t size)
 {
   return (size + (1 << 12) - 1) & (~((1 << 12) - 1));
 }
 
+static void
+free_multiboot_spans (void)
+{
+  while (mb_num_spans > 0)
+    {
+      mb_num_spans--;
+      grub_efi_free_pages ((grub_addr_t) mb_spans[mb_num_spans].mem,
+			   mb_spans[mb_num_spans].pages);
+    }
+}
+
 static void
 free_pages (void)
 {
@@ -110,6 +133,90 @@ free_pages (void)
       grub_efi_free_pages ((grub_addr_t) mmap_buf, mmap_pages);
       mmap_buf = 0;
     }
+
+  free_multiboot_spans ();
+}
+
+/* Room for the events still to come when the boot profile is sized,
+   ExitBootServices among them.  */
+#define BOOTPROF_SLACK		16
+
+static void *bootprof_mem;
+static grub_efi_uintn_t bootprof_pages;
+static int bootprof_size;
+
+static void
+bootprof_free (void)
+{
+  if (bootprof_mem)
+    {
+      grub_efi_free_pages ((grub_addr_t) bootprof_mem, bootprof_pages);
+      bootprof_mem = 0;
+    }
+}
+
+/* Allocate the memory that the boot profile is handed to the OS in,
+   with EXTRA bytes after it for whatever passes it on.  This must be
+   done before the memory map for ExitBootServices is taken, and while
+   the TSC can still be calibrated.  */
+static void *
+bootprof_alloc (int extra)
+{
+  bootprof_free ();
+  bootprof_tsc_khz ();
+
+  bootprof_size = (bootprof_export_size ()
+		   + BOOTPROF_SLACK * sizeof (struct bootprof_event));
+  bootprof_pages = page_align (bootprof_size + extra) >> 12;
+  bootprof_mem = grub_efi_allocate_pages (0, bootprof_pages);
+
+  return bootprof_mem;
+}
+
+/* Pass the boot profile to Linux in a setup_data entry.  */
+static void
+bootprof_setup_data (struct grub_linux_kernel_header *lh)
+{
+  struct grub_linux_setup_data *sd = bootprof_mem;
+
+  /* The list at setup_data is there from boot protocol 2.09.  */
+  if (! sd || grub_le_to_cpu16 (lh->version) < 0x0209)
+    return;
+
+  sd->type = BOOTPROF_MAGIC;
+  sd->len = bootprof_export (sd + 1, bootprof_size);
+  sd->next = lh->setup_data;
+  lh->setup_data = (grub_uint32_t) (grub_addr_t) sd;
+}
+
+/* Pass the boot profile to a multiboot kernel as one more module after
+   the MODS there are already.  */
+static void
+bootprof_module (struct multiboot_info *info, int mods)
+{
+  struct mod_list *mll;
+  char *cmdline;
+  int size;
+
+  if (! bootprof_mem)
+    return;
+
+  size = bootprof_export (bootprof_mem, bootprof_size);
+  mll = (struct mod_list *) ((char *) bootprof_mem + bootprof_size);
+  cmdline = (char *) (mll + mods + 1);
+
+  if (mods)
+    grub_memmove (mll, (void *) info->mods_addr, mods * sizeof (*mll));
+  grub_strcpy (cmdline, "bootprof");
+
+  mll[mods].mod_start = (unsigned long) bootprof_mem;
+  mll[mods].mod_end = mll[mods].mod_start + size;
+  mll[mods].cmdline = (unsigned long) cmdline;
+  mll[mods].pad = 0;
+
+  info->mods_addr = (unsigned long) mll;
+  info->mods_count = mods + 1;
+  info->flags |= MB_INFO_MODS;
 }
 
 /* Allocate pages for the real mode code and the protected mode code
@@ -258,14 +365,20 @@ multi_boot (int start, int mb_info)
 {
   /* memos is modified so that it doesn't need any information
    * from mb_info. So mb_info is not used now */
+  struct multiboot_info *info = (struct multiboot_info *) mb_info;
   grub_efi_uintn_t map_key;
   grub_efi_uintn_t desc_size;
   grub_efi_uint32_t desc_version;
+  int mods = (info->flags & MB_INFO_MODS) ? info->mods_count : 0;
+
+  /* No profile is not worth failing the boot over.  */
+  bootprof_alloc ((mods + 1) * sizeof (struct mod_list) + sizeof ("bootprof"));
 
   if (grub_efi_get_memory_map (&map_key, &desc_size, &desc_version) <= 0)
   {
     grub_printf ("Cannot get memory map\n");
     errnum = ERR_BOOT_FAILURE;
+    bootprof_free ();
     return;
   }
 
@@ -276,9 +389,13 @@ multi_boot (int start, int mb_info)
   {
     grub_printf ("cannot exit boot services");
     errnum = ERR_BOOT_FAILURE;
+    bootprof_free ();
     return;
   }
 
+  bootprof_mark ("multi_boot");
+  bootprof_module (info, mods);
+
   asm volatile ("cli"); 
 
   /* set gdt, actually we don't need this... */
@@ -305,13 +422,18 @@ big_linux_boot (void)
   int i;
 
   params = real_mode_mem;
+  lh = &params->hdr;
 
   graphics_set_kernel_params (params);
 
+  if (grub_le_to_cpu16 (lh->version) >= 0x0209)
+    bootprof_alloc (sizeof (struct grub_linux_setup_data));
+
   if (grub_efi_get_memory_map (&map_key, &desc_size, &desc_version) <= 0)
     {
       grub_printf ("cannot get memory map");
       errnum = ERR_BOOT_FAILURE;
+      bootprof_free ();
       return;
     }
 
@@ -326,12 +448,12 @@ big_linux_boot (void)
     {
       grub_printf ("cannot exit boot services");
       errnum = ERR_BOOT_FAILURE;
+      bootprof_free ();
       return;
     }
     
   /* Note that no boot services are available from here.  */
 
-  lh = &params->hdr;
   /* Pass EFI parameters.  */
   if (grub_le_to_cpu16 (lh->version) >= 0x0206) {
     params->version_0206.efi_mem_desc_size = desc_size;
@@ -352,6 +474,8 @@ big_linux_boot (void)
   }
 
 #ifdef __x86_64__
+  bootprof_setup_data (lh);
+
   /* copy our real mode transition code to 0x700 */
   memcpy ((void *) 0x700, switch_image, switch_size);
   asm volatile ( "mov $0x700, %%rdi" : :);
@@ -379,6 +503,7 @@ big_linux_boot (void)
   grub_strncat ((char *) real_mode_mem + 0x1000,
                  grub_cln_event_get_metrics (),
                  GRUB_LINUX_CL_END_OFFSET - GRUB_LINUX_CL_OFFSET + 1);
+  bootprof_setup_data (lh);
 
   if (0) {
     /* copy our real mode transition code to 0x7C00 */
@@ -448,6 +573,137 @@ cln_detect_early_uart (char **cmdline)
   grub_sprintf(p + offs, "%s", p + sizeof(QUARK_UART_MMIO_TOKEN) - 1);
 }
 
+/* Load the PT_LOAD segments of the ELF kernel whose header ELF is at
+   the start of BUFFER, and set END_ADDR to the end of the highest.  Only
+   the pages under the segments are taken, and only what the file does
+   not fill, the gaps between the segments and their BSS, is zeroed.  */
+static int
+load_multiboot_segments (Elf32_Ehdr *elf, unsigned char *buffer,
+			 unsigned long *end_addr)
+{
+  Elf32_Phdr *seg[MULTIBOOT_MAX_SEGMENTS], *p;
+  unsigned long start, end, done, bytes_read = 0, bytes_zeroed = 0;
+  int num = 0, i, j, k;
+  void *mem;
+
+  /* Find the segments, in order of address.  */
+  for (i = 0; i < elf->e_phnum; i++)
+    {
+      p = (Elf32_Phdr *) (buffer + elf->e_phoff + i * elf->e_phentsize);
+      if (p->p_type != PT_LOAD || ! p->p_memsz)
+	continue;
+
+      if (num == MULTIBOOT_MAX_SEGMENTS || p->p_filesz > p->p_memsz
+	  || p->p_paddr + p->p_memsz < p->p_paddr)
+	{
+	  errnum = ERR_EXEC_FORMAT;
+	  return 0;
+	}
+
+      if (p->p_paddr < GRUB_MULTIBOOT_ADDR)
+	{
+	  errnum = ERR_BELOW_1MB;
+	  return 0;
+	}
+
+      for (j = num++; j > 0 && seg[j - 1]->p_paddr > p->p_paddr; j--)
+	seg[j] = seg[j - 1];
+      seg[j] = p;
+    }
+
+  if (! num)
+    {
+      errnum = ERR_EXEC_FORMAT;
+      return 0;
+    }
+
+  /* The pages of a kernel loaded before are in the way.  */
+  free_multiboot_spans ();
+
+  /* Take the pages under each run of segments that share or touch
+     pages, and zero what is not read into them.  Zeroing comes first,
+     so that where segments overlap, what is read wins.  */
+  for (i = 0; i < num; i = j)
+    {
+      start = seg[i]->p_paddr & ~(PAGE_SIZE - 1);
+      end = seg[i]->p_paddr + seg[i]->p_memsz;
+      for (j = i + 1; j < num && seg[j]->p_paddr <= page_align (end); j++)
+	if (seg[j]->p_paddr + seg[j]->p_memsz > end)
+	  end = seg[j]->p_paddr + seg[j]->p_memsz;
+      end = page_align (end);
+
+      mem = grub_efi_allocate_pages (start, (end - start) >> 12);
+      if (! mem)
+	{
+	  grub_printf ("Cannot allocate pages for multiboot kernel at 0x%x\n",
+		       start);
+	  errnum = ERR_WONT_FIT;
+	  return 0;
+	}
+
+      mb_spans[mb_num_spans].mem = mem;
+      mb_spans[mb_num_spans].pages = (end - start) >> 12;
+      mb_num_spans++;
+
+      done = seg[i]->p_paddr;
+      for (k = i; k < j; k++)
+	{
+	  p = seg[k];
+	  if (p->p_paddr > done)
+	    {
+	      grub_memset ((char *) done, 0, p->p_paddr - done);
+	      bytes_zeroed += p->p_paddr - done;
+	    }
+
+	  if (p->p_memsz > p->p_filesz)
+	    {
+	      grub_memset ((char *) p->p_paddr + p->p_filesz, 0,
+			   p->p_memsz - p->p_filesz);
+	      bytes_zeroed += p->p_memsz - p->p_filesz;
+	    }
+
+	  if (p->p_paddr + p->p_memsz > done)
+	    done = p->p_paddr + p->p_memsz;
+	}
+    }
+
+  start = seg[0]->p_paddr;
+  *end_addr = done;
+
+  /* Read the segments in the order they are in the file, so that a
+     compressed kernel is never read again from the start.  */
+  for (i = 1; i < num; i++)
+    for (j = i; j > 0 && seg[j - 1]->p_offset > seg[j]->p_offset; j--)
+      {
+	p = seg[j];
+	seg[j] = seg[j - 1];
+	seg[j - 1] = p;
+      }
+
+  for (i = 0; i < num; i++)
+    {
+      p = seg[i];
+      if (! p->p_filesz)
+	continue;
+
+      if (grub_seek (p->p_offset) < 0
+	  || grub_read ((char *) p->p_paddr, p->p_filesz) != p->p_filesz)
+	{
+	  grub_printf ("Reading ELF failed!\n");
+	  if (errnum == ERR_NONE)
+	    errnum = ERR_EXEC_FORMAT;
+	  return 0;
+	}
+
+      bytes_read += p->p_filesz;
+    }
+
+  grub_printf ("Loaded 0x%x-0x%x: %u bytes read, %u bytes zeroed,"
+	       " %d segments in %d spans\n", start, *end_addr,
+	       bytes_read, bytes_zeroed, num, mb_num_spans);
+  return 1;
+}
+
 int
 grub_load_multiboot (char *kernel, char *arg)
 {
@@ -455,8 +711,7 @@ grub_load_multiboot (char *kernel, char *arg)
   int len, i;
   extern int cur_addr;
   unsigned long flags = 0;
-  grub_size_t prot_size = 0;
-  entry_func real_entry_addr = 0;
+  unsigned long end_addr;
   Elf32_Ehdr *elf;
 
   if (!grub_open(kernel)) {
@@ -505,123 +760,16 @@ grub_load_multiboot (char *kernel, char *arg)
     goto fail;
   } 
 
-  /* allocate memory for elf loading */
-
-  /**
-   * grub_cln_asset_size is useful for SPI support
-   * prot_size = grub_cln_asset_size (GRUB_CLN_ASSET_KERNEL);
-   * grub_size_t real_size = 0;
-   * if (! allocate_pages (real_size , prot_size))
-   *   goto fail;
-   */
-
-  /* grub_file_size () returns filemax set by grub_open */
-  prot_size = grub_file_size ();
-  prot_mode_pages = (prot_size >> 12);
-  real_mode_pages = 0;
-  real_mode_mem = prot_mode_mem = 0;
-
-  /**
-   * Now, we try to allocate memory for the multiboot kernel. For simplicity, we
-   * will assume it starts at GRUB_MULTIBOOT_ADDR (1MB by default).
-   */
-  prot_mode_mem = grub_efi_allocate_pages (GRUB_MULTIBOOT_ADDR, prot_mode_pages);
-  if (! prot_mode_mem) {
-      grub_printf ("Cannot allocate pages for multiboot kernel\n");
-      errnum = ERR_WONT_FIT;
-      free_pages ();
-      goto fail;
-  }
-
-  grub_printf ("Memory allocated: At %p of %u bytes\n", prot_mode_mem, prot_size);
-
-  /* Can we skip this? Donno why we need imr...	*/
-#if 0
-  errnum = intel_cln_imr_setup(IMR_RANGE_BZIMAGE, (grub_addr_t)prot_mode_mem, prot_size);
-  if (errnum != ERR_NONE) {
-    grub_printf("IMR boot params setup failed!\n");
-    goto fail;
-  }
-#endif
-
-  /* init bss */
-  grub_memset (prot_mode_mem, 0, prot_size);
-
-  /* start loading elf */
-  Elf32_Phdr *phdr;
-  unsigned filesiz = 0, memsiz = 0;
-
   /* Reset cur_addr */
   cur_addr = 0;
 
-  phdr = (Elf32_Phdr *) (elf->e_phoff + ((int) buffer));
-  //grub_printf ("e_phnum is %u\n", elf->e_phnum);
-
-  for (i = 0; i < elf->e_phnum; i++) {
-    if (phdr[i].p_type == PT_LOAD) {
-      /* locate the section in file */
-      grub_seek (phdr[i].p_offset);
-      filesiz = phdr[i].p_filesz;
-      memsiz = phdr[i].p_memsz;
-
-#if 0
-      /* record the load address of the first section
-       * so that we can calculate following sections'
-       * real physical address */
-      grub_printf("first_loaded_sect_phy_addr is %p\n", first_loaded_sect_phy_addr);
-      if (first_loaded_sect_phy_addr == 0xFFFFFFFF)
-        first_loaded_sect_phy_addr = phdr[i].p_paddr;
-      real_phy_addr = load_phy_to_real_phy(phdr[i].p_paddr, first_loaded_sect_phy_addr, prot_size);
-      if (real_phy_addr == 0xFFFFFFFF || real_phy_addr < 0x100000) {
-        /* real_phy_addr is out of range */
-        errnum = ERR_BELOW_1MB;
-        goto fail;
-      }
-      grub_printf("loading No.%u section, real_phy_addr is %p,\
-          load_phy is %p, memsiz is %x, filesiz is %x\n",
-          loaded, real_phy_addr, phdr[i].p_paddr, memsiz, filesiz);
-
-      /* No virtual memory here, we have to find 
-       * the physical addresss of entry on our own */
-      if ((unsigned) entry_addr >= phdr[i].p_vaddr
-          && (unsigned) entry_addr < phdr[i].p_vaddr + memsiz) {
-        unsigned offset_in_sect = (unsigned) entry_addr - phdr[i].p_vaddr;
-        unsigned entry_load_phy = phdr[i].p_paddr + offset_in_sect;
-        real_entry_addr = (entry_func) load_phy_to_real_phy(entry_load_phy, 
-            first_loaded_sect_phy_addr, prot_size);
-        grub_printf("entry_addr is %p, real_entry_addr is %p\n",
-            entry_addr, real_entry_addr);
-      }
-
-      if (filesiz > memsiz)
-        filesiz = memsiz;
-
-
-      /* finally, we can load the section now */
-      if (grub_read((char *)real_phy_addr, filesiz) == filesiz) {
-        if (memsiz > filesiz)
-          memset ((char *) real_phy_addr, 0, memsiz - filesiz);
-      }
-#endif
-
-      grub_printf("load_phy is %p, virt_addr is %p, memsiz is %x, filesiz is %x\n",
-          phdr[i].p_paddr, phdr[i].p_vaddr, memsiz, filesiz);
-      /* finally, we can load the section now */
-      if (grub_read ((char *)phdr[i].p_paddr, filesiz) == filesiz) {
-        if (memsiz > filesiz) {
-          grub_memset ((char *) phdr[i].p_paddr + filesiz, 0, memsiz - filesiz);
-        }
-
-        /* Update cur_addr */
-        if ((phdr[i].p_paddr + memsiz) > cur_addr) {
-          cur_addr = phdr[i].p_paddr + memsiz;
-        }
-      } else {
-        grub_printf ("Reading ELF failed!\n");
-        break;
-      }
+  if (! load_multiboot_segments (elf, buffer, &end_addr))
+    {
+      free_pages ();
+      goto fail;
     }
-  }
+
+  cur_addr = end_addr;
 
   /* find the mmaped uart base address */
   mmio_base = (grub_uint32_t)cln_early_uart_init();
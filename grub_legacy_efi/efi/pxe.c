@@ -332,52 +332,64 @@ static void set_pxe_info(grub_efi_loaded_image_t *LoadedImage,
 	tftp_info.BasePath = get_pxe_file_dir(pxe);
 }
 
-char *grub_efi_pxe_get_config_path(grub_efi_loaded_image_t *LoadedImage)
+/*
+ * The names we look for our configuration under, most specific first:
+ * the UUID, the MAC address, the IP address in hex and each shorter
+ * prefix of it, and then the default.
+ */
+#define PXE_CONFIG_MAX		11
+#define PXE_CONFIG_DEFAULT	"efidefault"
+
+/*
+ * A list of the per-host configurations the server has, one name to a
+ * word, kept next to the default.  If there is one, we take the first
+ * of our names on it without asking for any of them.
+ */
+#define PXE_CONFIG_MANIFEST	"efimanifest"
+#define PXE_MANIFEST_SIZE	4096
+
+/*
+ * All the names are asked for at once, each from a port of its own, so
+ * a node without a file of its own waits one round trip instead of
+ * eleven.  Those not answered are asked for again every second, three
+ * times in all, and then one at a time the old way.
+ */
+#define PXE_PROBE_PORT		0xc000
+#define PXE_PROBE_RESEND	1000000
+#define PXE_PROBE_TRIES		3
+
+enum {
+	PROBE_WAITING,
+	PROBE_FOUND,
+	PROBE_MISSING
+};
+
+struct config_probe {
+	char Name[40];
+	char *Path;
+	EFI_PXE_BASE_CODE_UDP_PORT Port;
+	int State;
+};
+
+static int config_names(EFI_PXE_BASE_CODE *pxe, struct config_probe *probes)
 {
-	EFI_PXE_BASE_CODE *pxe = NULL;
-	EFI_IP_ADDRESS ServerIp;
-	char *FileName = NULL;
 	EFI_PXE_BASE_CODE_DHCPV4_PACKET *packet;
 	uuid_t uuid;
-	grub_efi_uintn_t FileSize = 0;
-	grub_efi_status_t rc = GRUB_EFI_SUCCESS;
-	char *ConfigPath = NULL;
 	char hex[] = "0123456789ABCDEF";
 	char hexip[9];
 	int hexiplen;
-
-	pxe = grub_efi_locate_protocol(&PxeBaseCodeProtocol, NULL);
-	if (pxe == NULL)
-		return NULL;
-
-	if (!pxe->Mode->Started)
-		return NULL;
-
-	set_pxe_info(LoadedImage, pxe);
-
-	FileName = grub_malloc(strlen("1902dcf5-7190-d811-bbd6-6ef21c690030"));
+	int n = 0;
 
 	packet = &pxe->Mode->DhcpDiscover.Dhcpv4;
 
 	if (get_dhcp_client_id((EFI_PXE_BASE_CODE_PACKET *)packet, &uuid)) {
-
 		uuid.time_mid = 0x0011;
-		sprintf(FileName,
+		sprintf(probes[n++].Name,
 			"%08X-%04X-%04X-%02X%02X-%02X%02X%02X%02X%02X%02X",
 			uuid.time_low, uuid.time_mid, uuid.time_hi_ver,
 			uuid.clock_seq_hi, uuid.clock_seq_low,
 			uuid.node[0], uuid.node[1], uuid.node[2],
 			uuid.node[3], uuid.node[4], uuid.node[5]);
-
-		rc = tftp_get_file_size(FileName, &FileSize);
-		if (rc == GRUB_EFI_SUCCESS) {
-			char *ReturnFile = grub_malloc(strlen("(nd)/") +
-						strlen(FileName) + 1);
-			sprintf(ReturnFile, "(nd)/%s", FileName);
-			grub_free(FileName);
-			//sprintf(tftp_info.LastPath, FileName);
-			return ReturnFile;
-		}
 	}
 
 	packet = &pxe->Mode->DhcpAck.Dhcpv4;
@@ -386,8 +398,7 @@ char *grub_efi_pxe_get_config_path(grub_efi_loaded_image_t *LoadedImage)
 					     "\x00\x00\x00\x00\x00", 10) &&
 			memcmp(packet->BootpHwAddr, "\x00\x00\x00\x00\x00\x00",
 				6)) {
-		char mac[21];
-		sprintf(mac, "01-%c%c-%c%c-%c%c-%c%c-%c%c-%c%c",
+		sprintf(probes[n++].Name, "01-%c%c-%c%c-%c%c-%c%c-%c%c-%c%c",
 			hex[(packet->BootpHwAddr[0] & 0xf0) >> 4],
 			hex[packet->BootpHwAddr[0] & 0xf],
 			hex[(packet->BootpHwAddr[1] & 0xf0) >> 4],
@@ -400,15 +411,6 @@ char *grub_efi_pxe_get_config_path(grub_efi_loaded_image_t *LoadedImage)
 			hex[packet->BootpHwAddr[4] & 0xf],
 			hex[(packet->BootpHwAddr[5] & 0xf0) >> 4],
 			hex[packet->BootpHwAddr[5] & 0xf]);
-
-		rc = tftp_get_file_size(mac, &FileSize);
-		if (rc == GRUB_EFI_SUCCESS) {
-			char *ReturnFile = grub_malloc(strlen("(nd)/") +
-						strlen(mac) + 1);
-			sprintf(ReturnFile, "(nd)/%s", mac);
-			return ReturnFile;
-		}
-
 	}
 
 	sprintf(hexip, "%c%c%c%c%c%c%c%c",
@@ -421,24 +423,264 @@ char *grub_efi_pxe_get_config_path(grub_efi_loaded_image_t *LoadedImage)
 		hex[(packet->BootpYiAddr[3] & 0xf0) >> 4],
 		hex[packet->BootpYiAddr[3] & 0xf]);
 
-	for (hexiplen = strlen(hexip); hexiplen > 0; hexiplen--)
-	{
+	for (hexiplen = strlen(hexip); hexiplen > 0; hexiplen--) {
 		hexip[hexiplen] = '\0';
-		rc = tftp_get_file_size(hexip, &FileSize);
-		if (rc == GRUB_EFI_SUCCESS) {
-			char *ReturnFile = grub_malloc(strlen("(nd)/") +
-						strlen(hexip) + 1);
-			sprintf(ReturnFile, "(nd)/%s", hexip);
-			return ReturnFile;
+		strcpy(probes[n++].Name, hexip);
+	}
+
+	strcpy(probes[n++].Name, PXE_CONFIG_DEFAULT);
+	return n;
+}
+
+/* Return true if NAME is a word of the manifest MANIFEST.  */
+static int manifest_lists(char *Manifest, char *Name)
+{
+	int len = strlen(Name);
+	char *p = Manifest;
+
+	while (*p) {
+		while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+			p++;
+		if (*p == '#') {
+			while (*p && *p != '\n')
+				p++;
+			continue;
 		}
+		if (!memcmp(p, Name, len) &&
+		    (!p[len] || p[len] == ' ' || p[len] == '\t' ||
+		     p[len] == '\r' || p[len] == '\n'))
+			return 1;
+		while (*p && *p != ' ' && *p != '\t' && *p != '\r' &&
+		       *p != '\n')
+			p++;
 	}
+	return 0;
+}
 
-	rc = tftp_get_file_size("efidefault", &FileSize);
-	if (rc == GRUB_EFI_SUCCESS) {
-		char *ReturnFile = grub_malloc(strlen("(nd)/efidefault")+1);
-		sprintf(ReturnFile, "(nd)/efidefault");
-		return ReturnFile;
+/*
+ * Settle the per-host names from the manifest, if the server has one:
+ * those on it are there and those not on it are not.  The default is
+ * left to be asked for.  Return false if there is no manifest.
+ */
+static int read_config_manifest(struct config_probe *probes, int n)
+{
+	EFI_PXE_BASE_CODE_TFTP_OPCODE OpCode = EFI_PXE_BASE_CODE_TFTP_READ_FILE;
+	grub_efi_uint64_t BufferSize = PXE_MANIFEST_SIZE - 1;
+	grub_efi_status_t rc;
+	char *Manifest;
+	int i;
+
+	Manifest = grub_malloc(PXE_MANIFEST_SIZE);
+	if (!Manifest)
+		return 0;
+
+	rc = tftp_mtftp(OpCode, Manifest, &BufferSize, PXE_CONFIG_MANIFEST);
+	if (rc != GRUB_EFI_SUCCESS) {
+		if (rc == GRUB_EFI_BUFFER_TOO_SMALL)
+			grub_printf("%s is over %d bytes, not used\n",
+				    PXE_CONFIG_MANIFEST, PXE_MANIFEST_SIZE - 1);
+		grub_free(Manifest);
+		return 0;
+	}
+	Manifest[BufferSize] = '\0';
+
+	for (i = 0; i < n - 1; i++) {
+		if (manifest_lists(Manifest, probes[i].Name)) {
+			probes[i].State = PROBE_FOUND;
+		} else {
+			probes[i].State = PROBE_MISSING;
+			tftp_note_missing(probes[i].Name);
+		}
+	}
+	grub_free(Manifest);
+	return 1;
+}
+
+/*
+ * Return the first of the names that is not missing, if what became of
+ * it is known, or -1 if it is still being waited for.  Return N if every
+ * name is missing.
+ */
+static int config_decided(struct config_probe *probes, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (probes[i].State == PROBE_WAITING)
+			return -1;
+		if (probes[i].State == PROBE_FOUND)
+			return i;
+	}
+	return n;
+}
+
+static grub_efi_status_t probe_send(EFI_PXE_BASE_CODE *pxe,
+				    EFI_PXE_BASE_CODE_UDP_PORT SrcPort,
+				    EFI_PXE_BASE_CODE_UDP_PORT DestPort,
+				    char *Packet, grub_efi_uintn_t Size)
+{
+	return Call_Service_11(pxe->UdpWrite, pxe, 0, tftp_info.ServerIp,
+			       &DestPort, NULL, NULL, &SrcPort, NULL, NULL,
+			       &Size, Packet);
+}
+
+/* Ask for PROBE's file, and for its size, which we do not want but
+   which makes a server that knows the option answer without data.  */
+static grub_efi_status_t probe_send_rrq(EFI_PXE_BASE_CODE *pxe,
+					struct config_probe *probe)
+{
+	char Packet[512];
+	int len = strlen(probe->Path);
+
+	if (len + 20 > sizeof(Packet))
+		return GRUB_EFI_BAD_BUFFER_SIZE;
+
+	Packet[0] = 0;
+	Packet[1] = TFTP_RRQ;
+	memcpy(Packet + 2, probe->Path, len + 1);
+	memcpy(Packet + 2 + len + 1, "octet\0tsize\0" "0", 14);
+	return probe_send(pxe, probe->Port, TFTP_PORT, Packet, len + 17);
+}
+
+/* End the transfer the server began on PORT for PROBE; we only wanted
+   to know that the file is there.  */
+static void probe_abort(EFI_PXE_BASE_CODE *pxe, struct config_probe *probe,
+			EFI_PXE_BASE_CODE_UDP_PORT Port)
+{
+	char Packet[5] = { 0, TFTP_ERROR, 0, 0, 0 };
+
+	probe_send(pxe, probe->Port, Port, Packet, sizeof(Packet));
+}
+
+/*
+ * Take one answer, if one comes before the firmware gives up waiting,
+ * and mark the name it is for.
+ */
+static void probe_receive(EFI_PXE_BASE_CODE *pxe,
+			  struct config_probe *probes, int n)
+{
+	grub_efi_uint16_t OpFlags = EFI_PXE_BASE_CODE_UDP_OPFLAGS_ANY_DEST_IP |
+				    EFI_PXE_BASE_CODE_UDP_OPFLAGS_ANY_DEST_PORT |
+				    EFI_PXE_BASE_CODE_UDP_OPFLAGS_ANY_SRC_PORT;
+	EFI_IP_ADDRESS DestIp;
+	EFI_IP_ADDRESS SrcIp = *tftp_info.ServerIp;
+	EFI_PXE_BASE_CODE_UDP_PORT DestPort = 0;
+	EFI_PXE_BASE_CODE_UDP_PORT SrcPort = 0;
+	unsigned char Packet[1024];
+	grub_efi_uintn_t Size = sizeof(Packet);
+	grub_efi_status_t rc;
+	int i;
+
+	rc = Call_Service_10(pxe->UdpRead, pxe, OpFlags, &DestIp, &DestPort,
+			     &SrcIp, &SrcPort, NULL, NULL, &Size, Packet);
+	if (rc != GRUB_EFI_SUCCESS || Size < 4)
+		return;
+
+	for (i = 0; i < n; i++)
+		if (probes[i].Port == DestPort)
+			break;
+	if (i == n || probes[i].State != PROBE_WAITING)
+		return;
+
+	switch ((Packet[0] << 8) | Packet[1]) {
+	case TFTP_OACK:
+	case TFTP_DATA:
+		probes[i].State = PROBE_FOUND;
+		probe_abort(pxe, &probes[i], SrcPort);
+		break;
+	case TFTP_ERROR:
+		probes[i].State = PROBE_MISSING;
+		if (((Packet[2] << 8) | Packet[3]) == TFTP_ERR_NOT_FOUND)
+			tftp_note_missing(probes[i].Name);
+		break;
+	}
+}
+
+/*
+ * Ask for every name still waiting at once, until the most specific
+ * one there is known.  Names the firmware would not send, or the
+ * server never answered, are left waiting.
+ */
+static void probe_configs(EFI_PXE_BASE_CODE *pxe,
+			  struct config_probe *probes, int n)
+{
+	unsigned long long Sent = 0;
+	int Tries = 0;
+	int Base;
+	int i;
+
+	/* Not the ports of the last boot, which the server may still know. */
+	Base = PXE_PROBE_PORT + (bootprof_tsc() & 0x3ff) * 16;
+	for (i = 0; i < n; i++)
+		probes[i].Port = Base + i;
+
+	while (config_decided(probes, n) < 0) {
+		if (Tries == 0 ||
+		    bootprof_usecs(bootprof_tsc() - Sent) >= PXE_PROBE_RESEND) {
+			if (Tries == PXE_PROBE_TRIES)
+				break;
+			for (i = 0; i < n; i++)
+				if (probes[i].State == PROBE_WAITING &&
+				    probe_send_rrq(pxe, &probes[i]) !=
+				    GRUB_EFI_SUCCESS)
+					return;
+			Sent = bootprof_tsc();
+			Tries++;
+		}
+		probe_receive(pxe, probes, n);
+	}
+}
+
+char *grub_efi_pxe_get_config_path(grub_efi_loaded_image_t *LoadedImage)
+{
+	EFI_PXE_BASE_CODE *pxe = NULL;
+	struct config_probe probes[PXE_CONFIG_MAX];
+	grub_efi_uintn_t FileSize = 0;
+	char *ReturnFile = NULL;
+	int n;
+	int i;
+
+	pxe = grub_efi_locate_protocol(&PxeBaseCodeProtocol, NULL);
+	if (pxe == NULL)
+		return NULL;
+
+	if (!pxe->Mode->Started)
+		return NULL;
+
+	set_pxe_info(LoadedImage, pxe);
+	if (tftp_info.ServerIp == NULL)
+		return NULL;
+
+	n = config_names(pxe, probes);
+	for (i = 0; i < n; i++) {
+		probes[i].Path = tftp_full_path(probes[i].Name);
+		probes[i].State = probes[i].Path == NULL ||
+				  tftp_known_missing(probes[i].Name) ?
+				  PROBE_MISSING : PROBE_WAITING;
+	}
+
+	read_config_manifest(probes, n);
+	probe_configs(pxe, probes, n);
+
+	for (i = 0; i < n; i++) {
+		if (probes[i].State == PROBE_WAITING &&
+		    tftp_get_file_size(probes[i].Name, &FileSize) ==
+		    GRUB_EFI_SUCCESS)
+			probes[i].State = PROBE_FOUND;
+		if (probes[i].State == PROBE_FOUND)
+			break;
+	}
+
+	if (i < n) {
+		ReturnFile = grub_malloc(strlen("(nd)/") +
+					 strlen(probes[i].Name) + 1);
+		if (ReturnFile)
+			sprintf(ReturnFile, "(nd)/%s", probes[i].Name);
+		/* The boot profile shows when the search ended.  */
+		bootprof_mark(probes[i].Name);
 	}
 
-	return NULL;
+	for (i = 0; i < n; i++)
+		grub_free(probes[i].Path);
+	return ReturnFile;
 }
@@ -182,6 +182,13 @@ typedef struct {
     EFI_PXE_BASE_CODE_TFTP_ERROR    TftpError;
 } EFI_PXE_BASE_CODE_MODE;
 
+#define EFI_PXE_BASE_CODE_UDP_OPFLAGS_ANY_SRC_IP	0x0001
+#define EFI_PXE_BASE_CODE_UDP_OPFLAGS_ANY_SRC_PORT	0x0002
+#define EFI_PXE_BASE_CODE_UDP_OPFLAGS_ANY_DEST_IP	0x0004
+#define EFI_PXE_BASE_CODE_UDP_OPFLAGS_ANY_DEST_PORT	0x0008
+#define EFI_PXE_BASE_CODE_UDP_OPFLAGS_USE_FILTER	0x0010
+#define EFI_PXE_BASE_CODE_UDP_OPFLAGS_MAY_FRAGMENT	0x0020
+
 typedef EFI_STATUS (*EFI_PXE_BASE_CODE_START)();
 typedef EFI_STATUS (*EFI_PXE_BASE_CODE_STOP)();
 typedef EFI_STATUS (*EFI_PXE_BASE_CODE_DHCP)();
@@ -220,6 +227,28 @@ typedef struct {
 	grub_efi_uint8_t node[6];
 } uuid_t;
 
+/* The TFTP block sizes: the one every server has, the largest that fits
+   an Ethernet frame without IP fragmentation, and the largest of all
+   (RFC 2348).  */
+#define TFTP_BLKSIZE_MIN	512
+#define TFTP_BLKSIZE_DEFAULT	1468
+#define TFTP_BLKSIZE_MAX	65464
+
+/* How much of the start of a file is read for a look at its header.  */
+#define TFTP_HEAD_SIZE		8192
+
+/* The TFTP port and packet types (RFC 1350, RFC 2347).  */
+#define TFTP_PORT		69
+#define TFTP_RRQ		1
+#define TFTP_DATA		3
+#define TFTP_ERROR		5
+#define TFTP_OACK		6
+
+/* The TFTP error codes for a file the server does not have, and for an
+   option the server will not have.  */
+#define TFTP_ERR_NOT_FOUND	1
+#define TFTP_ERR_OPTION		8
+
 struct tftp_info {
 	grub_efi_loaded_image_t *LoadedImage;
 	EFI_PXE_BASE_CODE *Pxe;
@@ -227,11 +256,20 @@ struct tftp_info {
 	char *BasePath;
 	char *LastPath;
 	char *Buffer;
+	int BlockSize;
 };
 
 extern struct tftp_info tftp_info;
 extern grub_efi_status_t tftp_get_file_size(
 	char *Filename,
 	grub_efi_uintn_t *Size);
+extern grub_efi_status_t tftp_mtftp(
+	EFI_PXE_BASE_CODE_TFTP_OPCODE OpCode,
+	char *Buffer,
+	grub_efi_uint64_t *BufferSize,
+	char *Filename);
+extern char *tftp_full_path(char *Filename);
+extern int tftp_known_missing(char *Filename);
+extern void tftp_note_missing(char *Filename);
 
 #endif /* PXE_H */
@@ -66,6 +66,10 @@ int grub_stage2 (void);
 #include <device.h>
 #include <serial.h>
 #include <term.h>
+#ifdef PLATFORM_EFI
+# include <clanton/flash.h>
+# include <clanton/spi_xfer.h>
+#endif
 
 /* Simulated memory sizes. */
 #define EXTENDED_MEMSIZE (3 * 1024 * 1024)	/* 3MB */
@@ -87,6 +91,66 @@ unsigned short int grub_cln_loaded_from_spi = 0;
 unsigned short int grub_cln_linux_spi = 0;
 unsigned short int grub_cln_initrd_spi = 0;
 
+#ifdef PLATFORM_EFI
+grub_uint8_t *grub_cln_mfh_addr = (grub_uint8_t *) GRUB_CLN_MFH_ADDR;
+
+/* The file given by --flash-image stands in for the SPI flash part.  As
+   on the board, the flash ends at the top of the 32-bit address space,
+   which is where the MFH addresses point.  */
+#define FLASH_IMAGE_END		0x100000000ULL
+
+static int flash_image_fd = -1;
+static unsigned long long flash_image_base;
+
+static int
+flash_image_read_bytes (grub_addr_t src, void *dst, grub_uint32_t len)
+{
+  if (src < flash_image_base
+      || (unsigned long long) src + len > FLASH_IMAGE_END)
+    return 0;
+
+  return pread (flash_image_fd, dst, len,
+		src - flash_image_base) == (ssize_t) len;
+}
+
+static int
+flash_image_read_blocks (grub_addr_t src, void *dst, grub_uint32_t count)
+{
+  return flash_image_read_bytes (src, dst, count * GRUB_CLN_SPI_BLOCK_SIZE);
+}
+
+static struct grub_cln_spi_xfer flash_image_xfer =
+{
+  .name = "flash image",
+  .read_blocks = flash_image_read_blocks,
+  .read_bytes = flash_image_read_bytes,
+  .max_blocks = 128,
+};
+
+static int
+open_flash_image (void)
+{
+  struct stat st;
+
+  flash_image_fd = open (flash_image_file, O_RDONLY);
+  if (flash_image_fd < 0 || fstat (flash_image_fd, &st) < 0)
+    {
+      perror (flash_image_file);
+      return 0;
+    }
+
+  if (st.st_size == 0 || st.st_size > FLASH_IMAGE_END)
+    {
+      fprintf (stderr, "%s: not a flash image\n", flash_image_file);
+      return 0;
+    }
+
+  flash_image_base = FLASH_IMAGE_END - st.st_size;
+  grub_cln_spi_xfer_register (&flash_image_xfer);
+  return 1;
+}
+#endif /* PLATFORM_EFI */
+
 /* Emulation requirements. */
 void *grub_scratch_mem = 0;
 
@@ -260,6 +324,11 @@ grub_stage2 (void)
 
   if (! init_device_map (&device_map, device_map_file, floppy_disks))
     return 1;
+
+#ifdef PLATFORM_EFI
+  if (flash_image_file && ! open_flash_image ())
+    return 1;
+#endif
   
   /* Check some invariants. */
   assert ((SCRATCHSEG << 4) == SCRATCHADDR);
@@ -314,6 +383,11 @@ grub_stage2 (void)
 
   if (serial_fd >= 0)
     close (serial_fd);
+
+#ifdef PLATFORM_EFI
+  if (flash_image_fd >= 0)
+    close (flash_image_fd);
+#endif
   
   /* Release memory. */
   restore_device_map (device_map);
@@ -617,6 +691,19 @@ currticks (void)
   return ticks_per_csec + ticks_per_usec;
 }
 
+/* Spin rather than sleep, so that the wait is no longer than asked.  */
+void
+microdelay (unsigned long usecs)
+{
+  struct timeval start, now;
+
+  gettimeofday (&start, 0);
+  do
+    gettimeofday (&now, 0);
+  while ((unsigned long) ((now.tv_sec - start.tv_sec) * 1000000
+			  + now.tv_usec - start.tv_usec) < usecs);
+}
+
 /* displays an ASCII character.  IBM displays will translate some
    characters to special graphical ones */
 void
@@ -1058,10 +1145,9 @@ hex_dump (void *buf, size_t size)
 }
 
 int
-biosdisk (int subfunc, int drive, struct geometry *geometry,
-	  int sector, int nsec, int segment)
+biosdisk_direct (int subfunc, int drive, struct geometry *geometry,
+		 int sector, int nsec, char *buf)
 {
-  char *buf;
   int fd = geometry->flags;
 
   /* Get the file pointer from the geometry, and make sure it matches. */
@@ -1092,8 +1178,6 @@ biosdisk (int subfunc, int drive, struct geometry *geometry,
   }
 #endif
 
-  buf = (char *) (unsigned long) (segment << 4);
-
   switch (subfunc)
     {
     case BIOSDISK_READ:
@@ -1135,6 +1219,37 @@ biosdisk (int subfunc, int drive, struct geometry *geometry,
   return 0;
 }
 
+int
+biosdisk (int subfunc, int drive, struct geometry *geometry,
+	  int sector, int nsec, int segment)
+{
+  return biosdisk_direct (subfunc, drive, geometry, sector, nsec,
+			  (char *) (unsigned long) (segment << 4));
+}
+
+/* Writes made through the OS, such as to the Stage 2 file by the
+   command install, bypass the disk cache, so report a new medium each
+   time a drive is probed.  */
+unsigned long
+get_media_id (int drive)
+{
+  static unsigned long media_id;
+
+  return ++media_id;
+}
+
+void *
+grub_alloc_pages (unsigned long size)
+{
+  return malloc (size);
+}
+
+void
+grub_free_pages (void *addr, unsigned long size)
+{
+  free (addr);
+}
+
 
 void
 stop_floppy (void)
@@ -1441,7 +1556,7 @@ grub_cln_recovery_shell (unsigned short int asset_in_spi)
 void
 grub_cln_event_append (const char *tag)
 {
-  /* Nothing to do in the simulator.  */
+  bootprof_mark (tag);
 }
 
 void
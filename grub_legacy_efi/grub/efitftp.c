@@ -32,3 +32,18 @@ efi_tftp_close (void)
 {
 	grub_printf ("non-efi efi_tftp_close ()\n");
 }
+
+/* TFTP_BLKSIZE_DEFAULT, as in efi/pxe.h */
+static int efi_tftp_block_size = 1468;
+
+void
+efi_tftp_set_block_size (int size)
+{
+	efi_tftp_block_size = size;
+}
+
+int
+efi_tftp_get_block_size (void)
+{
+	return efi_tftp_block_size;
+}
@@ -45,6 +45,7 @@ int verbose = 0;
 int read_only = 0;
 int floppy_disks = 1;
 char *device_map_file = 0;
+char *flash_image_file = 0;
 static int default_boot_drive;
 static int default_install_partition;
 static char *default_config_file;
@@ -65,6 +66,7 @@ static char *default_config_file;
 #define OPT_DEVICE_MAP		-15
 #define OPT_PRESET_MENU		-16
 #define OPT_NO_PAGER		-17
+#define OPT_FLASH_IMAGE		-18
 #define OPTSTRING ""
 
 static struct option longopts[] =
@@ -73,6 +75,7 @@ static struct option longopts[] =
   {"boot-drive", required_argument, 0, OPT_BOOT_DRIVE},
   {"config-file", required_argument, 0, OPT_CONFIG_FILE},
   {"device-map", required_argument, 0, OPT_DEVICE_MAP},
+  {"flash-image", required_argument, 0, OPT_FLASH_IMAGE},
   {"help", no_argument, 0, OPT_HELP},
   {"hold", optional_argument, 0, OPT_HOLD},
   {"install-partition", required_argument, 0, OPT_INSTALL_PARTITION},
@@ -104,6 +107,7 @@ Enter the GRand Unified Bootloader command shell.\n\
     --boot-drive=DRIVE       specify stage2 boot_drive [default=0x%x]\n\
     --config-file=FILE       specify stage2 config_file [default=%s]\n\
     --device-map=FILE        use the device map file FILE\n\
+    --flash-image=FILE       read Clanton SPI flash assets from FILE\n\
     --help                   display this message and exit\n\
     --hold                   wait until a debugger will attach\n\
     --install-partition=PAR  specify stage2 install_partition [default=0x%x]\n\
@@ -233,6 +237,10 @@ main (int argc, char **argv)
 	  device_map_file = strdup (optarg);
 	  break;
 
+	case OPT_FLASH_IMAGE:
+	  flash_image_file = strdup (optarg);
+	  break;
+
 	case OPT_PRESET_MENU:
 	  use_preset_menu = 1;
 	  break;
@@ -0,0 +1,581 @@
+/* bootmap.c - open files through block lists saved ahead of time */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2014  Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * The command `mkbootmap' reads each file that the menu entries load,
+ * noting the sectors the file system reads it from, and saves them as
+ * runs of sectors in a map file.  Once `bootmap' has loaded the map,
+ * grub_open opens a file in it through a block list made of its runs,
+ * so that no directory or inode has to be read to find it.
+ *
+ * A map cannot know from the file system whether a file has changed
+ * since it was made, because the inode numbers and times are in the
+ * very metadata it is there to skip.  So each file is fingerprinted by
+ * its size and its first and last bytes, which are read through the
+ * runs before the file is used.  If they no longer match, or the
+ * partition has moved, the file is opened the ordinary way.
+ *
+ * GRUB cannot make files, so the map file must already exist and be
+ * big enough.  It is written over in place.
+ */
+
+#include "shared.h"
+
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+
+#define BOOTMAP_MAGIC		0x50414d42	/* "BMAP" */
+#define BOOTMAP_VERSION		1
+
+/* The largest map, which is also the size of the buffer it is in.  */
+#define BOOTMAP_SIZE		0x8000
+
+/* A file in more pieces than this is left to the file system.  */
+#define BOOTMAP_MAX_RUNS	256
+
+/* The bytes at either end of a file that go into its fingerprint.  */
+#define BOOTMAP_PRINT_LEN	512
+
+/* Read this much at a time while mapping a file.  */
+#define BOOTMAP_CHUNK		0x10000
+
+struct bootmap_header
+{
+  unsigned int magic;
+  unsigned short version;
+  /* The number of files */
+  unsigned short count;
+  /* The bytes used, the header included */
+  unsigned int size;
+  /* Of the bytes after the header */
+  unsigned int checksum;
+};
+
+/* Each file is one of these, followed by RUNS runs.  */
+struct bootmap_file
+{
+  unsigned int drive;
+  unsigned int partition;
+  /* The first sector of the partition, which the runs start from */
+  unsigned int part_start;
+  unsigned int size;
+  unsigned int fingerprint;
+  unsigned int runs;
+  char path[PRELOAD_PATH_LEN];
+};
+
+struct bootmap_run
+{
+  unsigned int start;
+  unsigned int length;
+};
+
+unsigned long bootmap_hits;
+unsigned long bootmap_stale;
+
+/* The map in use.  */
+static char map[BOOTMAP_SIZE];
+static int map_count;
+
+/* The file last found in it.  */
+static struct bootmap_file *found;
+
+/* A block list for it, with room for the device and every run.  */
+static char blocklist[32 + BOOTMAP_MAX_RUNS * 24];
+
+/* The map being made, and the runs of the file being mapped.  */
+static char *new_map;
+static int new_size;
+static struct bootmap_run *runs;
+static int num_runs;
+static int run_bytes;
+static int run_last_length;
+static int run_bad;
+
+static struct bootmap_file *
+next_file (struct bootmap_file *f)
+{
+  return (struct bootmap_file *) ((char *) (f + 1)
+				  + f->runs * sizeof (struct bootmap_run));
+}
+
+static unsigned int
+hash_bytes (unsigned int hash, char *buf, int len)
+{
+  /* FNV-1a.  */
+  while (len--)
+    hash = (hash ^ (unsigned char) *buf++) * 16777619;
+
+  return hash;
+}
+
+/* Return the fingerprint of F, reading its ends through its runs from
+   the partition open now.  */
+static unsigned int
+fingerprint (struct bootmap_file *f)
+{
+  struct bootmap_run *run = (struct bootmap_run *) (f + 1);
+  struct bootmap_run *last_run = run + f->runs - 1;
+  int sector_size = get_sector_size (current_drive);
+  unsigned int hash = 2166136261U, last;
+  char buf[BOOTMAP_PRINT_LEN];
+  int len, end;
+
+  hash = hash_bytes (hash, (char *) &f->size, sizeof (f->size));
+
+  len = f->size < BOOTMAP_PRINT_LEN ? f->size : BOOTMAP_PRINT_LEN;
+  if (! devread (run->start, 0, len, buf))
+    return 0;
+  hash = hash_bytes (hash, buf, len);
+
+  /* The last bytes, as far back as the start of the last sector.  */
+  last = (f->size - 1) / sector_size;
+  while (last >= run->length)
+    {
+      /* The runs are too short for the file.  */
+      if (run == last_run)
+	return 0;
+      last -= run++->length;
+    }
+
+  end = (f->size - 1) % sector_size + 1;
+  len = end < BOOTMAP_PRINT_LEN ? end : BOOTMAP_PRINT_LEN;
+  if (! devread (run->start + last, end - len, len, buf))
+    return 0;
+
+  return hash_bytes (hash, buf, len);
+}
+
+static unsigned int
+checksum (struct bootmap_header *hdr)
+{
+  return hash_bytes (2166136261U, (char *) (hdr + 1),
+		     hdr->size - sizeof (*hdr));
+}
+
+/* Return true if every file of the map HDR, with its runs, lies within
+   HDR->SIZE, and can be made into a block list.  */
+static int
+check_files (struct bootmap_header *hdr)
+{
+  char *end = (char *) hdr + hdr->size;
+  struct bootmap_file *f = (struct bootmap_file *) (hdr + 1);
+  int i, j;
+
+  for (i = 0; i < hdr->count; i++, f = next_file (f))
+    {
+      if ((char *) (f + 1) > end
+	  || f->runs == 0 || f->runs > BOOTMAP_MAX_RUNS
+	  || (char *) next_file (f) > end || f->size == 0)
+	return 0;
+
+      for (j = 0; j < PRELOAD_PATH_LEN && f->path[j]; j++)
+	;
+      if (j == PRELOAD_PATH_LEN)
+	return 0;
+    }
+
+  return 1;
+}
+
+/* Print the device DRIVE and PARTITION to BUF as a user would name it,
+   and return the length.  */
+static int
+print_device (char *buf, unsigned long drive, unsigned long partition)
+{
+  char *p = buf;
+
+  p += grub_sprintf (p, "(%cd%d", (drive & 0x80) ? 'h' : 'f',
+		     (int) (drive & ~0x80));
+
+  if ((partition & 0xFF0000) != 0xFF0000)
+    p += grub_sprintf (p, ",%d", (int) ((partition >> 16) & 0xFF));
+
+  if ((partition & 0x00FF00) != 0x00FF00)
+    p += grub_sprintf (p, ",%c", 'a' + (int) ((partition >> 8) & 0xFF));
+
+  p += grub_sprintf (p, ")");
+  return p - buf;
+}
+
+/* Return a block list for FILENAME if the map in use has it, and set
+   SIZE to the size of the file.  */
+char *
+bootmap_lookup (char *filename, int *size)
+{
+  unsigned long drive = saved_drive, partition = saved_partition;
+  struct bootmap_run *run;
+  char *path, *p;
+  int i;
+
+  if (! map_count)
+    return 0;
+
+  path = resolve_file_name (filename, &drive, &partition);
+  if (! path || *path != '/')
+    return 0;
+
+  found = (struct bootmap_file *) (map + sizeof (struct bootmap_header));
+  for (i = 0; i < map_count; i++, found = next_file (found))
+    if (found->drive == drive && found->partition == partition
+	&& same_file_path (found->path, path))
+      break;
+
+  if (i == map_count)
+    {
+      found = 0;
+      return 0;
+    }
+
+  p = blocklist + print_device (blocklist, drive, partition);
+  run = (struct bootmap_run *) (found + 1);
+  for (i = 0; i < (int) found->runs; i++, run++)
+    p += grub_sprintf (p, "%s%d+%d", i ? "," : "", run->start, run->length);
+
+  *size = found->size;
+  return blocklist;
+}
+
+/* Return true if the file just opened through the block list from
+   bootmap_lookup is still the file that was mapped.  */
+int
+bootmap_verify (void)
+{
+  grub_error_t old_errnum = errnum;
+  int ok;
+
+  ok = (found && part_start == found->part_start
+	&& fingerprint (found) == found->fingerprint && ! errnum);
+  errnum = old_errnum;
+
+  if (ok)
+    bootmap_hits++;
+  else
+    bootmap_stale++;
+
+  return ok;
+}
+
+/* Load the map in MAPFILE, and use it from now on.  */
+int
+bootmap_load (char *mapfile)
+{
+  struct bootmap_header *hdr = (struct bootmap_header *) map;
+  int len;
+
+  map_count = 0;
+  bootmap_hits = bootmap_stale = 0;
+
+  if (! grub_open (mapfile))
+    return 0;
+
+  len = grub_read (map, sizeof (map));
+  grub_close ();
+  if (errnum)
+    return 0;
+
+  if (len < (int) sizeof (*hdr) || hdr->magic != BOOTMAP_MAGIC
+      || hdr->version != BOOTMAP_VERSION
+      || hdr->size < sizeof (*hdr) || hdr->size > (unsigned int) len
+      || checksum (hdr) != hdr->checksum || ! check_files (hdr))
+    {
+      errnum = ERR_BAD_BOOTMAP;
+      return 0;
+    }
+
+  map_count = hdr->count;
+  return 1;
+}
+
+/* Forget the map in use.  */
+void
+bootmap_unload (void)
+{
+  map_count = 0;
+}
+
+/* Return the number of files in the map in use.  */
+int
+bootmap_count (void)
+{
+  return map_count;
+}
+
+/* Note the sectors that a file is read from as runs.  */
+static void
+bootmap_read_helper (int sector, int offset, int length)
+{
+  struct bootmap_run *run = num_runs ? &runs[num_runs - 1] : 0;
+  int sector_size = get_sector_size (current_drive);
+
+  run_bytes += length;
+
+  /* Only whole sectors can be read through a block list, so only the
+     last sector of a file may be read in part.  */
+  if (offset || (run && run_last_length != sector_size))
+    run_bad = 1;
+  else if (run && run->start + run->length == sector - part_start)
+    run->length++;
+  else if (num_runs == BOOTMAP_MAX_RUNS)
+    run_bad = 1;
+  else
+    {
+      run = &runs[num_runs++];
+      run->start = sector - part_start;
+      run->length = 1;
+    }
+
+  run_last_length = length;
+}
+
+/* Read through the file open now with the hook on, and return true if
+   it could be mapped.  */
+static int
+collect_runs (void)
+{
+  char *buf = grub_alloc_pages (BOOTMAP_CHUNK);
+  int len;
+
+  if (! buf)
+    {
+      errnum = ERR_WONT_FIT;
+      return 0;
+    }
+
+  num_runs = 0;
+  run_bytes = 0;
+  run_bad = 0;
+
+  disk_read_hook = bootmap_read_helper;
+  do
+    len = grub_read (buf, BOOTMAP_CHUNK);
+  while (len > 0 && ! run_bad);
+  disk_read_hook = 0;
+
+  grub_free_pages (buf, BOOTMAP_CHUNK);
+
+  /* Holes are read as zeros without going to the disk.  */
+  if (! errnum && ! run_bad && run_bytes != filemax)
+    errnum = ERR_FILE_HOLES;
+
+  return ! errnum && ! run_bad && num_runs;
+}
+
+/* Add the file NAME on DRIVE and PARTITION to the map being made.  */
+static void
+map_file (char *name, unsigned long drive, unsigned long partition,
+	  int nounzip)
+{
+  struct bootmap_header *hdr = (struct bootmap_header *) new_map;
+  struct bootmap_file *f;
+  unsigned long old_saved_drive = saved_drive;
+  unsigned long old_saved_partition = saved_partition;
+  int old_nounzip = no_decompression;
+  char *path, *why = 0;
+  char token[PRELOAD_PATH_LEN];
+  int i, ok;
+
+  path = resolve_file_name (name, &drive, &partition);
+  if (! path || *path != '/')
+    return;
+
+  f = (struct bootmap_file *) (new_map + sizeof (*hdr));
+  for (i = 0; i < hdr->count; i++, f = next_file (f))
+    if (f->drive == drive && f->partition == partition
+	&& same_file_path (f->path, path))
+      return;
+
+  for (i = 0; path[i] && ! isspace (path[i]); i++)
+    if (i == PRELOAD_PATH_LEN - 1)
+      return;
+
+  grub_memmove (token, path, i);
+  token[i] = 0;
+  grub_printf (" %s: ", token);
+
+  if (drive == NETWORK_DRIVE)
+    {
+      grub_printf ("not on a disk\n");
+      return;
+    }
+
+  if (new_size + sizeof (*f)
+      + BOOTMAP_MAX_RUNS * sizeof (struct bootmap_run) > BOOTMAP_SIZE)
+    {
+      grub_printf ("the map is full\n");
+      return;
+    }
+
+  /* The runs are of the file as it is on the disk.  */
+  saved_drive = drive;
+  saved_partition = partition;
+  no_decompression = 1;
+
+  runs = (struct bootmap_run *) (f + 1);
+  ok = grub_open (path);
+  if (ok)
+    {
+      ok = collect_runs ();
+      if (ok)
+	{
+	  grub_memset (f->path, 0, sizeof (f->path));
+	  grub_memmove (f->path, token, i);
+	  f->drive = drive;
+	  f->partition = partition;
+	  f->part_start = part_start;
+	  f->size = filemax;
+	  f->runs = num_runs;
+	  f->fingerprint = fingerprint (f);
+	  ok = ! errnum;
+	}
+      else if (! errnum)
+	why = num_runs ? "not in whole sectors" : "empty";
+      grub_close ();
+    }
+
+  saved_drive = old_saved_drive;
+  saved_partition = old_saved_partition;
+  no_decompression = old_nounzip;
+
+  if (ok)
+    {
+      grub_printf ("%d bytes in %d runs\n", f->size, f->runs);
+      hdr->count++;
+      new_size += (char *) next_file (f) - (char *) f;
+    }
+  else
+    {
+      if (why)
+	grub_printf ("%s\n", why);
+      else
+	print_error ();
+      errnum = ERR_NONE;
+    }
+}
+
+/* Write the map being made to MAPFILE, over the sectors it has.  */
+static int
+write_map (char *mapfile)
+{
+  struct bootmap_header *hdr = (struct bootmap_header *) new_map;
+  struct bootmap_run *run;
+  int old_nounzip = no_decompression;
+  int sector_size, done, len, i = 0, ok;
+  char *buf;
+
+  /* The runs of the map file go after the map.  */
+  runs = (struct bootmap_run *) (new_map + BOOTMAP_SIZE);
+
+  no_decompression = 1;
+  ok = grub_open (mapfile);
+  no_decompression = old_nounzip;
+  if (! ok)
+    return 0;
+
+  if (filemax < (int) hdr->size)
+    errnum = ERR_WONT_FIT;
+  else if (! collect_runs () && ! errnum)
+    errnum = ERR_UNALIGNED;
+  grub_close ();
+  if (errnum)
+    return 0;
+
+  sector_size = get_sector_size (current_drive);
+  buf = grub_alloc_pages (sector_size);
+  if (! buf)
+    {
+      errnum = ERR_WONT_FIT;
+      return 0;
+    }
+
+  /* Whatever is in the last sector after the map is kept.  */
+  run = runs;
+  for (done = 0; done < (int) hdr->size; done += len)
+    {
+      len = hdr->size - done;
+      if (len > sector_size)
+	len = sector_size;
+
+      if (! devread (run->start + i, 0, sector_size, buf))
+	break;
+      grub_memmove (buf, new_map + done, len);
+      if (! devwrite (run->start + i, 1, buf))
+	break;
+
+      if (++i == (int) run->length)
+	{
+	  run++;
+	  i = 0;
+	}
+    }
+
+  grub_free_pages (buf, sector_size);
+  return ! errnum;
+}
+
+/* Map the files that menu entry ENTRYNO loads, or that all of them do
+   if it is negative, and save the map in MAPFILE.  */
+int
+bootmap_make (char *mapfile, int entryno)
+{
+  int alloc = BOOTMAP_SIZE + BOOTMAP_MAX_RUNS * sizeof (struct bootmap_run);
+  struct bootmap_header *hdr;
+  char *script;
+  int i, ok = 0;
+
+  new_map = grub_alloc_pages (alloc);
+  if (! new_map)
+    {
+      errnum = ERR_WONT_FIT;
+      return 0;
+    }
+
+  grub_memset (new_map, 0, BOOTMAP_SIZE);
+  hdr = (struct bootmap_header *) new_map;
+  new_size = sizeof (*hdr);
+
+  for (i = entryno < 0 ? 0 : entryno; (script = get_menu_entry (i)); i++)
+    {
+      scan_entry_files (script, map_file);
+      if (entryno >= 0)
+	break;
+    }
+
+  if (entryno >= 0 && ! script)
+    errnum = ERR_BAD_ARGUMENT;
+  else if (! hdr->count)
+    errnum = ERR_FILE_NOT_FOUND;
+  else
+    {
+      hdr->magic = BOOTMAP_MAGIC;
+      hdr->version = BOOTMAP_VERSION;
+      hdr->size = new_size;
+      hdr->checksum = checksum (hdr);
+
+      ok = write_map (mapfile);
+      if (ok)
+	grub_printf (" %d files in %d bytes\n", hdr->count, hdr->size);
+    }
+
+  grub_free_pages (new_map, alloc);
+  new_map = 0;
+  return ok;
+}
+
+#endif /* PLATFORM_EFI || GRUB_UTIL */
@@ -0,0 +1,295 @@
+/* bootprof.c - record a timeline of where the boot time goes */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2014  Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * The loader brackets the work it does, such as loading the
+ * configuration file, running a command or reading a file, in spans
+ * that are stamped with the time-stamp counter as they begin and end.
+ * Spans nest: reading a compressed file reads the compressed data,
+ * which reads the disk.  Every begin, end and mark goes into a ring
+ * of the last BOOTPROF_RING_SIZE events, and each end is also added
+ * to the totals for its phase as it happens, so the totals stay
+ * right when the ring wraps.
+ *
+ * A phase's total counts the time of its outermost span only, so
+ * that a read made on behalf of another read is not counted twice.
+ * Its self time is what is left of each span after the spans nested
+ * in it, so the self times of all the phases add up to the time spent
+ * in spans.
+ */
+
+#include "shared.h"
+
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+
+/* Spans nested deeper than this are not recorded.  */
+#define BOOTPROF_STACK		16
+
+/* The time the TSC is calibrated against, in microseconds.  */
+#define BOOTPROF_CALIBRATE_US	10000
+
+struct bootprof_stats bootprof_stats[BOOTPROF_PHASES];
+
+const char *bootprof_phase_names[BOOTPROF_PHASES] =
+{
+  "mark", "config", "command", "open", "read", "rawread", "decompress",
+  "exitboot"
+};
+
+unsigned long bootprof_dropped;
+
+static struct bootprof_event ring[BOOTPROF_RING_SIZE];
+
+/* The number of events recorded since the last reset.  */
+static unsigned long ring_next;
+
+/* The spans open now.  DEPTH may exceed BOOTPROF_STACK.  */
+static struct
+{
+  unsigned long long start;
+  /* Cycles spent in spans nested in this one */
+  unsigned long long nested;
+  int phase;
+} stack[BOOTPROF_STACK];
+static int depth;
+
+/* The number of spans open of each phase.  */
+static int open_spans[BOOTPROF_PHASES];
+
+static unsigned long tsc_khz;
+
+static inline unsigned long long
+rdtsc (void)
+{
+  unsigned int lo, hi;
+
+  __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+  return (unsigned long long) hi << 32 | lo;
+}
+
+static void
+record (int type, int phase, const char *name, unsigned long bytes,
+	unsigned long long tsc)
+{
+  struct bootprof_event *ev = &ring[ring_next % BOOTPROF_RING_SIZE];
+  int i = 0;
+
+  if (++ring_next > BOOTPROF_RING_SIZE)
+    bootprof_dropped++;
+
+  ev->tsc = tsc;
+  ev->bytes = bytes;
+  ev->type = type;
+  ev->phase = phase;
+  ev->depth = depth;
+  ev->drive = current_drive;
+
+  if (name)
+    {
+      const char *end = name;
+
+      /* A file name runs to the first space, and the tail of it is the
+	 part worth keeping.  */
+      while (*end && ! isspace (*end))
+	end++;
+      if (end - name >= BOOTPROF_NAME_LEN)
+	name = end - (BOOTPROF_NAME_LEN - 1);
+
+      while (name < end)
+	ev->name[i++] = *name++;
+    }
+
+  while (i < BOOTPROF_NAME_LEN)
+    ev->name[i++] = 0;
+}
+
+/* Open a span of PHASE, about NAME if it is not null.  */
+void
+bootprof_begin (int phase, const char *name)
+{
+  unsigned long long now = rdtsc ();
+
+  if (depth < BOOTPROF_STACK)
+    {
+      record (BOOTPROF_BEGIN, phase, name, 0, now);
+      stack[depth].start = now;
+      stack[depth].nested = 0;
+      stack[depth].phase = phase;
+      open_spans[phase]++;
+    }
+
+  depth++;
+}
+
+/* Close the innermost span, which moved BYTES bytes.  */
+void
+bootprof_end (unsigned long bytes)
+{
+  unsigned long long now = rdtsc (), spent;
+  struct bootprof_stats *st;
+  int phase;
+
+  if (! depth)
+    return;
+
+  if (--depth >= BOOTPROF_STACK)
+    return;
+
+  phase = stack[depth].phase;
+  spent = now - stack[depth].start;
+
+  st = &bootprof_stats[phase];
+  st->count++;
+  st->self += spent - stack[depth].nested;
+  if (--open_spans[phase] == 0)
+    {
+      st->total += spent;
+      st->bytes += bytes;
+    }
+
+  if (depth)
+    stack[depth - 1].nested += spent;
+
+  record (BOOTPROF_END, phase, 0, bytes, now);
+}
+
+void
+bootprof_mark (const char *name)
+{
+  record (BOOTPROF_POINT, BOOTPROF_MARK, name, 0, rdtsc ());
+}
+
+/* Close all the open spans, after a longjmp has left them behind.  */
+void
+bootprof_unwind (void)
+{
+  while (depth)
+    bootprof_end (0);
+}
+
+/* Forget the events and the totals so far.  Open spans stay open.  */
+void
+bootprof_reset (void)
+{
+  int i;
+
+  ring_next = 0;
+  bootprof_dropped = 0;
+  grub_memset (bootprof_stats, 0, sizeof (bootprof_stats));
+
+  for (i = 0; i < depth && i < BOOTPROF_STACK; i++)
+    {
+      stack[i].start = rdtsc ();
+      stack[i].nested = 0;
+    }
+}
+
+/* Return the number of events in the ring.  */
+int
+bootprof_count (void)
+{
+  return ring_next < BOOTPROF_RING_SIZE ? ring_next : BOOTPROF_RING_SIZE;
+}
+
+/* Return the Nth oldest event in the ring, or null.  */
+struct bootprof_event *
+bootprof_event (int n)
+{
+  int count = bootprof_count ();
+
+  if (n < 0 || n >= count)
+    return 0;
+
+  return &ring[(ring_next - count + n) % BOOTPROF_RING_SIZE];
+}
+
+/* Return the TSC frequency in kHz, measuring it the first time.  This
+   needs the firmware, so it must be called once before it goes away.  */
+unsigned long
+bootprof_tsc_khz (void)
+{
+  if (! tsc_khz)
+    {
+      unsigned long long start = rdtsc ();
+
+      microdelay (BOOTPROF_CALIBRATE_US);
+      tsc_khz = (rdtsc () - start) / (BOOTPROF_CALIBRATE_US / 1000);
+    }
+
+  return tsc_khz;
+}
+
+/* Return the time-stamp counter, for timing things against.  */
+unsigned long long
+bootprof_tsc (void)
+{
+  return rdtsc ();
+}
+
+/* Convert CYCLES to microseconds.  */
+unsigned long long
+bootprof_usecs (unsigned long long cycles)
+{
+  unsigned long khz = bootprof_tsc_khz ();
+
+  return khz ? cycles * 1000 / khz : 0;
+}
+
+/* Return the size that the profile takes to hand over, as it is now.  */
+int
+bootprof_export_size (void)
+{
+  return (sizeof (struct bootprof_header)
+	  + bootprof_count () * sizeof (struct bootprof_event));
+}
+
+/* Write the profile in the layout of bootprof.h to BUF, which is SIZE
+   bytes long, dropping the oldest events if they do not all fit.
+   Return the number of bytes written.  The TSC frequency is passed on
+   only if it was measured earlier.  */
+int
+bootprof_export (void *buf, int size)
+{
+  struct bootprof_header *hdr = buf;
+  struct bootprof_event *ev = (struct bootprof_event *) (hdr + 1);
+  int count = bootprof_count (), skip = 0, room, i;
+
+  if (size < (int) sizeof (*hdr))
+    return 0;
+
+  room = (size - sizeof (*hdr)) / sizeof (*ev);
+  if (count > room)
+    skip = count - room;
+
+  hdr->magic = BOOTPROF_MAGIC;
+  hdr->version = BOOTPROF_VERSION;
+  hdr->event_size = sizeof (*ev);
+  hdr->tsc_khz = tsc_khz;
+  hdr->count = count - skip;
+  hdr->dropped = bootprof_dropped + skip;
+  hdr->size = sizeof (*hdr) + hdr->count * sizeof (*ev);
+
+  for (i = 0; i < (int) hdr->count; i++)
+    grub_memmove (ev + i, bootprof_event (skip + i), sizeof (*ev));
+
+  return hdr->size;
+}
+
+#endif /* PLATFORM_EFI || GRUB_UTIL */
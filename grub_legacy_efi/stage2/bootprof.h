@@ -0,0 +1,89 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2014  Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ *  The boot profile, a timeline of what the loader spent its time on.
+ *
+ *  This is also the layout of the copy handed to the OS: a header
+ *  followed by COUNT events, oldest first.  It is passed to Linux as a
+ *  setup_data entry of type BOOTPROF_MAGIC, and to a multiboot kernel
+ *  as the last module, with the command line "bootprof".
+ */
+
+#define BOOTPROF_MAGIC		0x464f5250	/* "PROF" */
+#define BOOTPROF_VERSION	1
+
+/* What a span of time was spent on.  */
+#define BOOTPROF_MARK		0	/* a point in time, not a span */
+#define BOOTPROF_CONFIG		1	/* loading the configuration file */
+#define BOOTPROF_COMMAND	2	/* a command of a menu entry */
+#define BOOTPROF_OPEN		3	/* grub_open */
+#define BOOTPROF_READ		4	/* grub_read */
+#define BOOTPROF_RAWREAD	5	/* rawread */
+#define BOOTPROF_INFLATE	6	/* decompressing a file */
+#define BOOTPROF_EXIT_BOOT	7	/* ExitBootServices */
+#define BOOTPROF_PHASES		8
+
+/* Event types.  */
+#define BOOTPROF_BEGIN		1
+#define BOOTPROF_END		2
+#define BOOTPROF_POINT		3
+
+#define BOOTPROF_NAME_LEN	16
+
+struct bootprof_event
+{
+  /* The time-stamp counter when it happened */
+  unsigned long long tsc;
+
+  /* For an end, the bytes moved during the span */
+  unsigned int bytes;
+
+  unsigned char type;
+  unsigned char phase;
+
+  /* The number of spans open around this one */
+  unsigned char depth;
+
+  /* The BIOS drive number current at the time */
+  unsigned char drive;
+
+  /* For a begin or a mark, the file, command or tag, or the tail of
+     it if it is too long */
+  char name[BOOTPROF_NAME_LEN];
+};
+
+struct bootprof_header
+{
+  unsigned int magic;
+  unsigned short version;
+  unsigned short event_size;
+
+  /* TSC ticks per millisecond, or zero if it could not be measured */
+  unsigned int tsc_khz;
+
+  /* The number of events that follow */
+  unsigned int count;
+
+  /* The number of older events lost when the ring wrapped */
+  unsigned int dropped;
+
+  /* The size of the header and the events, in bytes */
+  unsigned int size;
+};
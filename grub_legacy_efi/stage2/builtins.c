@@ -405,6 +405,46 @@ static struct builtin builtin_boot =
   "Boot the OS/chain-loader which has been loaded."
 };
 
+
+#if defined(GRUB_UTIL) || defined(PLATFORM_EFI)
+/* bootmap [--off] [FILE] */
+static int
+bootmap_func (char *arg, int flags)
+{
+  if (grub_memcmp (arg, "--off", 5) == 0)
+    {
+      bootmap_unload ();
+      return 0;
+    }
+
+  if (! *arg)
+    {
+      grub_printf (" %d files in the boot map, %lu opened through it,"
+		   " %lu stale\n",
+		   bootmap_count (), bootmap_hits, bootmap_stale);
+      return 0;
+    }
+
+  if (! bootmap_load (arg))
+    return 1;
+
+  return 0;
+}
+
+static struct builtin builtin_bootmap =
+{
+  "bootmap",
+  bootmap_func,
+  BUILTIN_CMDLINE | BUILTIN_MENU | BUILTIN_HELP_LIST,
+  "bootmap [--off] [FILE]",
+  "Load the boot map in FILE, made by `mkbootmap', so that the files it"
+  " lists are read through their block lists, without looking them up in"
+  " the file system. A file that has changed since the map was made is"
+  " looked up as usual. If `--off' is given, stop using the map. With no"
+  " argument, show how much the map has been used."
+};
+#endif /* GRUB_UTIL || PLATFORM_EFI */
+
 
 #ifdef SUPPORT_NETBOOT
 /* bootp */
@@ -451,6 +491,164 @@ static struct builtin builtin_bootp =
 };
 #endif /* SUPPORT_NETBOOT */
 
+
+#if defined(GRUB_UTIL) || defined(PLATFORM_EFI)
+/* bootprof [--events] [--reset] */
+static int
+bootprof_func (char *arg, int flags)
+{
+  int events = 0, phase, i, j;
+  unsigned long long begin[16];
+  struct bootprof_event *ev;
+
+  /* Deal with GNU-style long options.  */
+  while (1)
+    {
+      if (grub_memcmp (arg, "--events", 8) == 0)
+	events = 1;
+      else if (grub_memcmp (arg, "--reset", 7) == 0)
+	bootprof_reset ();
+      else
+	break;
+
+      arg = skip_to (0, arg);
+    }
+
+  grub_printf (" TSC at %lu kHz, %d events kept, %lu dropped\n",
+	       bootprof_tsc_khz (), bootprof_count (), bootprof_dropped);
+
+  if (events)
+    {
+      /* The time of the begin of each open span, to give the length of
+	 the span at its end.  Zero if the begin was dropped.  */
+      grub_memset (begin, 0, sizeof (begin));
+
+      for (i = 0; (ev = bootprof_event (i)) != 0; i++)
+	{
+	  int depth = ev->depth < 16 ? ev->depth : 15;
+	  unsigned long long since = ev->tsc - bootprof_event (0)->tsc;
+
+	  grub_printf (" %llu us ", bootprof_usecs (since));
+	  for (j = 0; j < depth; j++)
+	    grub_printf ("  ");
+
+	  if (ev->type == BOOTPROF_BEGIN)
+	    {
+	      begin[depth] = ev->tsc;
+	      grub_printf ("%s %s (drive 0x%x)\n",
+			   bootprof_phase_names[ev->phase], ev->name,
+			   ev->drive);
+	    }
+	  else if (ev->type == BOOTPROF_END)
+	    {
+	      grub_printf ("end %s, %u bytes", bootprof_phase_names[ev->phase],
+			   ev->bytes);
+	      if (begin[depth])
+		grub_printf (" in %llu us",
+			     bootprof_usecs (ev->tsc - begin[depth]));
+	      grub_printf ("\n");
+	      begin[depth] = 0;
+	    }
+	  else
+	    grub_printf ("mark %s\n", ev->name);
+	}
+    }
+
+  for (phase = 0; phase < BOOTPROF_PHASES; phase++)
+    {
+      struct bootprof_stats *st = &bootprof_stats[phase];
+
+      if (! st->count)
+	continue;
+
+      grub_printf (" %s: %lu spans, %llu us (%llu us self)",
+		   bootprof_phase_names[phase], st->count,
+		   bootprof_usecs (st->total), bootprof_usecs (st->self));
+      if (st->bytes)
+	grub_printf (", %llu bytes", st->bytes);
+      grub_printf ("\n");
+    }
+
+  return 0;
+}
+
+static struct builtin builtin_bootprof =
+{
+  "bootprof",
+  bootprof_func,
+  BUILTIN_CMDLINE | BUILTIN_HELP_LIST,
+  "bootprof [--events] [--reset]",
+  "Show where the time has gone since GRUB started: for each phase, such"
+  " as reading files or running the commands of an entry, the number of"
+  " spans, the time in them, the time not spent in nested spans (self)"
+  " and the bytes moved. If the option `--events' is given, list the"
+  " events recorded first. If `--reset' is given, clear the profile."
+};
+#endif /* GRUB_UTIL || PLATFORM_EFI */
+
+
+#if defined(GRUB_UTIL) || defined(PLATFORM_EFI)
+/* cachestat [--reset] [--size=N] */
+static int
+cachestat_func (char *arg, int flags)
+{
+  unsigned long total;
+
+  /* Deal with GNU-style long options.  */
+  while (1)
+    {
+      if (grub_memcmp (arg, "--reset", 7) == 0)
+	{
+	  disk_cache_hits = 0;
+	  disk_cache_misses = 0;
+	  dentry_hits = 0;
+	  dentry_misses = 0;
+	}
+      else if (grub_memcmp (arg, "--size=", 7) == 0)
+	{
+	  char *p = arg + 7;
+	  int entries;
+
+	  if (! safe_parse_maxint (&p, &entries))
+	    return 1;
+
+	  if (! disk_cache_resize (entries))
+	    {
+	      errnum = ERR_WONT_FIT;
+	      return 1;
+	    }
+	}
+      else
+	break;
+
+      arg = skip_to (0, arg);
+    }
+
+  total = disk_cache_hits + disk_cache_misses;
+  grub_printf (" Disk cache: %d of %d tracks in use, %d KB each\n",
+	       disk_cache_used, disk_cache_entries, BUFFERLEN >> 10);
+  grub_printf (" Hits: %lu, misses: %lu (%lu%c of reads saved)\n",
+	       disk_cache_hits, disk_cache_misses,
+	       total ? disk_cache_hits * 100 / total : 0, '%');
+  grub_printf (" Path cache: %lu hits, %lu misses\n",
+	       dentry_hits, dentry_misses);
+  return 0;
+}
+
+static struct builtin builtin_cachestat =
+{
+  "cachestat",
+  cachestat_func,
+  BUILTIN_CMDLINE | BUILTIN_MENU | BUILTIN_HELP_LIST,
+  "cachestat [--reset] [--size=N]",
+  "Show how many track reads were served by the disk cache (hits) and how"
+  " many went to the device (misses), and how many file name lookups"
+  " started from a path found in the path cache. If the option `--reset'"
+  " is given, clear the counters. If `--size' is given, make the disk"
+  " cache hold N tracks, dropping its contents; 0 disables it."
+};
+#endif /* GRUB_UTIL || PLATFORM_EFI */
+
 
 /* cat */
 static int
@@ -956,6 +1154,8 @@ device_func (char *arg, int flags)
     }
 
   assign_device_name (current_drive, device);
+  /* The drives may have been renumbered, so what is cached is stale.  */
+  disk_cache_flush (-1);
 
   return 0;
 }
@@ -1215,6 +1415,19 @@ displaymem_func (char *arg, int flags)
 	}
     }
 
+#if defined(PLATFORM_EFI) && !defined(GRUB_UTIL)
+  /* The grub shell takes its memory from the C library.  */
+  {
+    struct grub_heap_stats heap;
+
+    grub_heap_stats (&heap);
+    grub_printf (" Heap: %luK in %lu arenas, %luK in use, %luK at most,"
+		 " %lu slab pages, %lu requests from the pool\n",
+		 heap.size >> 10, heap.arenas, heap.in_use >> 10,
+		 heap.peak >> 10, heap.slabs, heap.pool);
+  }
+#endif
+
   return 0;
 }
 
@@ -2967,6 +3180,48 @@ static struct builtin builtin_md5crypt =
 };
 #endif /* USE_MD5_PASSWORDS */
 
+#if defined(GRUB_UTIL) || defined(PLATFORM_EFI)
+/* mkbootmap [--entry=N] FILE */
+static int
+mkbootmap_func (char *arg, int flags)
+{
+  int entryno = -1;
+
+  if (grub_memcmp (arg, "--entry=", 8) == 0)
+    {
+      char *p = arg + 8;
+
+      if (! safe_parse_maxint (&p, &entryno))
+	return 1;
+
+      arg = skip_to (0, arg);
+    }
+
+  if (! *arg)
+    {
+      errnum = ERR_BAD_ARGUMENT;
+      return 1;
+    }
+
+  if (! bootmap_make (arg, entryno))
+    return 1;
+
+  return 0;
+}
+
+static struct builtin builtin_mkbootmap =
+{
+  "mkbootmap",
+  mkbootmap_func,
+  BUILTIN_CMDLINE | BUILTIN_HELP_LIST,
+  "mkbootmap [--entry=N] FILE",
+  "Find the sectors of each file that the menu entries load, or that"
+  " entry N loads, and save them with a fingerprint of each file as a"
+  " boot map in FILE, for `bootmap' to use. FILE must already exist and"
+  " be big enough, as it is written over in place."
+};
+#endif /* GRUB_UTIL || PLATFORM_EFI */
+
 /* module */
 static int
 module_func (char *arg, int flags)
@@ -4541,6 +4796,22 @@ static struct builtin builtin_silent =
   "grub will attempt to avoid printing anything to the screen"
 };
 
+
+#ifdef PLATFORM_EFI
+/* spibench */
+static struct builtin builtin_spibench =
+{
+  "spibench",
+  grub_cln_spi_bench,
+  BUILTIN_CMDLINE | BUILTIN_HELP_LIST,
+  "spibench [--kernel | --initrd | --config] [--chunk=SIZE]",
+  "Look up the kernel (the default), initrd or config file in the SPI"
+  " flash, read it in chunks of SIZE bytes (all at once by default) and"
+  " show how it was transferred: how much went in blocks and how much by"
+  " the CPU, and how long it took in TSC cycles."
+};
+#endif /* PLATFORM_EFI */
+
 
 #if defined(SUPPORT_SERIAL) || defined(SUPPORT_HERCULES) || defined(SUPPORT_GRAPHICS)
 /* terminal */
@@ -5056,6 +5327,42 @@ static struct builtin builtin_tftpserver =
 };
 #endif /* SUPPORT_NETBOOT */
 
+#ifdef PLATFORM_EFI
+/* tftpblksize [SIZE] */
+static int
+tftpblksize_func (char *arg, int flags)
+{
+  int size;
+
+  if (! *arg)
+    {
+      grub_printf (" TFTP block size is %d\n", efi_tftp_get_block_size ());
+      return 0;
+    }
+
+  if (! safe_parse_maxint (&arg, &size) || size < 512 || size > 65464)
+    {
+      errnum = ERR_BAD_ARGUMENT;
+      return 1;
+    }
+
+  efi_tftp_set_block_size (size);
+  return 0;
+}
+
+static struct builtin builtin_tftpblksize =
+{
+  "tftpblksize",
+  tftpblksize_func,
+  BUILTIN_CMDLINE | BUILTIN_MENU | BUILTIN_HELP_LIST,
+  "tftpblksize [SIZE]",
+  "Ask the TFTP server for blocks of SIZE bytes, from 512 to 65464, or"
+  " show the size asked for if SIZE is omitted. The default, 1468, fits"
+  " an Ethernet frame; larger blocks need IP fragmentation. If the"
+  " server refuses, 512-byte blocks are used instead."
+};
+#endif /* PLATFORM_EFI */
+
 
 /* timeout */
 static int
@@ -5303,9 +5610,18 @@ struct builtin *builtin_table[] =
 #endif
   &builtin_blocklist,
   &builtin_boot,
+#if defined(GRUB_UTIL) || defined(PLATFORM_EFI)
+  &builtin_bootmap,
+#endif /* GRUB_UTIL || PLATFORM_EFI */
 #ifdef SUPPORT_NETBOOT
   &builtin_bootp,
 #endif /* SUPPORT_NETBOOT */
+#if defined(GRUB_UTIL) || defined(PLATFORM_EFI)
+  &builtin_bootprof,
+#endif /* GRUB_UTIL || PLATFORM_EFI */
+#if defined(GRUB_UTIL) || defined(PLATFORM_EFI)
+  &builtin_cachestat,
+#endif /* GRUB_UTIL || PLATFORM_EFI */
   &builtin_cat,
   &builtin_chainloader,
   &builtin_clear,
@@ -5365,6 +5681,9 @@ struct builtin *builtin_table[] =
 #ifdef USE_MD5_PASSWORDS
   &builtin_md5crypt,
 #endif /* USE_MD5_PASSWORDS */
+#if defined(GRUB_UTIL) || defined(PLATFORM_EFI)
+  &builtin_mkbootmap,
+#endif /* GRUB_UTIL || PLATFORM_EFI */
   &builtin_module,
   &builtin_modulenounzip,
   &builtin_pager,
@@ -5391,6 +5710,9 @@ struct builtin *builtin_table[] =
   &builtin_setup,
 #endif
   &builtin_silent,
+#ifdef PLATFORM_EFI
+  &builtin_spibench,
+#endif
 #ifdef SUPPORT_GRAPHICS
   &builtin_splashimage,
 #endif /* SUPPORT_GRAPHICS */
@@ -5404,6 +5726,9 @@ struct builtin *builtin_table[] =
 #ifndef PLATFORM_EFI
   &builtin_testvbe,
 #endif
+#ifdef PLATFORM_EFI
+  &builtin_tftpblksize,
+#endif /* PLATFORM_EFI */
 #ifdef SUPPORT_NETBOOT
   &builtin_tftpserver,
 #endif /* SUPPORT_NETBOOT */
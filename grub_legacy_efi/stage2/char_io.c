@@ -1632,34 +1632,138 @@ memcheck (int addr, int len)
 #endif
 }
 
+#ifndef STAGE1_5
+/* Moves and stores of a whole word, as wide as the build is.  */
+# ifdef __x86_64__
+#  define MOVS_WORD	"movsq"
+#  define STOS_WORD	"stosq"
+# else
+#  define MOVS_WORD	"movsl"
+#  define STOS_WORD	"stosl"
+# endif
+# define WORD_SIZE	(sizeof (unsigned long))
+
+# define REP_MOVS(insn, count, to, from)				\
+  asm volatile ("rep\n\t" insn					\
+		: "+c" (count), "+S" (from), "+D" (to) : : "memory")
+# define REP_STOS(insn, count, to, val)				\
+  asm volatile ("rep\n\t" insn					\
+		: "+c" (count), "+D" (to) : "a" (val) : "memory")
+
+# ifdef __x86_64__
+/* Return true if the processor moves strings a byte at a time as fast
+   as it can, so that REP MOVSB beats any loop over words.  */
+static int
+fast_strings (void)
+{
+  static int fast = -1;
+  unsigned int eax, ebx, ecx, edx;
+
+  if (fast < 0)
+    {
+      asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+	   : "0" (0));
+      fast = 0;
+      if (eax >= 7)
+	{
+	  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+	       : "0" (7), "2" (0));
+	  /* Enhanced REP MOVSB/STOSB */
+	  fast = (ebx >> 9) & 1;
+	}
+    }
+
+  return fast;
+}
+# else
+/* None of the 32-bit processors this runs on, such as Quark, have
+   them.  */
+#  define fast_strings()	0
+# endif
+
+/* Copy LEN bytes from FROM to TO front to back, which is right unless
+   TO overlaps the end of FROM.  Without fast strings, the bytes up to a
+   word boundary of TO are moved one at a time, then whole words, then
+   the bytes left.  */
+static void
+copy_forward (char *to, const char *from, unsigned long len)
+{
+  unsigned long n;
+
+  if (len >= 4 * WORD_SIZE && ! fast_strings ())
+    {
+      n = -(unsigned long) to & (WORD_SIZE - 1);
+      len -= n;
+      REP_MOVS ("movsb", n, to, from);
+
+      n = len / WORD_SIZE;
+      len %= WORD_SIZE;
+      REP_MOVS (MOVS_WORD, n, to, from);
+    }
+
+  REP_MOVS ("movsb", len, to, from);
+}
+
+/* Set LEN bytes at TO to C, a word at a time in the same way.  */
+static void
+fill (char *to, int c, unsigned long len)
+{
+  unsigned long n;
+
+  if (len >= 4 * WORD_SIZE && ! fast_strings ())
+    {
+      n = -(unsigned long) to & (WORD_SIZE - 1);
+      len -= n;
+      REP_STOS ("stosb", n, to, c);
+
+      n = len / WORD_SIZE;
+      len %= WORD_SIZE;
+      REP_STOS (STOS_WORD, n, to, (unsigned char) c * (~0UL / 0xff));
+    }
+
+  REP_STOS ("stosb", len, to, c);
+}
+#endif /* ! STAGE1_5 */
+
 void
 grub_memcpy(void *dest, const void *src, int len)
 {
+#ifndef STAGE1_5
+  if (len > 0)
+    copy_forward (dest, src, len);
+#else
   int i;
   register char *d = (char*)dest, *s = (char*)src;
 
   for (i = 0; i < len; i++)
     d[i] = s[i];
+#endif
 }
 
 void *
 grub_memmove (void *to, const void *from, int len)
 {
-  if (memcheck ((unsigned long) to, len))
+  if (memcheck ((unsigned long) to, len) && len > 0)
      {
-       /* This assembly code is stolen from
-	  linux-2.2.2/include/asm-i386/string.h. This is not very fast
-	  but compact.  */
        int d0, d1, d2;
 
-       if (to < from)
+       /* Only a copy onto the end of its own source has to go back to
+	  front.  */
+       if (to < from || (const char *) from + len <= (char *) to)
 	 {
+#ifndef STAGE1_5
+	   copy_forward (to, from, len);
+#else
+	   /* This assembly code is stolen from
+	      linux-2.2.2/include/asm-i386/string.h. This is not very fast
+	      but compact.  */
 	   asm volatile ("cld\n\t"
 			 "rep\n\t"
 			 "movsb"
 			 : "=&c" (d0), "=&S" (d1), "=&D" (d2)
 			 : "0" (len),"1" (from),"2" (to)
 			 : "memory");
+#endif
 	 }
        else
 	 {
@@ -1681,12 +1785,16 @@ grub_memmove (void *to, const void *from, int len)
 void *
 grub_memset (void *start, int c, int len)
 {
-  char *p = start;
-
-  if (memcheck ((unsigned long) start, len))
+  if (memcheck ((unsigned long) start, len) && len > 0)
     {
+#ifndef STAGE1_5
+      fill (start, c, len);
+#else
+      char *p = start;
+
       while (len -- > 0)
 	*p ++ = c;
+#endif
     }
 
   return errnum ? NULL : start;
@@ -134,6 +134,7 @@ enter_cmdline (char *heap, int forever, int cln_recovery)
   /* Initialize the data and print a message.  */
   init_cmdline (cln_recovery);
   grub_setjmp (restart_cmdline_env);
+  bootprof_unwind ();
   init_page (cln_recovery);
 #ifdef SUPPORT_DISKLESS
   print_network_configuration ();
@@ -253,6 +254,8 @@ run_script (char *script, char *heap)
 
       /* Run BUILTIN->FUNC.  */
       arg = skip_to (1, heap);
+      bootprof_begin (BOOTPROF_COMMAND, builtin->name);
       (builtin->func) (arg, BUILTIN_SCRIPT);
+      bootprof_end (0);
     }
 }
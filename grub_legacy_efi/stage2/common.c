@@ -90,6 +90,9 @@ char *err_list[] =
   [ERR_WRITE] = "Disk write error",
   [ERR_CLN_VERIFICATION] = "Clanton signature verification failed",
   [ERR_SGN_FILE_NOT_FOUND] = "Clanton signature file not found",
+  [ERR_BAD_GZIP_CRC] = "Compressed file failed its CRC or length check",
+  [ERR_BAD_BOOTMAP] = "Invalid boot map",
+  [ERR_FILE_HOLES] = "File has holes",
 };
 
 
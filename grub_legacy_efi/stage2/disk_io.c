@@ -144,8 +144,417 @@ grub_log2 (unsigned int word)
   return word;
 }
 
+#ifdef DENTRY_CACHE
+/*
+ *  The path cache.  Each entry is a path on a partition, up to the end
+ *  of one of its components, that a filesystem has looked up, with where
+ *  the filesystem found it, or with nothing if it was not there.  What
+ *  the location is, an inode number or a first cluster, is up to the
+ *  filesystem.  Its lookups then start from the longest known prefix of
+ *  a path instead of the root directory, and a path below one that is
+ *  missing fails at once, which keeps `find' and probes for optional
+ *  files cheap.
+ *
+ *  The entries of a drive are dropped when BUF_DRIVE has been reset and
+ *  the drive is probed again with another medium in it, as the tracks of
+ *  the disk cache are.
+ */
+struct dentry
+{
+  int drive;
+  int partition;
+  int fsys;
+  unsigned long media_id;
+  /* The value of DENTRY_CLOCK when last used.  */
+  unsigned long last_used;
+  /* The length of PATH, or 0 if free.  */
+  int len;
+  /* The bytes of LOC, or 0 if the path is missing.  */
+  int size;
+  char path[DENTRY_PATH_LEN];
+  char loc[DENTRY_LOC_SIZE];
+};
+
+static struct dentry dentries[DENTRY_ENTRIES];
+static unsigned long dentry_clock;
+unsigned long dentry_hits;
+unsigned long dentry_misses;
+
+/* Drop the entries of DRIVE, or of all drives if DRIVE is -1.  */
+static void
+dentry_flush (int drive)
+{
+  int i;
+
+  for (i = 0; i < DENTRY_ENTRIES; i++)
+    if (drive == -1 || dentries[i].drive == drive)
+      dentries[i].len = 0;
+}
+
+/* Called whenever DRIVE has been probed again: drop the entries which
+   were looked up on another medium than MEDIA_ID.  */
+static void
+dentry_probe (int drive, unsigned long media_id)
+{
+  int i;
+
+  for (i = 0; i < DENTRY_ENTRIES; i++)
+    if (dentries[i].drive == drive && dentries[i].media_id != media_id)
+      dentries[i].len = 0;
+}
+
+/* Look up the longest prefix of PATH known on the current partition.
+   If it was found, copy its location to LOC, which has SIZE bytes, set
+   *REST to the rest of PATH and return 1.  Return -1 if PATH is known
+   to be missing, and 0 if nothing is known.  */
 int
-rawread (int drive, int sector, int byte_offset, int byte_len, char *buf)
+dentry_lookup (char *path, char **rest, void *loc, int size)
+{
+  struct dentry *best = 0;
+  int i;
+
+  for (i = 0; i < DENTRY_ENTRIES; i++)
+    {
+      struct dentry *d = &dentries[i];
+      char c;
+
+      if (! d->len || d->drive != current_drive
+	  || d->partition != current_partition || d->fsys != fsys_type
+	  || grub_memcmp (d->path, path, d->len) != 0)
+	continue;
+
+      /* The prefix must end where a component of PATH does.  */
+      c = path[d->len];
+      if (c && c != '/' && ! isspace (c))
+	continue;
+
+      if (! d->size)
+	{
+	  d->last_used = ++dentry_clock;
+	  dentry_hits++;
+	  return -1;
+	}
+
+      if (d->size == size && (! best || d->len > best->len))
+	best = d;
+    }
+
+  if (! best)
+    {
+      dentry_misses++;
+      return 0;
+    }
+
+  best->last_used = ++dentry_clock;
+  dentry_hits++;
+  grub_memmove (loc, best->loc, size);
+  *rest = path + best->len;
+  return 1;
+}
+
+/* Remember that the first LEN bytes of PATH are at LOC, which has SIZE
+   bytes, on the current partition, or are missing if SIZE is 0.  */
+void
+dentry_enter (char *path, int len, void *loc, int size)
+{
+  struct dentry *d = 0;
+  int i;
+
+  if (len <= 0 || len > DENTRY_PATH_LEN || size > DENTRY_LOC_SIZE)
+    return;
+
+  for (i = 0; i < DENTRY_ENTRIES; i++)
+    {
+      if (dentries[i].len == len && dentries[i].drive == current_drive
+	  && dentries[i].partition == current_partition
+	  && dentries[i].fsys == fsys_type
+	  && grub_memcmp (dentries[i].path, path, len) == 0)
+	{
+	  d = &dentries[i];
+	  break;
+	}
+
+      /* A free entry has LEN zero, so it is taken first.  */
+      if (! d || (d->len && (! dentries[i].len
+			     || dentries[i].last_used < d->last_used)))
+	d = &dentries[i];
+    }
+
+  d->drive = current_drive;
+  d->partition = current_partition;
+  d->fsys = fsys_type;
+  d->media_id = get_media_id (current_drive);
+  d->last_used = ++dentry_clock;
+  d->len = len;
+  d->size = size;
+  grub_memmove (d->path, path, len);
+  if (size)
+    grub_memmove (d->loc, loc, size);
+}
+#endif /* DENTRY_CACHE */
+
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+/*
+ *  The disk cache.  It keeps the most recently used tracks of every
+ *  drive, so that the metadata which the filesystems read over and over
+ *  again (superblocks, inode tables, directories, FATs and indirect
+ *  blocks) is fetched from the device only once.  Each entry holds a
+ *  virtual track, the same unit as the track buffer at BUFFERADDR, and
+ *  the least recently used entry is replaced on a miss.
+ *
+ *  Unlike the track buffer, the entries survive BUF_DRIVE being reset
+ *  between commands.  Instead, when a drive is probed again, the entries
+ *  read from it are dropped if its medium identifier has changed.
+ */
+struct disk_cache_entry
+{
+  /* The drive and the first sector of the track, or -1 if free.  */
+  int drive;
+  int track;
+  /* The number of sectors held, which is short at the end of a disk.  */
+  int nsec;
+  /* The identifier of the medium the track was read from.  */
+  unsigned long media_id;
+  /* The value of DISK_CACHE_CLOCK when last used, or 0 if free.  */
+  unsigned long last_used;
+  char *data;
+};
+
+/* The memory used for ENTRIES entries.  The tracks come first, so that
+   they stay page aligned, and the table of entries follows them.  */
+#define DISK_CACHE_BYTES(entries)	\
+  ((entries) * (BUFFERLEN + sizeof (struct disk_cache_entry)))
+
+int disk_cache_entries = DISK_CACHE_ENTRIES;
+int disk_cache_used;
+unsigned long disk_cache_hits;
+unsigned long disk_cache_misses;
+
+static struct disk_cache_entry *disk_cache;
+static unsigned long disk_cache_clock;
+/* The medium identifier of BUF_DRIVE.  */
+static unsigned long buf_media_id;
+
+static int
+disk_cache_init (void)
+{
+  char *mem;
+  int i;
+
+  mem = grub_alloc_pages (DISK_CACHE_BYTES (disk_cache_entries));
+  if (! mem)
+    {
+      /* Go on with the track buffer alone.  */
+      disk_cache_entries = 0;
+      return 0;
+    }
+
+  disk_cache = (struct disk_cache_entry *) (mem + (disk_cache_entries
+						   * BUFFERLEN));
+  for (i = 0; i < disk_cache_entries; i++)
+    {
+      disk_cache[i].track = -1;
+      disk_cache[i].last_used = 0;
+      disk_cache[i].data = mem + i * BUFFERLEN;
+    }
+
+  disk_cache_used = 0;
+  return 1;
+}
+
+static void
+disk_cache_drop (struct disk_cache_entry *entry)
+{
+  if (entry->track == -1)
+    return;
+
+  entry->track = -1;
+  entry->last_used = 0;
+  disk_cache_used--;
+}
+
+/* Drop the entries of DRIVE, or of all drives if DRIVE is -1.  */
+void
+disk_cache_flush (int drive)
+{
+  int i;
+
+#ifdef DENTRY_CACHE
+  dentry_flush (drive);
+#endif
+  if (! disk_cache)
+    return;
+
+  for (i = 0; i < disk_cache_entries; i++)
+    if (drive == -1 || disk_cache[i].drive == drive)
+      disk_cache_drop (&disk_cache[i]);
+}
+
+/* Make the cache hold ENTRIES tracks, dropping everything cached so far.
+   Zero disables the cache.  Return zero if the memory cannot be had.  */
+int
+disk_cache_resize (int entries)
+{
+  if (disk_cache)
+    {
+      grub_free_pages (disk_cache[0].data,
+		       DISK_CACHE_BYTES (disk_cache_entries));
+      disk_cache = 0;
+    }
+
+  disk_cache_entries = entries;
+  disk_cache_used = 0;
+  if (entries <= 0)
+    return 1;
+
+  return disk_cache_init ();
+}
+
+/* Called whenever DRIVE has been probed again: drop the tracks which
+   were read from another medium.  */
+static void
+disk_cache_probe (int drive)
+{
+  int i;
+
+  buf_media_id = get_media_id (drive);
+#ifdef DENTRY_CACHE
+  dentry_probe (drive, buf_media_id);
+#endif
+  if (! disk_cache)
+    return;
+
+  for (i = 0; i < disk_cache_entries; i++)
+    if (disk_cache[i].drive == drive
+	&& disk_cache[i].media_id != buf_media_id)
+      disk_cache_drop (&disk_cache[i]);
+}
+
+/* Drop the track holding SECTOR of DRIVE, which is being written.  */
+static void
+disk_cache_invalidate (int drive, int sector)
+{
+  int i;
+
+  if (! disk_cache)
+    return;
+
+  for (i = 0; i < disk_cache_entries; i++)
+    if (disk_cache[i].track != -1
+	&& disk_cache[i].drive == drive
+	&& sector >= disk_cache[i].track
+	&& sector < disk_cache[i].track + disk_cache[i].nsec)
+      disk_cache_drop (&disk_cache[i]);
+}
+
+/* Return the data of the track of NSEC sectors starting at TRACK on
+   DRIVE, which must be BUF_DRIVE, reading it in on a miss.  Return 0 if
+   the cache is disabled or the track cannot be read as a whole, so that
+   the caller falls back to the track buffer.  */
+static char *
+disk_cache_lookup (int drive, int track, int nsec)
+{
+  struct disk_cache_entry *entry = 0;
+  int i;
+
+  if (! disk_cache && (disk_cache_entries <= 0 || ! disk_cache_init ()))
+    return 0;
+
+  disk_cache_clock++;
+  for (i = 0; i < disk_cache_entries; i++)
+    {
+      if (disk_cache[i].track == track && disk_cache[i].drive == drive)
+	{
+	  disk_cache[i].last_used = disk_cache_clock;
+	  disk_cache_hits++;
+	  return disk_cache[i].data;
+	}
+
+      /* A free entry has LAST_USED zero, so it is taken first.  */
+      if (! entry || disk_cache[i].last_used < entry->last_used)
+	entry = &disk_cache[i];
+    }
+
+  disk_cache_misses++;
+  disk_cache_drop (entry);
+
+  if (nsec > buf_geom.total_sectors - track)
+    nsec = buf_geom.total_sectors - track;
+
+  if (biosdisk_direct (BIOSDISK_READ, drive, &buf_geom,
+		       track, nsec, entry->data))
+    return 0;
+
+  if (track == 0
+      && (PC_SLICE_TYPE (entry->data, 0) == PC_SLICE_TYPE_EZD
+	  || PC_SLICE_TYPE (entry->data, 1) == PC_SLICE_TYPE_EZD
+	  || PC_SLICE_TYPE (entry->data, 2) == PC_SLICE_TYPE_EZD
+	  || PC_SLICE_TYPE (entry->data, 3) == PC_SLICE_TYPE_EZD))
+    {
+      /* This is a EZD disk map sector 0 to sector 1 */
+      if (nsec >= 2)
+	grub_memmove (entry->data, entry->data + buf_geom.sector_size,
+		      buf_geom.sector_size);
+      else if (biosdisk_direct (BIOSDISK_READ, drive, &buf_geom,
+				1, 1, entry->data))
+	return 0;
+    }
+
+  entry->drive = drive;
+  entry->track = track;
+  entry->nsec = nsec;
+  entry->media_id = buf_media_id;
+  entry->last_used = disk_cache_clock;
+  disk_cache_used++;
+  return entry->data;
+}
+#endif /* PLATFORM_EFI || GRUB_UTIL */
+
+/* A flat LBA device has no tracks.  Its virtual tracks are as large as
+   the track buffer holds in whole units of IO_SECTORS, and aligned the
+   way the medium is, so that no read splits a physical block.  The
+   utility, which defines PLATFORM_EFI too, passes a file descriptor in
+   the flags and keeps the track geometry.  */
+#if defined(PLATFORM_EFI) && !defined(GRUB_UTIL)
+# define LBA_DEVICE(geom)	((geom)->flags & BIOSDISK_FLAG_LBA_EXTENSION)
+#else
+# define LBA_DEVICE(geom)	0
+#endif
+
+/* Return the number of sectors in a virtual track of BUF_GEOM, the unit
+   read into the track buffer and the disk cache.  */
+static int
+vtrack_sectors (int sector_size_bits)
+{
+  int max = BUFFERLEN >> sector_size_bits;
+
+  if (LBA_DEVICE (&buf_geom))
+    return max - max % buf_geom.io_sectors;
+
+  /* Eliminate a buffer overflow.  */
+  if (buf_geom.sectors > max)
+    return max;
+  return buf_geom.sectors;
+}
+
+/* Return how far SECTOR is into its virtual track of SECTORS_PER_VTRACK
+   sectors.  The sectors before the first aligned one are a track of
+   their own.  */
+static int
+vtrack_offset (int sector, int sectors_per_vtrack)
+{
+  if (LBA_DEVICE (&buf_geom))
+    {
+      if (sector < buf_geom.io_first)
+	return sector;
+      return (sector - buf_geom.io_first) % sectors_per_vtrack;
+    }
+
+  return sector % sectors_per_vtrack;
+}
+
+static int
+read_sectors (int drive, int sector, int byte_offset, int byte_len, char *buf)
 {
   int slen, sectors_per_vtrack;
   int sector_size_bits = grub_log2 (buf_geom.sector_size);
@@ -157,6 +566,9 @@ rawread (int drive, int sector, int byte_offset, int byte_len, char *buf)
     {
       int soff, num_sect, track, size = byte_len;
       char *bufaddr;
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+      char *cached;
+#endif
 
       /*
        *  Check track buffer.  If it isn't valid or it is from the
@@ -172,6 +584,9 @@ rawread (int drive, int sector, int byte_offset, int byte_len, char *buf)
 	  buf_drive = drive;
 	  buf_track = -1;
 	  sector_size_bits = grub_log2 (buf_geom.sector_size);
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+	  disk_cache_probe (drive);
+#endif
 	}
 
       /* Make sure that SECTOR is valid.  */
@@ -184,19 +599,59 @@ rawread (int drive, int sector, int byte_offset, int byte_len, char *buf)
       slen = ((byte_offset + byte_len + buf_geom.sector_size - 1)
 	      >> sector_size_bits);
       
-      /* Eliminate a buffer overflow.  */
-      if ((buf_geom.sectors << sector_size_bits) > BUFFERLEN)
-	sectors_per_vtrack = (BUFFERLEN >> sector_size_bits);
-      else
-	sectors_per_vtrack = buf_geom.sectors;
+      sectors_per_vtrack = vtrack_sectors (sector_size_bits);
       
       /* Get the first sector of track.  */
-      soff = sector % sectors_per_vtrack;
+      soff = vtrack_offset (sector, sectors_per_vtrack);
       track = sector - soff;
       num_sect = sectors_per_vtrack - soff;
       bufaddr = ((char *) BUFFERADDR
 		 + (soff << sector_size_bits) + byte_offset);
 
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+      /*
+       *  A span of at least a whole track's worth of sectors is read
+       *  straight into BUF in a single request, rather than track by
+       *  track through the buffer.  Only an unaligned head or tail
+       *  sector goes through BUFFERADDR.  Sector 0 is left to the
+       *  buffered path because of the EZD remapping below.
+       *
+       *  On an LBA device the head is the rest of its virtual track
+       *  instead, so that the span starts aligned, and the span is
+       *  made whole units of IO_SECTORS, leaving the rest to the tail.
+       */
+      if (byte_offset != 0 && ! LBA_DEVICE (&buf_geom)
+	  && ((byte_offset + byte_len) >> sector_size_bits) - 1
+	     >= sectors_per_vtrack)
+	num_sect = 1;
+
+      if (byte_offset == 0 && sector != 0
+	  && (! LBA_DEVICE (&buf_geom) || soff == 0)
+	  && (byte_len >> sector_size_bits) >= sectors_per_vtrack)
+	{
+	  num_sect = byte_len >> sector_size_bits;
+	  if (LBA_DEVICE (&buf_geom))
+	    num_sect -= num_sect % buf_geom.io_sectors;
+	  if (num_sect > buf_geom.total_sectors - sector)
+	    num_sect = buf_geom.total_sectors - sector;
+
+	  if (biosdisk_direct (BIOSDISK_READ, drive, &buf_geom,
+			       sector, num_sect, buf))
+	    {
+	      errnum = ERR_READ;
+	      return 0;
+	    }
+
+	  bufaddr = buf;
+	}
+      /* Reads of up to a track, which is what metadata lookups amount
+	 to, go through the disk cache.  */
+      else if (slen <= sectors_per_vtrack
+	       && (cached = disk_cache_lookup (drive, track,
+					       sectors_per_vtrack)) != 0)
+	bufaddr = cached + (soff << sector_size_bits) + byte_offset;
+      else
+#endif /* PLATFORM_EFI || GRUB_UTIL */
       if (track != buf_track)
 	{
 	  int bios_err, read_start = track, read_len = sectors_per_vtrack;
@@ -235,6 +690,10 @@ rawread (int drive, int sector, int byte_offset, int byte_len, char *buf)
 		  bufaddr = (char *) BUFFERADDR + byte_offset;
 		}
 	    }
+	  else if (read_start != track)
+	    /* Only the tail of TRACK was read, to the start of the buffer,
+	       so the buffer cannot serve later reads of this track.  */
+	    buf_track = -1;
 	  else
 	    buf_track = track;
 
@@ -286,7 +745,8 @@ rawread (int drive, int sector, int byte_offset, int byte_len, char *buf)
 	    }
 	}
 
-      grub_memmove (buf, bufaddr, size);
+      if (bufaddr != buf)
+	grub_memmove (buf, bufaddr, size);
 
       buf += size;
       byte_len -= size;
@@ -297,6 +757,18 @@ rawread (int drive, int sector, int byte_offset, int byte_len, char *buf)
   return (!errnum);
 }
 
+int
+rawread (int drive, int sector, int byte_offset, int byte_len, char *buf)
+{
+  int ret;
+
+  bootprof_begin (BOOTPROF_RAWREAD, 0);
+  ret = read_sectors (drive, sector, byte_offset, byte_len, buf);
+  bootprof_end (ret ? byte_len : 0);
+
+  return ret;
+}
+
 
 int
 devread (int sector, int byte_offset, int byte_len, char *buf)
@@ -363,9 +835,14 @@ rawwrite (int drive, int sector, char *buf)
       return 0;
     }
 
-  if (sector - sector % buf_geom.sectors == buf_track)
+  if (drive == buf_drive && sector >= buf_track
+      && (sector < buf_track
+	  + vtrack_sectors (grub_log2 (buf_geom.sector_size))))
     /* Clear the cache.  */
     buf_track = -1;
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+  disk_cache_invalidate (drive, sector);
+#endif
 
   return 1;
 }
@@ -891,6 +1368,9 @@ real_open_partition (int flags)
 	}
       buf_drive = current_drive;
       buf_track = -1;
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+      disk_cache_probe (current_drive);
+#endif
     }
   part_length = buf_geom.total_sectors;
 
@@ -1647,8 +2127,32 @@ print_completions (int is_filename, int is_completion)
  *  This is the generic file open function.
  */
 
-int
-grub_open (char *filename)
+#ifndef NO_DECOMPRESSION
+/* See if the file just opened is in a compressed format that is read
+   through transparently, and set up to read it so if it is.  */
+static int
+test_compressed_header (void)
+{
+  if (! gunzip_test_header ())
+    return 0;
+
+# if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+  if (! compressed_file)
+    return lz4_test_header ();
+# endif
+
+  return 1;
+}
+#endif /* NO_DECOMPRESSION */
+
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+/* The size of a file being opened through its block list from the boot
+   map.  */
+static int mapped_size;
+#endif
+
+static int
+open_file (char *filename)
 {
 #ifndef NO_DECOMPRESSION
   compressed_file = 0;
@@ -1725,8 +2229,15 @@ grub_open (char *filename)
 	  BLK_CUR_BLKLIST = BLK_BLKLIST_START;
 	  BLK_CUR_BLKNUM = 0;
 
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+	  /* The block list covers whole sectors, but the boot map knows
+	     where the file ends.  */
+	  if (mapped_size)
+	    filemax = mapped_size;
+#endif
+
 #ifndef NO_DECOMPRESSION
-	  return gunzip_test_header ();
+	  return test_compressed_header ();
 #else /* NO_DECOMPRESSION */
 	  return 1;
 #endif /* NO_DECOMPRESSION */
@@ -1747,7 +2258,7 @@ grub_open (char *filename)
   if (!errnum && (*(fsys_table[fsys_type].dir_func)) (filename))
     {
 #ifndef NO_DECOMPRESSION
-      return gunzip_test_header ();
+      return test_compressed_header ();
 #else /* NO_DECOMPRESSION */
       return 1;
 #endif /* NO_DECOMPRESSION */
@@ -1756,9 +2267,72 @@ grub_open (char *filename)
   return 0;
 }
 
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+/* What was read ahead of the file open now, if any of it was.  */
+static struct preload_file *preloaded;
+
+/* Open FILENAME through the block list the boot map has for it, if it
+   has one that is still good.  */
+static int
+open_mapped (char *filename)
+{
+  char *blocklist = bootmap_lookup (filename, &mapped_size);
+  int ret;
+
+  if (! blocklist)
+    return 0;
+
+  ret = open_file (blocklist);
+  mapped_size = 0;
+
+  if (ret && bootmap_verify ())
+    return 1;
+
+  if (ret)
+    grub_close ();
+  errnum = ERR_NONE;
+  return 0;
+}
+#endif
 
 int
-grub_read (char *buf, int len)
+grub_open (char *filename)
+{
+  int ret;
+
+  bootprof_begin (BOOTPROF_OPEN, filename);
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+  /* A file read ahead to the end needs nothing from the disk.  */
+  preloaded = preload_lookup (filename);
+  if (preloaded && preloaded->loaded == preloaded->size)
+    {
+# ifndef NO_DECOMPRESSION
+      compressed_file = 0;
+# endif
+      filepos = 0;
+      filemax = preloaded->size;
+      ret = 1;
+    }
+  else
+    {
+      ret = open_mapped (filename) || open_file (filename);
+
+      /* Otherwise what was read of it is read from memory, and only
+	 the rest from the disk.  */
+      if (! ret || (preloaded && filemax != preloaded->size))
+	preloaded = 0;
+    }
+#else
+  ret = open_file (filename);
+#endif
+  bootprof_end (0);
+
+  return ret;
+}
+
+
+static int
+read_file (char *buf, int len)
 {
   /* Make sure "filepos" is a sane value */
   if ((filepos < 0) || (filepos > filemax))
@@ -1778,6 +2352,10 @@ grub_read (char *buf, int len)
     }
 
 #ifndef NO_DECOMPRESSION
+# if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+  if (compressed_file == COMPRESSED_LZ4)
+    return lz4_read (buf, len);
+# endif
   if (compressed_file)
     return gunzip_read (buf, len);
 #endif /* NO_DECOMPRESSION */
@@ -1853,6 +2431,58 @@ grub_read (char *buf, int len)
   return (*(fsys_table[fsys_type].read_func)) (buf, len);
 }
 
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+static int
+read_preloaded (char *buf, int len)
+{
+  int size = 0, ret;
+
+  if ((filepos < 0) || (filepos > filemax))
+    filepos = filemax;
+
+  if ((len < 0) || (len > (filemax - filepos)))
+    len = filemax - filepos;
+
+  if (filepos < preloaded->loaded)
+    {
+      size = preloaded->loaded - filepos;
+      if (size > len)
+	size = len;
+
+      grub_memmove (buf, preloaded->buf + filepos, size);
+      filepos += size;
+    }
+
+  if (size < len)
+    {
+      ret = read_file (buf + size, len - size);
+      if (errnum)
+	return 0;
+
+      size += ret;
+    }
+
+  return size;
+}
+#endif
+
+int
+grub_read (char *buf, int len)
+{
+  int ret;
+
+  bootprof_begin (BOOTPROF_READ, 0);
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+  if (preloaded)
+    ret = read_preloaded (buf, len);
+  else
+#endif
+    ret = read_file (buf, len);
+  bootprof_end (ret);
+
+  return ret;
+}
+
 #ifndef STAGE1_5
 /* Reposition a file offset.  */
 int
@@ -1894,6 +2524,26 @@ dir (char *dirname)
 void 
 grub_close (void)
 {
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+  if (preloaded)
+    {
+      int whole = preloaded->loaded == preloaded->size;
+
+      preloaded = 0;
+      if (whole)
+	return;
+    }
+#endif
+
+#ifndef NO_DECOMPRESSION
+  if (compressed_file == COMPRESSED_GZIP)
+    gunzip_close ();
+# if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+  else if (compressed_file == COMPRESSED_LZ4)
+    lz4_close ();
+# endif
+#endif /* NO_DECOMPRESSION */
+
 #ifndef NO_BLOCK_FILES
   if (block_file)
     return;
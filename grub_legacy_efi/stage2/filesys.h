@@ -121,6 +121,8 @@ int efi_tftp_mount (void);
 int efi_tftp_read (char *buf, int len);
 int efi_tftp_dir (char *dirname);
 void efi_tftp_close (void);
+void efi_tftp_set_block_size (int size);
+int efi_tftp_get_block_size (void);
 #else
 #define FSYS_EFI_TFTP_NUM 0
 #endif
@@ -24,6 +24,18 @@
 
 static int mapblock1, mapblock2;
 
+/* The extent cursor: the physical block of the leaf at EXT4_LEAF (0 if
+   the leaf is the root in the inode, -1 if none), the logical blocks it
+   covers and the extent in it which was used last.  */
+static int ext4_leaf_block = -1;
+static int ext4_leaf_start, ext4_leaf_end;
+static int ext4_leaf_extent;
+
+/* The physical blocks of the index nodes cached at EXT4_INDEX_NODE.  */
+#define EXT4_INDEX_CACHE_SIZE	4
+static int ext4_index_block[EXT4_INDEX_CACHE_SIZE];
+static int ext4_index_next;
+
 /* sizes are always in bytes, BLOCK values are always in DEV_BSIZE (sectors) */
 #define DEV_BSIZE get_sector_size(current_drive)
 
@@ -309,6 +321,9 @@ struct ext4_extent_header
   };
 
 #define EXT4_EXT_MAGIC      (0xf30a)
+/* An extent longer than this is uninitialized, and reads as zeros.  */
+#define EXT_INIT_MAX_LEN    (1 << 15)
+#define EXT4_MAX_LOGICAL_BLOCK	0x7fffffff
 #define EXT_FIRST_EXTENT(__hdr__) \
     ((struct ext4_extent *) (((char *) (__hdr__)) +     \
                  sizeof(struct ext4_extent_header)))
@@ -355,6 +370,11 @@ struct ext4_extent_header
     ((unsigned long)INODE + sizeof(struct ext2_inode))
 #define DATABLOCK2 \
     ((unsigned long)DATABLOCK1 + EXT2_BLOCK_SIZE(SUPERBLOCK))
+/* the extent tree leaf used last, and the index node cache */
+#define EXT4_LEAF \
+    ((unsigned long)DATABLOCK2 + EXT2_BLOCK_SIZE(SUPERBLOCK))
+#define EXT4_INDEX_NODE(n) \
+    ((unsigned long)EXT4_LEAF + ((n) + 1) * EXT2_BLOCK_SIZE(SUPERBLOCK))
 
 /* linux/ext2_fs.h */
 #define EXT2_ADDR_PER_BLOCK(s)          (EXT2_BLOCK_SIZE(s) / sizeof (__u32))
@@ -418,6 +438,15 @@ ext2fs_mount (void)
 		   (char *) SUPERBLOCK)
       || SUPERBLOCK->s_magic != EXT2_SUPER_MAGIC)
       retval = 0;
+  else
+    {
+      int i;
+
+      /* forget the extent tree nodes of any earlier file system */
+      ext4_leaf_block = -1;
+      for (i = 0; i < EXT4_INDEX_CACHE_SIZE; i++)
+	ext4_index_block[i] = -1;
+    }
 
   return retval;
 }
@@ -582,18 +611,57 @@ ext4_ext_binsearch(struct ext4_extent_header* eh, int logical_block)
   return (struct ext4_extent*)(l - 1);
 }
 
+/* Returns the extent tree index node in the physical block BLOCK, from
+ * the index node cache if it is there, or NULL if it cannot be read.
+ */
+static struct ext4_extent_header*
+ext4_get_index_node (int block)
+{
+  int slots, i;
+  unsigned long node;
+
+  slots = ((long) (FSYS_BUF + FSYS_BUFLEN) - (long) EXT4_INDEX_NODE (0))
+	  >> EXT2_BLOCK_SIZE_BITS (SUPERBLOCK);
+  if (slots > EXT4_INDEX_CACHE_SIZE)
+	slots = EXT4_INDEX_CACHE_SIZE;
+
+  for (i = 0; i < slots; i++)
+	if (ext4_index_block[i] == block)
+	  return (struct ext4_extent_header*)EXT4_INDEX_NODE (i);
+
+  if (slots <= 0)
+	{/* no room left in FSYS_BUF, so do without the cache */
+	  if (!ext2_rdfsb (block, DATABLOCK1))
+	    return NULL;
+	  return (struct ext4_extent_header*)DATABLOCK1;
+	}
+
+  /* replace the slots in turn */
+  i = ext4_index_next;
+  ext4_index_next = (i + 1) % slots;
+  node = EXT4_INDEX_NODE (i);
+  ext4_index_block[i] = -1;
+  if (!ext2_rdfsb (block, node))
+	return NULL;
+  ext4_index_block[i] = block;
+  return (struct ext4_extent_header*)node;
+}
+
 /* Maps extents enabled logical block into physical block via an inode.
  * EXT4_HUGE_FILE_FL should be checked before calling this.
+ * A hole maps to 0.  If RUN is not NULL, the number of blocks from
+ * LOGICAL_BLOCK on which are contiguous on the disk (or which are all
+ * in the hole) is stored there.
+ * The leaf used last and the extent used last in it are remembered, so
+ * that sequential reads are mapped without any I/O.
  */
 static int
-ext4fs_block_map (int logical_block)
+ext4fs_block_map (int logical_block, int *run)
 {
   struct ext4_extent_header *eh;
-  struct ext4_extent *ex, *extent;
-  struct ext4_extent_idx *ei, *index;
-  int depth;
-  int i;
-
+  struct ext4_extent *ex;
+  struct ext4_extent_idx *ei;
+  int len;
 #ifdef E2DEBUG
   unsigned char *i;
   for (i = (unsigned char *) INODE;
@@ -613,49 +681,148 @@ ext4fs_block_map (int logical_block)
     }
   printf ("logical block %d\n", logical_block);
 #endif /* E2DEBUG */
-  eh = (struct ext4_extent_header*)INODE->i_block;
-  if (eh->eh_magic != EXT4_EXT_MAGIC)
-  {
-          errnum = ERR_FSYS_CORRUPT;
-          return -1;
-  }
-  while((depth = eh->eh_depth) != 0)
-  	{ /* extent index */
+  if (ext4_leaf_block >= 0
+      && logical_block >= ext4_leaf_start && logical_block < ext4_leaf_end)
+	/* the leaf used last covers it */
+	eh = (ext4_leaf_block
+	      ? (struct ext4_extent_header*)EXT4_LEAF
+	      : (struct ext4_extent_header*)INODE->i_block);
+  else
+	{
+	  int leaf = 0, start = 0, end = EXT4_MAX_LOGICAL_BLOCK;
+
+	  ext4_leaf_block = -1;
+	  eh = (struct ext4_extent_header*)INODE->i_block;
 	  if (eh->eh_magic != EXT4_EXT_MAGIC)
 	  {
 	          errnum = ERR_FSYS_CORRUPT;
 		  return -1;
 	  }
-	  ei = ext4_ext_binsearch_idx(eh, logical_block);
-	  if (ei->ei_leaf_hi)
-	{/* 64bit physical block number not supported */
-	  errnum = ERR_FILELENGTH;
-	  return -1;
+	  while (eh->eh_depth != 0)
+	    { /* extent index */
+	      ei = ext4_ext_binsearch_idx(eh, logical_block);
+	      if (ei->ei_leaf_hi)
+		{/* 64bit physical block number not supported */
+		  errnum = ERR_FILELENGTH;
+		  return -1;
+		}
+	      /* the logical blocks under EI; the first index also takes
+		 whatever comes before it */
+	      if (ei > EXT_FIRST_INDEX(eh) && (int) ei->ei_block > start)
+		start = ei->ei_block;
+	      if (ei < EXT_LAST_INDEX(eh) && (int) (ei + 1)->ei_block < end)
+		end = (ei + 1)->ei_block;
+
+	      if (eh->eh_depth == 1)
+		{
+		  if (!ext2_rdfsb(ei->ei_leaf_lo, EXT4_LEAF))
+		    eh = NULL;
+		  else
+		    eh = (struct ext4_extent_header*)EXT4_LEAF;
+		}
+	      else
+		eh = ext4_get_index_node (ei->ei_leaf_lo);
+
+	      if (!eh || eh->eh_magic != EXT4_EXT_MAGIC)
+		{
+		  errnum = ERR_FSYS_CORRUPT;
+		  return -1;
+		}
+	      leaf = ei->ei_leaf_lo;
+	    }
+
+	  /* depth==0, we come to the leaf */
+	  ext4_leaf_block = leaf;
+	  ext4_leaf_start = start;
+	  ext4_leaf_end = end;
+	  ext4_leaf_extent = 0;
+	}
+
+  if (eh->eh_entries == 0)
+	{/* an empty file */
+	  if (run)
+	    *run = 1;
+	  return 0;
 	}
-	  if (!ext2_rdfsb(ei->ei_leaf_lo, DATABLOCK1))
+
+  /* sequential reads stay in the extent used last, or go on to the
+     next one; anything else is searched for */
+  ex = EXT_FIRST_EXTENT(eh) + ext4_leaf_extent;
+  if (ex > EXT_LAST_EXTENT(eh) || logical_block < ex->ee_block)
+	ex = ext4_ext_binsearch(eh, logical_block);
+  else if (ex < EXT_LAST_EXTENT(eh) && logical_block >= (ex + 1)->ee_block)
 	{
-	  errnum = ERR_FSYS_CORRUPT;
-	  return -1;
+	  ex++;
+	  if (ex < EXT_LAST_EXTENT(eh) && logical_block >= (ex + 1)->ee_block)
+	    ex = ext4_ext_binsearch(eh, logical_block);
 	}
-	  eh = (struct ext4_extent_header*)DATABLOCK1;
-  	}
+  ext4_leaf_extent = ex - EXT_FIRST_EXTENT(eh);
 
-  /* depth==0, we come to the leaf */
-  ex = ext4_ext_binsearch(eh, logical_block);
   if (ex->ee_start_hi)
 	{/* 64bit physical block number not supported */
 	  errnum = ERR_FILELENGTH;
 	  return -1;
 	}
-  if ((ex->ee_block + ex->ee_len) < logical_block)
-	{
-	  errnum = ERR_FSYS_CORRUPT;
-	  return -1;
+  len = ex->ee_len;
+  if (len > EXT_INIT_MAX_LEN)
+	len -= EXT_INIT_MAX_LEN;
+  if (logical_block < ex->ee_block)
+	{/* a hole before the first extent */
+	  if (run)
+	    *run = ex->ee_block - logical_block;
+	  return 0;
+	}
+  if (logical_block >= ex->ee_block + len)
+	{/* a hole up to the next extent, or to the end of the leaf */
+	  if (run)
+	    *run = (ex < EXT_LAST_EXTENT(eh)
+		    ? (int) (ex + 1)->ee_block : ext4_leaf_end) - logical_block;
+	  return 0;
 	}
+  if (run)
+	*run = ex->ee_block + len - logical_block;
+  if (ex->ee_len > EXT_INIT_MAX_LEN)
+	/* preallocated but never written */
+	return 0;
   return ex->ee_start_lo + logical_block - ex->ee_block;
 
 }
 
+/* Maps LOGICAL_BLOCK like the above, and stores in *RUN the number of
+   blocks, from 1 up to MAX, which follow it contiguously on the disk, or
+   which are all in the same hole if it maps to 0.  */
+static int
+ext2fs_block_run (int logical_block, int max, int *run)
+{
+  int map, next;
+
+  if (EXT4_HAS_INCOMPAT_FEATURE(SUPERBLOCK,EXT4_FEATURE_INCOMPAT_EXTENTS)
+      && INODE->i_flags & EXT4_EXTENTS_FL)
+    {
+      map = ext4fs_block_map (logical_block, run);
+      if (*run > max)
+	*run = max;
+      return map;
+    }
+
+  /* Walk the block pointers, which come from the inode or from the
+     indirect blocks kept in DATABLOCK1 and DATABLOCK2.  */
+  map = ext2fs_block_map (logical_block);
+  for (*run = 1; map >= 0 && *run < max; (*run)++)
+    {
+      next = ext2fs_block_map (logical_block + *run);
+      if (next != (map ? map + *run : 0))
+	{
+	  /* An error is found again when that block is mapped on its own.  */
+	  if (next < 0)
+	    errnum = ERR_NONE;
+	  break;
+	}
+    }
+
+  return map;
+}
+
 /* preconditions: all preconds of ext2fs_block_map */
 int
 ext2fs_read (char *buf, int len)
@@ -663,6 +830,7 @@ ext2fs_read (char *buf, int len)
   int logical_block;
   int offset;
   int map;
+  int run;
   int ret = 0;
   int size = 0;
 
@@ -690,19 +858,19 @@ ext2fs_read (char *buf, int len)
       /* find the (logical) block component of our location */
       logical_block = filepos >> EXT2_BLOCK_SIZE_BITS (SUPERBLOCK);
       offset = filepos & (EXT2_BLOCK_SIZE (SUPERBLOCK) - 1);
-      /* map extents enabled logical block number to physical fs on-disk block number */
-      if (EXT4_HAS_INCOMPAT_FEATURE(SUPERBLOCK,EXT4_FEATURE_INCOMPAT_EXTENTS)
-                    && INODE->i_flags & EXT4_EXTENTS_FL)
-          map = ext4fs_block_map (logical_block);
-      else
-      map = ext2fs_block_map (logical_block);
+      /* map the run of blocks which are contiguous on the disk from there,
+	 so that all of it is read at once */
+      map = ext2fs_block_run (logical_block,
+			      ((offset + len + EXT2_BLOCK_SIZE (SUPERBLOCK) - 1)
+			       >> EXT2_BLOCK_SIZE_BITS (SUPERBLOCK)),
+			      &run);
 #ifdef E2DEBUG
-      printf ("map=%d\n", map);
+      printf ("map=%d run=%d\n", map, run);
 #endif /* E2DEBUG */
       if (map < 0)
 	break;
 
-      size = EXT2_BLOCK_SIZE (SUPERBLOCK);
+      size = run << EXT2_BLOCK_SIZE_BITS (SUPERBLOCK);
       size -= offset;
       if (size > len)
 	size = len;
@@ -787,6 +955,9 @@ ext2fs_dir (char *dirname)
 
   char *rest;
   char ch;			/* temp char holder */
+#ifdef DENTRY_CACHE
+  char *path = dirname;		/* the whole name, for the path cache */
+#endif
 
   int off;			/* offset within block of directory entry (off mod blocksize) */
   int loc;			/* location within a directory */
@@ -803,6 +974,21 @@ ext2fs_dir (char *dirname)
      the directory known pointed to by current_ino (if any)
    */
 
+#ifdef DENTRY_CACHE
+  /* Start from the deepest directory already looked up.  */
+  if (! print_possibilities)
+    switch (dentry_lookup (dirname, &rest, &current_ino, sizeof (int)))
+      {
+      case -1:
+	errnum = ERR_FILE_NOT_FOUND;
+	return 0;
+      case 1:
+	dirname = rest;
+	updir_ino = current_ino;
+	break;
+      }
+#endif
+
   while (1)
     {
 #ifdef E2DEBUG
@@ -844,8 +1030,9 @@ ext2fs_dir (char *dirname)
 	  return 0;
 	}
 
-      /* reset indirect blocks! */
+      /* reset indirect blocks and the extent cursor! */
       mapblock2 = mapblock1 = -1;
+      ext4_leaf_block = -1;
 
       raw_inode = (struct ext2_inode *)((char *)INODE +
 	((current_ino - 1) & (EXT2_INODES_PER_BLOCK (SUPERBLOCK) - 1)) *
@@ -952,6 +1139,13 @@ ext2fs_dir (char *dirname)
 	  continue;
 	}
 
+#ifdef DENTRY_CACHE
+      /* Only a name that has not gone through a symbolic link is a
+	 prefix of PATH.  */
+      if (! link_count && ! print_possibilities)
+	dentry_enter (path, dirname - path, &current_ino, sizeof (int));
+#endif
+
       /* if end of filename, INODE points to the file's inode */
       if (!*dirname || isspace (*dirname))
 	{
@@ -1016,6 +1210,10 @@ ext2fs_dir (char *dirname)
 		{
 		  errnum = ERR_FILE_NOT_FOUND;
 		  *rest = ch;
+#ifdef DENTRY_CACHE
+		  if (! link_count && ! print_possibilities)
+		    dentry_enter (path, rest - path, 0, 0);
+#endif
 		}
 	      return (print_possibilities < 0);
 	    }
@@ -1030,7 +1228,7 @@ ext2fs_dir (char *dirname)
 	  /* map extents enabled logical block number to physical fs on-disk block number */
 	  if (EXT4_HAS_INCOMPAT_FEATURE(SUPERBLOCK,EXT4_FEATURE_INCOMPAT_EXTENTS)
                         && INODE->i_flags & EXT4_EXTENTS_FL)
-              map = ext4fs_block_map (blk);
+              map = ext4fs_block_map (blk, NULL);
 	  else
 	  map = ext2fs_block_map (blk);
 #ifdef E2DEBUG
@@ -44,6 +44,17 @@ struct fat_superblock
   int file_cluster;
   int current_cluster_num;
   int current_cluster;
+
+  int num_runs;
+  int current_run;
+};
+
+/* A run of consecutive clusters in the chain of the open file.  The run
+   ends where the next one begins.  */
+struct fat_run
+{
+  int logical;		/* Cluster number within the file */
+  int cluster;		/* Cluster number on the disk */
 };
 
 /* pointer(s) into filesystem info buffer for DOS stuff */
@@ -51,6 +62,18 @@ struct fat_superblock
  		    ( FSYS_BUF + 32256) )/* 512 bytes long */
 #define FAT_BUF   ( FSYS_BUF + 28160 )	/* 4 sector FAT buffer */
 #define NAME_BUF  ( FSYS_BUF + 27136 )	/* Filename buffer (833 bytes) */
+#define FAT_RUNS  ( (struct fat_run *) FSYS_BUF )	/* Run map (27136 bytes) */
+
+/* Where the path cache finds a file or directory.  */
+struct fat_dentry
+{
+  int cluster;		/* First cluster */
+  int attrib;
+  int size;
+};
+
+/* The number of runs in the map, leaving room for the end marker.  */
+#define FAT_MAX_RUNS (27136 / sizeof (struct fat_run) - 1)
 
 #define FAT_CACHE_SIZE 4096
 
@@ -199,6 +222,110 @@ fat_mount (void)
   return 1;
 }
 
+/* Return the FAT entry of CLUSTER, read through the FAT window at
+   FAT_BUF, or -1 if the FAT cannot be read.  */
+static int
+fat_next_cluster (int cluster)
+{
+  int fat_entry = cluster * FAT_SUPER->fat_size;
+  int next_cluster;
+  int cached_pos = (fat_entry - FAT_SUPER->cached_fat);
+  int sector_size = get_sector_size(current_drive);
+
+  if (cached_pos < 0 || 
+      (cached_pos + FAT_SUPER->fat_size) > 2*FAT_CACHE_SIZE)
+    {
+      FAT_SUPER->cached_fat = (fat_entry & ~(2*sector_size - 1));
+      cached_pos = (fat_entry - FAT_SUPER->cached_fat);
+      if (!devread (FAT_SUPER->fat_offset
+		    + FAT_SUPER->cached_fat / (2*sector_size),
+		    0, FAT_CACHE_SIZE, (char*) FAT_BUF))
+	return -1;
+    }
+  next_cluster = * (unsigned long *) (FAT_BUF + (cached_pos >> 1));
+  if (FAT_SUPER->fat_size == 3)
+    {
+      if (cached_pos & 1)
+	next_cluster >>= 4;
+      next_cluster &= 0xFFF;
+    }
+  else if (FAT_SUPER->fat_size == 4)
+    next_cluster &= 0xFFFF;
+
+  return next_cluster;
+}
+
+/* Walk the whole cluster chain of FAT_SUPER->file_cluster once, and
+   record it in FAT_RUNS as runs of consecutive clusters.  fat_read then
+   reads a run at once and finds any position by a binary search.  If
+   there is no chain, or it has too many runs or cannot be walked, no map
+   is made and fat_read follows the chain as it goes.  */
+static void
+fat_map_runs (void)
+{
+  int cluster = FAT_SUPER->file_cluster;
+  int logical = 0;
+  int n = 0;
+
+  FAT_SUPER->num_runs = -1;
+  if (cluster < 2 || cluster >= FAT_SUPER->num_clust)
+    return;
+
+  FAT_RUNS[0].logical = 0;
+  FAT_RUNS[0].cluster = cluster;
+  while (1)
+    {
+      int next_cluster = fat_next_cluster (cluster);
+
+      if (next_cluster < 0)
+	{
+	  /* Leave the error to fat_read, if it gets that far.  */
+	  errnum = ERR_NONE;
+	  return;
+	}
+
+      logical++;
+      if (next_cluster >= FAT_SUPER->clust_eof_marker)
+	break;
+      if (next_cluster < 2 || next_cluster >= FAT_SUPER->num_clust
+	  || logical >= FAT_SUPER->num_clust)
+	return;
+
+      if (next_cluster != cluster + 1)
+	{
+	  if (++n >= FAT_MAX_RUNS)
+	    return;
+	  FAT_RUNS[n].logical = logical;
+	  FAT_RUNS[n].cluster = next_cluster;
+	}
+      cluster = next_cluster;
+    }
+
+  /* The end marker.  */
+  FAT_RUNS[n + 1].logical = logical;
+  FAT_SUPER->num_runs = n + 1;
+  FAT_SUPER->current_run = 0;
+}
+
+/* Return the run holding LOGICAL_CLUST, which must be in the map.  */
+static struct fat_run *
+fat_find_run (int logical_clust)
+{
+  int low = 0, high = FAT_SUPER->num_runs - 1;
+
+  while (low < high)
+    {
+      int mid = (low + high + 1) >> 1;
+
+      if (FAT_RUNS[mid].logical <= logical_clust)
+	low = mid;
+      else
+	high = mid - 1;
+    }
+
+  return FAT_RUNS + low;
+}
+
 int
 fat_read (char *buf, int len)
 {
@@ -206,7 +333,6 @@ fat_read (char *buf, int len)
   int offset;
   int ret = 0;
   int size;
-  int sector_size = get_sector_size(current_drive);
   
   if (FAT_SUPER->file_cluster < 0)
     {
@@ -220,6 +346,54 @@ fat_read (char *buf, int len)
       return size;
     }
   
+  if (FAT_SUPER->num_runs >= 0)
+    {
+      struct fat_run *run = FAT_RUNS + FAT_SUPER->current_run;
+
+      while (len > 0 && !errnum)
+	{
+	  int sector, num_clust;
+
+	  logical_clust = filepos >> FAT_SUPER->clustsize_bits;
+	  offset = (filepos & ((1 << FAT_SUPER->clustsize_bits) - 1));
+
+	  /* Sequential reads stay in the current run or go on to the
+	     next one, and anything else is searched for.  */
+	  if (logical_clust >= FAT_RUNS[FAT_SUPER->num_runs].logical)
+	    break;
+	  if (logical_clust < run->logical
+	      || logical_clust >= run[1].logical)
+	    {
+	      run = fat_find_run (logical_clust);
+	      FAT_SUPER->current_run = run - FAT_RUNS;
+	    }
+
+	  sector = FAT_SUPER->data_offset +
+	    ((run->cluster + logical_clust - run->logical - 2)
+	     << (FAT_SUPER->clustsize_bits - FAT_SUPER->sectsize_bits));
+
+	  /* Read up to the end of the run, or as much as is wanted.  */
+	  num_clust = run[1].logical - logical_clust;
+	  if (num_clust > (len >> FAT_SUPER->clustsize_bits) + 1)
+	    num_clust = (len >> FAT_SUPER->clustsize_bits) + 1;
+	  size = (num_clust << FAT_SUPER->clustsize_bits) - offset;
+	  if (size > len)
+	    size = len;
+
+	  disk_read_func = disk_read_hook;
+
+	  devread(sector, offset, size, buf);
+
+	  disk_read_func = NULL;
+
+	  len -= size;
+	  buf += size;
+	  ret += size;
+	  filepos += size;
+	}
+      return errnum ? 0 : ret;
+    }
+
   logical_clust = filepos >> FAT_SUPER->clustsize_bits;
   offset = (filepos & ((1 << FAT_SUPER->clustsize_bits) - 1));
   if (logical_clust < FAT_SUPER->current_cluster_num)
@@ -234,31 +408,10 @@ fat_read (char *buf, int len)
       while (logical_clust > FAT_SUPER->current_cluster_num)
 	{
 	  /* calculate next cluster */
-	  int fat_entry = 
-	    FAT_SUPER->current_cluster * FAT_SUPER->fat_size;
-	  int next_cluster;
-	  int cached_pos = (fat_entry - FAT_SUPER->cached_fat);
-	  
-	  if (cached_pos < 0 || 
-	      (cached_pos + FAT_SUPER->fat_size) > 2*FAT_CACHE_SIZE)
-	    {
-	      FAT_SUPER->cached_fat = (fat_entry & ~(2*sector_size - 1));
-	      cached_pos = (fat_entry - FAT_SUPER->cached_fat);
-	      sector = FAT_SUPER->fat_offset
-		+ FAT_SUPER->cached_fat / (2*sector_size);
-	      if (!devread (sector, 0, FAT_CACHE_SIZE, (char*) FAT_BUF))
-		return 0;
-	    }
-	  next_cluster = * (unsigned long *) (FAT_BUF + (cached_pos >> 1));
-	  if (FAT_SUPER->fat_size == 3)
-	    {
-	      if (cached_pos & 1)
-		next_cluster >>= 4;
-	      next_cluster &= 0xFFF;
-	    }
-	  else if (FAT_SUPER->fat_size == 4)
-	    next_cluster &= 0xFFFF;
+	  int next_cluster = fat_next_cluster (FAT_SUPER->current_cluster);
 	  
+	  if (next_cluster < 0)
+	    return 0;
 	  if (next_cluster >= FAT_SUPER->clust_eof_marker)
 	    return ret;
 	  if (next_cluster < 2 || next_cluster >= FAT_SUPER->num_clust)
@@ -313,10 +466,40 @@ fat_dir (char *dirname)
   { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
   int slot = -2;
   int alias_checksum = -1;
+#ifdef DENTRY_CACHE
+  /* The whole name, for the path cache, and where one was found.  */
+  char *path = dirname;
+  struct fat_dentry found;
+#endif
   
   FAT_SUPER->file_cluster = FAT_SUPER->root_cluster;
   filepos = 0;
   FAT_SUPER->current_cluster_num = MAXINT;
+
+#ifdef DENTRY_CACHE
+  if (! print_possibilities)
+    {
+      /* The names are looked up in lower case, so remember them so.  */
+      for (rest = dirname; *rest && !isspace (*rest); rest++)
+	*rest = tolower (*rest);
+
+      /* Start from the deepest directory already looked up.  */
+      switch (dentry_lookup (dirname, &rest, &found, sizeof (found)))
+	{
+	case -1:
+	  errnum = ERR_FILE_NOT_FOUND;
+	  return 0;
+	case 1:
+	  dirname = rest;
+	  attrib = found.attrib;
+	  filemax = found.size;
+	  FAT_SUPER->file_cluster = found.cluster;
+	  break;
+	}
+    }
+#endif
+
+  fat_map_runs ();
   
   /* main loop to find desired directory entry */
  loop:
@@ -377,6 +560,10 @@ fat_dir (char *dirname)
 	      
 	      errnum = ERR_FILE_NOT_FOUND;
 	      *rest = ch;
+#ifdef DENTRY_CACHE
+	      if (! print_possibilities)
+		dentry_enter (path, rest - path, 0, 0);
+#endif
 	    }
 	  
 	  return 0;
@@ -489,6 +676,17 @@ fat_dir (char *dirname)
   filepos = 0;
   FAT_SUPER->file_cluster = FAT_DIRENTRY_FIRST_CLUSTER (dir_buf);
   FAT_SUPER->current_cluster_num = MAXINT;
+  fat_map_runs ();
+
+#ifdef DENTRY_CACHE
+  if (! print_possibilities)
+    {
+      found.cluster = FAT_SUPER->file_cluster;
+      found.attrib = attrib;
+      found.size = filemax;
+      dentry_enter (path, dirname - path, &found, sizeof (found));
+    }
+#endif
   
   /* go back to main loop at top of function */
   goto loop;
@@ -81,12 +81,12 @@ iso9660_devread (int sector, int byte_offset, int byte_len, char *buf)
   if (byte_len <= 0)
     return 1;
 
-  sector += (byte_offset >> sector_size_lg2);
-  byte_offset &= (buf_geom.sector_size - 1);
   asm volatile ("shl%L0 %1,%0"
 		: "=r"(sector)
 		: "Ic"((int8_t)(ISO_SECTOR_BITS - sector_size_lg2)),
 		"0"(sector));
+  sector += (byte_offset >> sector_size_lg2);
+  byte_offset &= (buf_geom.sector_size - 1);
 
 #if !defined(STAGE1_5)
   if (disk_read_hook && debug)
@@ -96,6 +96,87 @@ iso9660_devread (int sector, int byte_offset, int byte_len, char *buf)
   return rawread(current_drive, part_start + sector, byte_offset, byte_len, buf);
 }
 
+#if !defined(STAGE1_5) && (defined(PLATFORM_EFI) || defined(GRUB_UTIL))
+/*
+ *  The volume descriptors and directory sectors, kept across grub_open
+ *  calls.  Every open mounts the volume and walks the path from the
+ *  root again, and the file systems tried before this one clobber
+ *  FSYS_BUF.  A sector is known by its drive, the start of its
+ *  partition and the medium, and the least recently used one goes.
+ */
+#define ISO_DIR_CACHE_SECTORS	16
+
+struct iso_dir_cache_entry
+{
+  unsigned long drive;
+  unsigned long part_start;
+  unsigned long media_id;
+  int sector;
+  /* The value of ISO_DIR_CACHE_CLOCK when last used, or 0 if free.  */
+  unsigned long last_used;
+};
+
+static struct iso_dir_cache_entry iso_dir_cache[ISO_DIR_CACHE_SECTORS];
+static char *iso_dir_cache_data;
+static unsigned long iso_dir_cache_clock;
+
+/* Read the ISO sector SECTOR, a volume descriptor or a directory
+   sector, into BUF.  */
+static int
+iso9660_read_meta (int sector, char *buf)
+{
+  struct iso_dir_cache_entry *entry = 0;
+  unsigned long media_id;
+  char *data;
+  int i;
+
+  if (! iso_dir_cache_data)
+    {
+      iso_dir_cache_data = grub_alloc_pages (ISO_DIR_CACHE_SECTORS
+					     * ISO_SECTOR_SIZE);
+      if (! iso_dir_cache_data)
+	return iso9660_devread (sector, 0, ISO_SECTOR_SIZE, buf);
+    }
+
+  media_id = get_media_id (current_drive);
+  iso_dir_cache_clock++;
+  for (i = 0; i < ISO_DIR_CACHE_SECTORS; i++)
+    {
+      if (iso_dir_cache[i].last_used
+	  && iso_dir_cache[i].sector == sector
+	  && iso_dir_cache[i].drive == current_drive
+	  && iso_dir_cache[i].part_start == part_start
+	  && iso_dir_cache[i].media_id == media_id)
+	{
+	  iso_dir_cache[i].last_used = iso_dir_cache_clock;
+	  memmove (buf, iso_dir_cache_data + i * ISO_SECTOR_SIZE,
+		   ISO_SECTOR_SIZE);
+	  return 1;
+	}
+
+      /* A free entry has LAST_USED zero, so it is taken first.  */
+      if (! entry || iso_dir_cache[i].last_used < entry->last_used)
+	entry = &iso_dir_cache[i];
+    }
+
+  data = iso_dir_cache_data + (entry - iso_dir_cache) * ISO_SECTOR_SIZE;
+  entry->last_used = 0;
+  if (! iso9660_devread (sector, 0, ISO_SECTOR_SIZE, data))
+    return 0;
+
+  entry->drive = current_drive;
+  entry->part_start = part_start;
+  entry->media_id = media_id;
+  entry->sector = sector;
+  entry->last_used = iso_dir_cache_clock;
+  memmove (buf, data, ISO_SECTOR_SIZE);
+  return 1;
+}
+#else
+# define iso9660_read_meta(sector, buf) \
+  iso9660_devread (sector, 0, ISO_SECTOR_SIZE, buf)
+#endif
+
 int
 iso9660_mount (void)
 {
@@ -116,7 +197,7 @@ iso9660_mount (void)
    */
   for (sector = 16 ; sector < 32 ; sector++)
     {
-      if (!iso9660_devread(sector, 0, sizeof(*PRIMDESC), (char *)PRIMDESC)) 
+      if (!iso9660_read_meta(sector, (char *)PRIMDESC))
 	break;
       /* check ISO_VD_PRIMARY and ISO_STANDARD_ID */
       if (PRIMDESC->type.l == ISO_VD_PRIMARY
@@ -164,7 +245,7 @@ iso9660_dir (char *dirname)
 
       while (size > 0)
 	{
-	  if (!iso9660_devread(extent, 0, ISO_SECTOR_SIZE, (char *)DIRREC))
+	  if (!iso9660_read_meta(extent, (char *)DIRREC))
 	    {
 	      errnum = ERR_FSYS_CORRUPT;
 	      return 0;
@@ -333,7 +414,7 @@ iso9660_dir (char *dirname)
 			}
 		      rr_ptr.ptr = RRCONT_BUF + ce_ptr->u.ce.offset.l;
 		      rr_len = ce_ptr->u.ce.size.l;
-		      if (!iso9660_devread(ce_ptr->u.ce.extent.l, 0, ISO_SECTOR_SIZE, RRCONT_BUF))
+		      if (!iso9660_read_meta(ce_ptr->u.ce.extent.l, (char *)RRCONT_BUF))
 			{
 			  errnum = 0;	/* this is not fatal. */
 			  break;
@@ -404,6 +485,14 @@ iso9660_dir (char *dirname)
   return 1;
 }
 
+/* The most read at once, which keeps the byte counts of rawread well
+   within an int.  */
+#define ISO_READ_MAX	(1 << 30)
+
+/*
+ *  A file is a single extent, so the whole span asked for is read at
+ *  once, and a large one goes straight from the disk into BUF.
+ */
 int
 iso9660_read (char *buf, int len)
 {
@@ -413,13 +502,13 @@ iso9660_read (char *buf, int len)
     return 0;
 
   ret = 0;
-  blkoffset = filepos & (ISO_SECTOR_SIZE - 1);
-  sector = filepos >> ISO_SECTOR_BITS;
   while (len > 0)
     {
-      size = ISO_SECTOR_SIZE - blkoffset;
-      if (size > len)
-        size = len;
+      blkoffset = filepos & (ISO_SECTOR_SIZE - 1);
+      sector = filepos >> ISO_SECTOR_BITS;
+      size = len;
+      if (size > ISO_READ_MAX)
+	size = ISO_READ_MAX;
 
       disk_read_func = disk_read_hook;
 
@@ -432,8 +521,6 @@ iso9660_read (char *buf, int len)
       buf += size;
       ret += size;
       filepos += size;
-      sector++;
-      blkoffset = 0;
     }
 
   return ret;
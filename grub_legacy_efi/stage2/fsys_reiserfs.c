@@ -314,9 +314,13 @@ struct fsys_reiser_info
   __u32 journal_block;
   /* The size of the journal */
   __u32 journal_block_count;
-  /* The first valid descriptor block in journal
-     (relative to journal_block) */
-  __u32 journal_first_desc;
+  /* The descriptor block of the first valid transaction that is not
+     in the journal index (relative to journal_block) */
+  __u32 journal_rest_desc;
+  /* The journal index, see below */
+  __u32 *journal_index;
+  /* The number of slots in the journal index, less one */
+  __u32 journal_index_mask;
 
   /* The ReiserFS version. */
   __u16 version;
@@ -332,6 +336,8 @@ struct fsys_reiser_info
   __u16 cached_slots;
   /* The number of valid transactions in journal */
   __u16 journal_transactions;
+  /* The number of them in the journal index */
+  __u16 journal_indexed;
   
   unsigned int blocks[MAX_HEIGHT];
   unsigned int next_key_nr[MAX_HEIGHT];
@@ -354,13 +360,19 @@ struct fsys_reiser_info
 #define INFO \
     ((struct fsys_reiser_info *) ((unsigned long) FSYS_BUF + FSYSREISER_CACHE_SIZE))
 /* 
- * The journal cache.  For each transaction it contains the number of
- * blocks followed by the real block numbers of this transaction.  
+ * The journal index.  It is an open addressing hash table that maps the
+ * real block number of every block in the indexed transactions to the
+ * journal block (relative to journal_block) with its latest copy.  Each
+ * slot is a pair of __u32, and a free slot has the block number
+ * JOURNAL_FREE.  It is never more than three quarters full, so that a
+ * lookup ends after a slot or two.
  *
- * If the block numbers of some transaction won't fit in this space,
- * this list is stopped with a 0xffffffff marker and the remaining
- * uncommitted transactions aren't cached.  
+ * On EFI and in the grub shell it is allocated with room for the whole
+ * journal.  Otherwise it lives in the JOURNAL_START-JOURNAL_END space,
+ * and if the block numbers of some transaction won't fit, that and the
+ * remaining uncommitted transactions aren't indexed.  
  */
+#define JOURNAL_FREE     0xffffffff
 #define JOURNAL_START    ((__u32 *) (INFO + 1))
 #define JOURNAL_END      ((__u32 *) (FSYS_BUF + FSYS_BUFLEN))
 
@@ -387,6 +399,22 @@ journal_read (int block, int len, char *buffer)
 		  0, len, buffer);
 }
 
+/* Return the slot of the journal index that holds BLOCKNR, or the free
+ * slot where it would go.
+ */
+static __u32 *
+journal_slot (__u32 blockNr)
+{
+  __u32 mask = INFO->journal_index_mask;
+  __u32 i = (blockNr * 0x9e3779b1) & mask;
+
+  while (INFO->journal_index[2 * i] != JOURNAL_FREE
+	 && INFO->journal_index[2 * i] != blockNr)
+    i = (i + 1) & mask;
+
+  return &INFO->journal_index[2 * i];
+}
+
 /* Read a block from ReiserFS file system, taking the journal into
  * account.  If the block nr is in the journal, the block from the
  * journal taken.  
@@ -394,54 +422,50 @@ journal_read (int block, int len, char *buffer)
 static int
 block_read (int blockNr, int start, int len, char *buffer)
 {
-  int transactions = INFO->journal_transactions;
-  int desc_block = INFO->journal_first_desc;
+  int transactions = INFO->journal_transactions - INFO->journal_indexed;
+  int desc_block = INFO->journal_rest_desc;
   int journal_mask = INFO->journal_block_count - 1;
   int translatedNr = blockNr;
-  __u32 *journal_table = JOURNAL_START;
+
+  if (INFO->journal_transactions && INFO->journal_indexed)
+    {
+      __u32 *slot = journal_slot (blockNr);
+
+      if (slot[0] == (__u32) blockNr)
+	{
+	  translatedNr = INFO->journal_block + slot[1];
+#ifdef REISERDEBUG
+	  printf ("block_read: block %d is mapped to journal block %d.\n", 
+		  blockNr, slot[1]);
+#endif
+	}
+    }
+
+  /* The transactions that didn't fit in the index are still on disk.  */
   while (transactions-- > 0) 
     {
       int i = 0;
       int j_len;
-      if (*journal_table != 0xffffffff)
-	{
-	  /* Search for the blockNr in cached journal */
-	  j_len = *journal_table++;
-	  while (i++ < j_len)
-	    {
-	      if (*journal_table++ == blockNr)
-		{
-		  journal_table += j_len - i;
-		  goto found;
-		}
-	    }
-	}
-      else
-	{
-	  /* This is the end of cached journal marker.  The remaining
-	   * transactions are still on disk.
-	   */
-	  struct reiserfs_journal_desc   desc;
-	  struct reiserfs_journal_commit commit;
+      struct reiserfs_journal_desc   desc;
+      struct reiserfs_journal_commit commit;
 
-	  if (! journal_read (desc_block, sizeof (desc), (char *) &desc))
-	    return 0;
+      if (! journal_read (desc_block, sizeof (desc), (char *) &desc))
+	return 0;
 
-	  j_len = desc.j_len;
-	  while (i < j_len && i < JOURNAL_TRANS_HALF)
-	    if (desc.j_realblock[i++] == blockNr)
+      j_len = desc.j_len;
+      while (i < j_len && i < JOURNAL_TRANS_HALF)
+	if (desc.j_realblock[i++] == blockNr)
+	  goto found;
+      
+      if (j_len >= JOURNAL_TRANS_HALF)
+	{
+	  int commit_block = (desc_block + 1 + j_len) & journal_mask;
+	  if (! journal_read (commit_block, 
+			      sizeof (commit), (char *) &commit))
+	    return 0;
+	  while (i < j_len)
+	    if (commit.j_realblock[i++ - JOURNAL_TRANS_HALF] == blockNr)
 	      goto found;
-	  
-	  if (j_len >= JOURNAL_TRANS_HALF)
-	    {
-	      int commit_block = (desc_block + 1 + j_len) & journal_mask;
-	      if (! journal_read (commit_block, 
-				  sizeof (commit), (char *) &commit))
-		return 0;
-	      while (i < j_len)
-		if (commit.j_realblock[i++ - JOURNAL_TRANS_HALF] == blockNr)
-		  goto found;
-	    }
 	}
       goto not_found;
       
@@ -460,13 +484,72 @@ block_read (int blockNr, int start, int len, char *buffer)
   return devread (translatedNr << INFO->blocksize_shift, start, len, buffer);
 }
 
-/* Init the journal data structure.  We try to cache as much as
- * possible in the JOURNAL_START-JOURNAL_END space, but if it is full
- * we can still read the rest from the disk on demand.
+#if !defined(STAGE1_5) && (defined(PLATFORM_EFI) || defined(GRUB_UTIL))
+/* The memory of the journal index, kept from one mount to the next.  */
+static __u32 *journal_index_buf;
+static unsigned long journal_index_size;
+#endif
+
+/* Make the journal index empty, and return the number of block numbers
+ * it may hold.
+ */
+static unsigned int
+journal_index_init (void)
+{
+  unsigned long slots;
+
+  /* No block is in more than one journal block, so twice the journal
+   * size in slots keeps the index no more than half full.  */
+  slots = INFO->journal_block_count * 2;
+#if !defined(STAGE1_5) && (defined(PLATFORM_EFI) || defined(GRUB_UTIL))
+  if (slots * 2 * sizeof (__u32) > journal_index_size)
+    {
+      if (journal_index_buf)
+	grub_free_pages (journal_index_buf, journal_index_size);
+      journal_index_size = slots * 2 * sizeof (__u32);
+      journal_index_buf = grub_alloc_pages (journal_index_size);
+      if (! journal_index_buf)
+	journal_index_size = 0;
+    }
+
+  if (journal_index_buf)
+    INFO->journal_index = journal_index_buf;
+  else
+#endif
+    {
+      INFO->journal_index = JOURNAL_START;
+      while (INFO->journal_index + slots * 2 > JOURNAL_END)
+	slots >>= 1;
+    }
+
+  INFO->journal_index_mask = slots - 1;
+  memset (INFO->journal_index, 0xff, slots * 2 * sizeof (__u32));
+  return slots / 4 * 3;
+}
+
+/* Enter BLOCKNR, which is in journal block JOURNAL_NR, in the journal
+ * index.  A later transaction replaces what an earlier one entered.
+ */
+static void
+journal_index_add (__u32 blockNr, __u32 journal_nr)
+{
+  __u32 *slot = journal_slot (blockNr);
+
+  slot[0] = blockNr;
+  slot[1] = journal_nr;
+#ifdef REISERDEBUG
+  printf ("block %d is in journal %d.\n", blockNr, journal_nr);
+#endif
+}
+
+/* Init the journal data structure.  We index every valid transaction
+ * if there is room, but if the index is full we can still read the
+ * rest from the disk on demand.
  *
- * The first number of valid transactions and the descriptor block of the
- * first valid transaction are held in INFO.  The transactions are all 
- * adjacent, but we must take care of the journal wrap around. 
+ * The number of valid transactions, how many of them are indexed and
+ * the descriptor block of the first one that isn't are held in INFO.
+ * The transactions are all adjacent, but we must take care of the
+ * journal wrap around. 
  */
 static int
 journal_init (void)
@@ -475,18 +558,21 @@ journal_init (void)
   unsigned int desc_block;
   unsigned int commit_block;
   unsigned int next_trans_id;
+  unsigned int room;
+  int indexing = 1;
   struct reiserfs_journal_header header;
   struct reiserfs_journal_desc   desc;
   struct reiserfs_journal_commit commit;
-  __u32 *journal_table = JOURNAL_START;
 
+  INFO->journal_indexed = 0;
   journal_read (block_count, sizeof (header), (char *) &header);
   desc_block = header.j_first_unflushed_offset;
   if (desc_block >= block_count)
     return 0;
 
-  INFO->journal_first_desc = desc_block;
+  INFO->journal_rest_desc = desc_block;
   next_trans_id = header.j_last_flush_trans_id + 1;
+  room = journal_index_init ();
 
 #ifdef REISERDEBUG
   printf ("journal_init: last flushed %d\n", 
@@ -515,41 +601,25 @@ journal_init (void)
 #endif
 
       next_trans_id++;
-      if (journal_table < JOURNAL_END)
+      if (indexing && desc.j_len > room)
 	{
-	  if ((journal_table + 1 + desc.j_len) >= JOURNAL_END)
-	    {
-	      /* The table is almost full; mark the end of the cached
-	       * journal.*/
-	      *journal_table = 0xffffffff;
-	      journal_table = JOURNAL_END;
-	    }
-	  else
-	    {
-	      int i;
-	      /* Cache the length and the realblock numbers in the table.
-	       * The block number of descriptor can easily be computed.
-	       * and need not to be stored here.
-	       */
-	      *journal_table++ = desc.j_len;
-	      for (i = 0; i < desc.j_len && i < JOURNAL_TRANS_HALF; i++)
-		{
-		  *journal_table++ = desc.j_realblock[i];
-#ifdef REISERDEBUG
-		  printf ("block %d is in journal %d.\n", 
-			  desc.j_realblock[i], desc_block);
-#endif
-		}
-	      for (     ; i < desc.j_len; i++)
-		{
-		  *journal_table++ = commit.j_realblock[i-JOURNAL_TRANS_HALF];
-#ifdef REISERDEBUG
-		  printf ("block %d is in journal %d.\n", 
-			  commit.j_realblock[i-JOURNAL_TRANS_HALF], 
-			  desc_block);
-#endif
-		}
-	    }
+	  /* The index is full; this and the later transactions are
+	   * searched on disk.  */
+	  INFO->journal_rest_desc = desc_block;
+	  indexing = 0;
+	}
+      if (indexing)
+	{
+	  int i;
+	  /* The data blocks follow the descriptor block.  */
+	  for (i = 0; i < desc.j_len && i < JOURNAL_TRANS_HALF; i++)
+	    journal_index_add (desc.j_realblock[i],
+			       (desc_block + 1 + i) & (block_count - 1));
+	  for (     ; i < desc.j_len; i++)
+	    journal_index_add (commit.j_realblock[i-JOURNAL_TRANS_HALF],
+			       (desc_block + 1 + i) & (block_count - 1));
+	  room -= desc.j_len;
+	  INFO->journal_indexed++;
 	}
       desc_block = (commit_block + 1) & (block_count - 1);
     }
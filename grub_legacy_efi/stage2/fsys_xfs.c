@@ -42,14 +42,19 @@ struct xfs_info {
 	int inopblog;
 	int agblklog;
 	int agnolog;
-	unsigned int nextents;
-	xfs_daddr_t next;
-	xfs_daddr_t daddr;
 	xfs_dablk_t forw;
 	xfs_dablk_t dablk;
-	xfs_bmbt_rec_32_t *xt;
-	xfs_bmbt_ptr_t ptr0;
 	int btnode_ptr0_off;
+	/* The extent cursor of the inode at INODE: the leaf holding the
+	   extent used last (0 for the extents in the inode itself, -1 if
+	   none), the file blocks under it and its number of records, and
+	   that extent, by index (-1 if none) and decoded.  */
+	xfs_daddr_t leaf;
+	xfs_fileoff_t leaf_start;
+	xfs_fileoff_t leaf_end;
+	int leaf_nrecs;
+	int rec;
+	xad_t xad;
 	int i8param;
 	int dirpos;
 	int dirmax;
@@ -219,75 +224,203 @@ di_read (xfs_ino_t ino)
 
 	devread (daddr, offset*xfs.isize, xfs.isize, (char *)inode);
 
-	xfs.ptr0 = *(xfs_bmbt_ptr_t *)
-		    (inode->di_u.di_c + sizeof(xfs_bmdr_block_t)
-		    + btroot_maxrecs ()*sizeof(xfs_bmbt_key_t));
+	xfs.leaf = -1;
+	xfs.rec = -1;
 
 	return 1;
 }
 
-static void
-init_extents (void)
+/*
+ * Returns the key or pointer at byte OFF of the bmap btree node at
+ * DADDR, or of the root in the inode if DADDR is 0.
+ */
+static xfs_uint64_t
+bt_entry (xfs_daddr_t daddr, int off)
+{
+	xfs_uint64_t v;
+
+	if (daddr == 0)
+		v = *(xfs_uint64_t *)(inode->di_u.di_c + off);
+	else if (!devread (daddr, off, sizeof(v), (char *)&v))
+		return 0;
+	return le64 (v);
+}
+
+/*
+ * Points the extent cursor at the leaf whose records cover BLOCK,
+ * going down the bmap btree by its keys.
+ */
+static int
+find_leaf (xfs_fileoff_t block)
 {
-	xfs_bmbt_ptr_t ptr0;
 	xfs_btree_lblock_t h;
+	xfs_daddr_t daddr = 0;
+	xfs_fileoff_t key;
+	int keys, ptrs;
+	int n, i, lo, hi;
+
+	xfs.rec = -1;
+	xfs.leaf_start = 0;
+	xfs.leaf_end = (xfs_fileoff_t)-1;
+
+	if (icore.di_format == XFS_DINODE_FMT_EXTENTS) {
+		xfs.leaf = 0;
+		xfs.leaf_nrecs = le32 (icore.di_nextents);
+		return 1;
+	}
 
-	switch (icore.di_format) {
-	case XFS_DINODE_FMT_EXTENTS:
-		xfs.xt = inode->di_u.di_bmx;
-		xfs.nextents = le32 (icore.di_nextents);
-		break;
-	case XFS_DINODE_FMT_BTREE:
-		ptr0 = xfs.ptr0;
-		for (;;) {
-			xfs.daddr = fsb2daddr (le64(ptr0));
-			devread (xfs.daddr, 0,
-				 sizeof(xfs_btree_lblock_t), (char *)&h);
-			if (!h.bb_level) {
-				xfs.nextents = le16(h.bb_numrecs);
-				xfs.next = fsb2daddr (le64(h.bb_rightsib));
-				xfs.fpos = sizeof(xfs_btree_block_t);
-				return;
-			}
-			devread (xfs.daddr, xfs.btnode_ptr0_off,
-				 sizeof(xfs_bmbt_ptr_t), (char *)&ptr0);
+	xfs.leaf = -1;
+	n = le16 (inode->di_u.di_bmbt.bb_numrecs);
+	keys = sizeof(xfs_bmdr_block_t);
+	ptrs = keys + btroot_maxrecs () * sizeof(xfs_bmbt_key_t);
+	for (;;) {
+		if (n == 0) {
+			errnum = ERR_FSYS_CORRUPT;
+			return 0;
 		}
+		/* the last key at or before BLOCK, or else the first */
+		i = 0;
+		lo = 1;
+		hi = n - 1;
+		while (lo <= hi) {
+			int mid = (lo + hi) / 2;
+
+			if (bt_entry (daddr, keys + mid * sizeof(xfs_bmbt_key_t))
+			    <= block) {
+				i = mid;
+				lo = mid + 1;
+			} else
+				hi = mid - 1;
+		}
+		key = bt_entry (daddr, keys + i * sizeof(xfs_bmbt_key_t));
+		if (key > xfs.leaf_start && key <= block)
+			xfs.leaf_start = key;
+		if (i + 1 < n) {
+			key = bt_entry (daddr,
+					keys + (i + 1) * sizeof(xfs_bmbt_key_t));
+			if (key < xfs.leaf_end)
+				xfs.leaf_end = key;
+		}
+
+		daddr = fsb2daddr (bt_entry (daddr,
+					     ptrs + i * sizeof(xfs_bmbt_ptr_t)));
+		if (errnum || !devread (daddr, 0, sizeof(h), (char *)&h))
+			return 0;
+		n = le16 (h.bb_numrecs);
+		if (!h.bb_level)
+			break;
+		keys = sizeof(xfs_btree_block_t);
+		ptrs = xfs.btnode_ptr0_off;
 	}
+
+	xfs.leaf = daddr;
+	xfs.leaf_nrecs = n;
+	return 1;
 }
 
-static xad_t *
-next_extent (void)
+/*
+ * Decodes record I of the leaf at the cursor into XAD.
+ */
+static int
+read_rec (int i, xad_t *xad)
 {
-	static xad_t xad;
+	xfs_bmbt_rec_32_t *r;
+
+	if (xfs.leaf == 0)
+		r = &inode->di_u.di_bmx[i];
+	else {
+		if (!devread (xfs.leaf,
+			      sizeof(xfs_btree_block_t) + i * sizeof(*r),
+			      sizeof(*r), filebuf))
+			return 0;
+		r = (xfs_bmbt_rec_32_t *)filebuf;
+	}
+	xad->offset = xt_offset (r);
+	xad->start = xt_start (r);
+	xad->len = xt_len (r);
+	return 1;
+}
 
-	switch (icore.di_format) {
-	case XFS_DINODE_FMT_EXTENTS:
-		if (xfs.nextents == 0)
-			return NULL;
-		break;
-	case XFS_DINODE_FMT_BTREE:
-		if (xfs.nextents == 0) {
-			xfs_btree_lblock_t h;
-			if (xfs.next == 0)
-				return NULL;
-			xfs.daddr = xfs.next;
-			devread (xfs.daddr, 0, sizeof(xfs_btree_lblock_t), (char *)&h);
-			xfs.nextents = le16(h.bb_numrecs);
-			xfs.next = fsb2daddr (le64(h.bb_rightsib));
-			xfs.fpos = sizeof(xfs_btree_block_t);
+/*
+ * Returns the index of the last record of the leaf at the cursor which
+ * starts at or before BLOCK, or -1 if there is none, and leaves the
+ * cursor on it.  Sequential reads stay in the extent used last, or go
+ * on to the next one; anything else is searched for.
+ */
+static int
+find_rec (xfs_fileoff_t block)
+{
+	xad_t x, best;
+	int lo, hi, mid, i;
+
+	if (xfs.rec >= 0 && block >= xfs.xad.offset) {
+		if (isinxt (block, xfs.xad.offset, xfs.xad.len)
+		    || xfs.rec + 1 == xfs.leaf_nrecs)
+			return xfs.rec;
+		if (!read_rec (xfs.rec + 1, &x))
+			return -1;
+		if (block < x.offset)
+			return xfs.rec;
+		if (isinxt (block, x.offset, x.len)) {
+			xfs.xad = x;
+			return ++xfs.rec;
 		}
-		/* Yeah, I know that's slow, but I really don't care */
-		devread (xfs.daddr, xfs.fpos, sizeof(xfs_bmbt_rec_t), filebuf);
-		xfs.xt = (xfs_bmbt_rec_32_t *)filebuf;
-		xfs.fpos += sizeof(xfs_bmbt_rec_32_t);
 	}
-	xad.offset = xt_offset (xfs.xt);
-	xad.start = xt_start (xfs.xt);
-	xad.len = xt_len (xfs.xt);
-	++xfs.xt;
-	--xfs.nextents;
 
-	return &xad;
+	i = -1;
+	lo = 0;
+	hi = xfs.leaf_nrecs - 1;
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		if (!read_rec (mid, &x))
+			return -1;
+		if (x.offset <= block) {
+			i = mid;
+			best = x;
+			lo = mid + 1;
+		} else
+			hi = mid - 1;
+	}
+
+	xfs.rec = i;
+	if (i >= 0)
+		xfs.xad = best;
+	return i;
+}
+
+/*
+ * Maps the file block BLOCK of the inode at INODE.  Returns 1 and the
+ * extent holding it in XAD, or 0 and the hole from it up to the next
+ * extent in XAD, or -1 if the map cannot be read.
+ */
+static int
+xfs_map (xfs_fileoff_t block, xad_t *xad)
+{
+	xad_t next;
+	int i;
+
+	if (xfs.leaf == -1
+	    || block < xfs.leaf_start || block >= xfs.leaf_end)
+		if (!find_leaf (block))
+			return -1;
+
+	i = find_rec (block);
+	if (errnum)
+		return -1;
+	if (i >= 0 && isinxt (block, xfs.xad.offset, xfs.xad.len)) {
+		*xad = xfs.xad;
+		return 1;
+	}
+
+	xad->offset = block;
+	xad->start = 0;
+	if (i + 1 < xfs.leaf_nrecs) {
+		if (!read_rec (i + 1, &next))
+			return -1;
+		xad->len = next.offset - block;
+	} else
+		xad->len = xfs.leaf_end - block;
+	return 0;
 }
 
 /*
@@ -296,18 +429,11 @@ next_extent (void)
 static void
 xfs_dabread (void)
 {
-	xad_t *xad;
-	xfs_fileoff_t offset;;
-
-	init_extents ();
-	while ((xad = next_extent ())) {
-		offset = xad->offset;
-		if (isinxt (xfs.dablk, offset, xad->len)) {
-			devread (fsb2daddr (xad->start + xfs.dablk - offset),
-				 0, 100, dirbuf);
-			break;
-		}
-	}
+	xad_t xad;
+
+	if (xfs_map (xfs.dablk, &xad) > 0)
+		devread (fsb2daddr (xad.start + xfs.dablk - xad.offset),
+			 0, 100, dirbuf);
 }
 
 static inline xfs_ino_t
@@ -490,10 +616,10 @@ xfs_mount (void)
 int
 xfs_read (char *buf, int len)
 {
-	xad_t *xad;
-	xfs_fileoff_t endofprev, endofcur, offset;
-	xfs_filblks_t xadlen;
-	int toread, startpos, endpos;
+	xad_t xad;
+	xfs_fileoff_t block;
+	xfs_filblks_t left;
+	int map, toread, startpos;
 
 	if (icore.di_format == XFS_DINODE_FMT_LOCAL) {
 		grub_memmove (buf, inode->di_u.di_c + filepos, len);
@@ -502,36 +628,34 @@ xfs_read (char *buf, int len)
 	}
 
 	startpos = filepos;
-	endpos = filepos + len;
-	endofprev = (xfs_fileoff_t)-1;
-	init_extents ();
-	while (len > 0 && (xad = next_extent ())) {
-		offset = xad->offset;
-		xadlen = xad->len;
-		if (isinxt (filepos >> xfs.blklog, offset, xadlen)) {
-			endofcur = (offset + xadlen) << xfs.blklog; 
-			toread = (endofcur >= endpos)
-				  ? len : (endofcur - filepos);
+	while (len > 0) {
+		block = filepos >> xfs.blklog;
+		map = xfs_map (block, &xad);
+		if (map < 0)
+			break;
+
+		/* up to the end of the extent or of the hole */
+		toread = len;
+		left = xad.offset + xad.len - block;
+		if (left < ((xfs_filblks_t)len >> xfs.blklog) + 2
+		    && toread > (left << xfs.blklog)
+				- (filepos & (xfs.bsize - 1)))
+			toread = (left << xfs.blklog)
+				 - (filepos & (xfs.bsize - 1));
 
+		if (map) {
 			disk_read_func = disk_read_hook;
-			devread (fsb2daddr (xad->start),
-				 filepos - (offset << xfs.blklog), toread, buf);
+			devread (fsb2daddr (xad.start + block - xad.offset),
+				 filepos & (xfs.bsize - 1), toread, buf);
 			disk_read_func = NULL;
+			if (errnum)
+				break;
+		} else
+			grub_memset (buf, 0, toread);
 
-			buf += toread;
-			len -= toread;
-			filepos += toread;
-		} else if (offset > endofprev) {
-			toread = ((offset << xfs.blklog) >= endpos)
-				  ? len : ((offset - endofprev) << xfs.blklog);
-			len -= toread;
-			filepos += toread;
-			for (; toread; toread--) {
-				*buf++ = 0;
-			}
-			continue;
-		}
-		endofprev = offset + xadlen; 
+		buf += toread;
+		len -= toread;
+		filepos += toread;
 	}
 
 	return filepos - startpos;
@@ -142,6 +142,7 @@ static int gzip_filemax;
 static int gzip_fsmax;
 static int saved_filepos;
 static unsigned int gzip_crc;
+static unsigned int crc_value;
 
 /* internal extra variables for use of inflate code */
 static int block_type;
@@ -152,6 +153,9 @@ static int code_state;
 
 /* Function prototypes */
 static void initialize_tables (void);
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+static void free_checkpoints (void);
+#endif
 
 /*
  *  Linear allocator.
@@ -278,6 +282,11 @@ gunzip_test_header (void)
   
   /* "compressed_file" is already reset to zero by this point */
 
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+  /* the seek index of the last compressed file is no use any more */
+  free_checkpoints ();
+#endif
+
   /*
    *  This checks if the file is gzipped.  If a problem occurs here
    *  (other than a real error with the disk) then we don't think it
@@ -328,7 +337,7 @@ gunzip_test_header (void)
 
   initialize_tables ();
 
-  compressed_file = 1;
+  compressed_file = COMPRESSED_GZIP;
   gunzip_swap_values ();
   /*
    *  Now "gzip_*" values refer to the compressed data.
@@ -340,23 +349,26 @@ gunzip_test_header (void)
 }
 
 
-/* Huffman code lookup table entry--this entry is four bytes for machines
-   that have 16-bit pointers (e.g. PC's in the small or medium model).
-   Valid extra bits are 0..13.  e == 15 is EOB (end of block), e == 16
-   means that v is a literal, 16 < e < 32 means that v is a pointer to
-   the next table, which codes e - 16 bits, and lastly e == 99 indicates
-   an unused code.  If a code with e == 99 is looked up, this implies an
-   error in the data. */
-struct huft
+/* Huffman code lookup table entry.  The tables are laid out the way
+   zlib's inflate lays them out: every entry is four bytes, and any code
+   no longer than the root table's index bits is decoded in one probe,
+   with its length or distance base and the number of extra bits to add
+   in the same entry.  Longer codes go through one more probe in a
+   sub-table.  op says what the entry is:
+
+	00000000	a literal, val is the byte
+	0000tttt	a link to a sub-table of tttt index bits at offset val
+	0001eeee	a length or distance base val with eeee extra bits
+	01100000	end of block
+	01000000	an invalid code
+
+   bits is the number of bits of the code this entry takes up (in a
+   sub-table, the number of bits past the root table).  */
+struct code
 {
-  uch e;			/* number of extra bits or operation */
-  uch b;			/* number of bits in this code or subcode */
-  union
-    {
-      ush n;			/* literal, length base, or distance base */
-      struct huft *t;		/* pointer to next level of table */
-    }
-  v;
+  uch op;			/* operation, extra bits or table bits */
+  uch bits;			/* bits in this part of the code */
+  ush val;			/* literal, base value or sub-table offset */
 };
 
 
@@ -373,7 +385,16 @@ struct huft
 /* sliding window in uncompressed data */
 static uch slide[WSIZE];
 
-/* current position in slide */
+/* Where inflate_window puts the window it decodes, and where the window
+   before it is.  Both are normally SLIDE; for a large sequential read,
+   gunzip_read points WINDOW at the caller's buffer instead, and the
+   window before it is then the previous one in that buffer (or, for the
+   first, SLIDE).  Windows always start on a multiple of WSIZE in the
+   uncompressed data, so the same index is used for a byte in either.  */
+static uch *window = slide;
+static uch *history = slide;
+
+/* current position in window */
 static unsigned wp;
 
 
@@ -382,28 +403,28 @@ static unsigned bitorder[] =
 {				/* Order of the bit length code lengths */
   16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
 static ush cplens[] =
-{				/* Copy lengths for literal codes 257..285 */
+{				/* Copy lengths for literal codes 257..287 */
   3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
   35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258, 0, 0};
 	/* note: see note #13 above about the 258 in this list. */
 static ush cplext[] =
-{				/* Extra bits for literal codes 257..285 */
-  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
-  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0, 99, 99};	/* 99==invalid */
+{				/* Extra bits for literal codes 257..287, as op */
+  16, 16, 16, 16, 16, 16, 16, 16, 17, 17, 17, 17, 18, 18, 18, 18,
+  19, 19, 19, 19, 20, 20, 20, 20, 21, 21, 21, 21, 16, 64, 64};	/* 64==invalid */
 static ush cpdist[] =
-{				/* Copy offsets for distance codes 0..29 */
+{				/* Copy offsets for distance codes 0..31 */
   1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
   257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
-  8193, 12289, 16385, 24577};
+  8193, 12289, 16385, 24577, 0, 0};
 static ush cpdext[] =
-{				/* Extra bits for distance codes */
-  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
-  7, 7, 8, 8, 9, 9, 10, 10, 11, 11,
-  12, 12, 13, 13};
+{				/* Extra bits for distance codes 0..31, as op */
+  16, 16, 16, 16, 17, 17, 18, 18, 19, 19, 20, 20, 21, 21, 22, 22,
+  23, 23, 24, 24, 25, 25, 26, 26, 27, 27,
+  28, 28, 29, 29, 64, 64};
 
 
 /*
-   Huffman code decoding is performed using a multi-level table lookup.
+   Huffman code decoding is performed using a two-level table lookup.
    The fastest way to decode is to simply build a lookup table whose
    size is determined by the longest code.  However, the time it takes
    to build this table can also be a factor if the data being decoded
@@ -415,14 +436,14 @@ static ush cpdext[] =
    then traded against the time it takes to make longer tables.
 
    This results of this trade are in the variables lbits and dbits
-   below.  lbits is the number of bits the first level table for literal/
+   below.  lbits is the number of bits the root table for literal/
    length codes can decode in one step, and dbits is the same thing for
-   the distance codes.  Subsequent tables are also less than or equal to
-   those sizes.  These values may be adjusted either when all of the
-   codes are shorter than that, in which case the longest code length in
-   bits is used, or when the shortest code is *longer* than the requested
-   table size, in which case the length of the shortest code in bits is
-   used.
+   the distance codes.  Each sub-table holds the rest of the codes that
+   share a root entry.  These values may be adjusted when all of the
+   codes are shorter than that, in which case the longest code length
+   in bits is used, or when the shortest code is *longer* than the
+   requested table size, in which case the length of the shortest code
+   in bits is used.
 
    There are two different values for the two tables, since they code a
    different number of possibilities each.  The literal/length table
@@ -439,12 +460,23 @@ static int lbits = 9;		/* bits in base literal/length lookup table */
 static int dbits = 6;		/* bits in base distance lookup table */
 
 
-/* If BMAX needs to be larger than 16, then h and x[] should be ulg. */
-#define BMAX 16			/* maximum bit length of any code (16 for explode) */
-#define N_MAX 288		/* maximum number of codes in any set */
+#define MAXBITS 15		/* maximum bit length of any code */
 
+/* The most table entries a literal/length code (with a 9 bit root
+   table) and a distance code (with a 6 bit root table) can need, as
+   worked out by zlib's enough.c.  Change these along with lbits and
+   dbits.  */
+#define ENOUGH_LENS 852
+#define ENOUGH_DISTS 592
+#define ENOUGH (ENOUGH_LENS + ENOUGH_DISTS)
 
-static unsigned hufts;		/* track memory usage */
+/* table types for inflate_table */
+#define TABLE_CODES 0
+#define TABLE_LENS  1
+#define TABLE_DISTS 2
+
+/* space for the decoding tables of the current block */
+static struct code *codes;
 
 
 /* Macros for inflate() bit peeking and grabbing.
@@ -471,10 +503,8 @@ static unsigned hufts;		/* track memory usage */
    (The EOB code is shorter than other codes because fixed blocks are
    generally short.  So, while a block always has an EOB, many other
    literal/length codes have a significantly lower probability of
-   showing up at all.)  However, by making the first table have a
-   lookup of seven bits, the EOB code will be found in that first
-   lookup, and so will not require that too many bits be pulled from
-   the stream.
+   showing up at all.)  Since the gzip trailer follows the compressed
+   data, pulling a byte too many at the very end does no harm.
  */
 
 static ulg bb;			/* bit buffer */
@@ -490,16 +520,41 @@ static ush mask_bits[] =
 #define NEEDBITS(n) do {while(k<(n)){b|=((ulg)get_byte())<<k;k+=8;}} while (0)
 #define DUMPBITS(n) do {b>>=(n);k-=(n);} while (0)
 
+/* The fast loop in inflate_fast keeps its bits in a whole machine word
+   and fills it up a word at a time straight from inbuf.  A refill ORs
+   in as many whole bytes as fit above the K bits already there; the
+   low bits of the byte that only partly fits are ORed in too, and the
+   next refill puts the same bits in the same place again, so the bits
+   above K are always either zero or the right stream bits.  After a
+   refill there are at least BITBUF_BITS - 8 bits in the buffer.  */
+typedef unsigned long bitbuf_t;
+typedef bitbuf_t __attribute__ ((__may_alias__, __aligned__ (1))) bitbuf_word_t;
+typedef unsigned long long __attribute__ ((__may_alias__, __aligned__ (1))) copy_word_t;
+
+#define BITBUF_BITS (sizeof (bitbuf_t) * 8)
+
+#define FASTREFILL() \
+  do { unsigned _n = (BITBUF_BITS - 1 - k) >> 3; \
+       b |= *(const bitbuf_word_t *) in << k; \
+       in += _n; k += _n << 3; } while (0)
+
+/* inflate_fast only runs while there is room for the longest match in
+   the window and for a symbol's worth of refills in inbuf.  */
+#define FAST_WINDOW_SLOP 258
+#define FAST_INPUT_SLOP 32
+
 #define INBUFSIZ  0x2000
 
 static uch inbuf[INBUFSIZ];
 static int bufloc;
+static int inbuf_pos;		/* compressed offset of inbuf[0] */
 
 static int
 get_byte (void)
 {
   if (filepos == gzip_data_offset || bufloc == INBUFSIZ)
     {
+      inbuf_pos = filepos;
       bufloc = 0;
       grub_read (inbuf, INBUFSIZ);
     }
@@ -508,207 +563,386 @@ get_byte (void)
 }
 
 /* decompression global pointers */
-static struct huft *tl;		/* literal/length code table */
-static struct huft *td;		/* distance code table */
-static int bl;			/* lookup bits for tl */
-static int bd;			/* lookup bits for td */
+static struct code *tl;		/* literal/length code table */
+static struct code *td;		/* distance code table */
+static unsigned bl;		/* lookup bits for tl */
+static unsigned bd;		/* lookup bits for td */
 
 
 /* more function prototypes */
-static int huft_build (unsigned *, unsigned, unsigned, ush *, ush *,
-		       struct huft **, int *);
+static int inflate_table (int, ush *, unsigned, struct code **,
+			  unsigned *, ush *);
 static int inflate_codes_in_window (void);
 
 
-/* Given a list of code lengths and a maximum table size, make a set of
-   tables to decode that set of codes.  Return zero on success, one if
-   the given code set is incomplete (the tables are still built in this
-   case), two if the input is invalid (all zero length codes or an
-   oversubscribed set of lengths), and three if not enough memory. */
+/* Build a decoding table for the code whose lengths are in LENS, for
+   CODES symbols, starting at *TABLE.  TYPE says which of the base and
+   extra bits lists to use.  *BITS is the requested number of root table
+   bits on entry and the actual number on return, and *TABLE is moved
+   past the space used.  WORK is scratch space for CODES symbols.
+   Return zero on success and non-zero for an over-subscribed or an
+   incomplete set of lengths; a single code of one bit and no codes at
+   all are allowed, and the latter decodes as an invalid code.  This is
+   inflate_table from zlib's inftrees.c.  */
 
 static int
-huft_build (unsigned *b,	/* code lengths in bits (all assumed <= BMAX) */
-	    unsigned n,		/* number of codes (assumed <= N_MAX) */
-	    unsigned s,		/* number of simple-valued codes (0..s-1) */
-	    ush * d,		/* list of base values for non-simple codes */
-	    ush * e,		/* list of extra bits for non-simple codes */
-	    struct huft **t,	/* result: starting table */
-	    int *m)		/* maximum lookup bits, returns actual */
+inflate_table (int type, ush * lens, unsigned ncodes, struct code **table,
+	       unsigned *bits, ush * work)
 {
-  unsigned a;			/* counter for codes of length k */
-  unsigned c[BMAX + 1];		/* bit length count table */
-  unsigned f;			/* i repeats in table every f entries */
-  int g;			/* maximum code length */
-  int h;			/* table level */
-  register unsigned i;		/* counter, current code */
-  register unsigned j;		/* counter */
-  register int k;		/* number of bits in current code */
-  int l;			/* bits per table (returned in m) */
-  register unsigned *p;		/* pointer into c[], b[], or v[] */
-  register struct huft *q;	/* points to current table */
-  struct huft r;		/* table entry for structure assignment */
-  struct huft *u[BMAX];		/* table stack */
-  unsigned v[N_MAX];		/* values in order of bit length */
-  register int w;		/* bits before this table == (l * h) */
-  unsigned x[BMAX + 1];		/* bit offsets, then code stack */
-  unsigned *xp;			/* pointer into x */
-  int y;			/* number of dummy codes added */
-  unsigned z;			/* number of entries in current table */
-
-  /* Generate counts for each bit length */
-  memset ((char *) c, 0, sizeof (c));
-  p = b;
-  i = n;
-  do
+  unsigned len;			/* a code's length in bits */
+  unsigned sym;			/* index of code symbols */
+  unsigned min, max;		/* minimum and maximum code lengths */
+  unsigned root;		/* number of index bits for root table */
+  unsigned curr;		/* number of index bits for current table */
+  unsigned drop;		/* code bits to drop for sub-table */
+  int left;			/* number of prefix codes available */
+  unsigned used;		/* code entries in table used */
+  unsigned huff;		/* Huffman code */
+  unsigned incr;		/* for incrementing code, index */
+  unsigned fill;		/* index for replicating entries */
+  unsigned low;			/* low bits for current root entry */
+  unsigned mask;		/* mask for low root bits */
+  struct code here;		/* table entry for duplication */
+  struct code *next;		/* next available space in table */
+  ush *base;			/* base value table to use */
+  ush *extra;			/* extra bits table to use */
+  unsigned match;		/* use base and extra for symbol >= match */
+  ush count[MAXBITS + 1];	/* number of codes of each length */
+  ush offs[MAXBITS + 1];	/* offsets in table for each length */
+
+  /* accumulate lengths for codes (assumes lens[] all in 0..MAXBITS) */
+  for (len = 0; len <= MAXBITS; len++)
+    count[len] = 0;
+  for (sym = 0; sym < ncodes; sym++)
+    count[lens[sym]]++;
+
+  /* bound code lengths, force root to be within code lengths */
+  root = *bits;
+  for (max = MAXBITS; max >= 1; max--)
+    if (count[max] != 0)
+      break;
+  if (root > max)
+    root = max;
+  if (max == 0)
     {
-      c[*p]++;			/* assume all entries <= BMAX */
-      p++;			/* Can't combine with above line (Solaris bug) */
+      /* no symbols to code at all: make a table that only holds an
+	 invalid code, so that decoding reports the error */
+      here.op = 64;
+      here.bits = 1;
+      here.val = 0;
+      *(*table)++ = here;
+      *(*table)++ = here;
+      *bits = 1;
+      return 0;
     }
-  while (--i);
-  if (c[0] == n)		/* null input--all zero length codes */
+  for (min = 1; min < max; min++)
+    if (count[min] != 0)
+      break;
+  if (root < min)
+    root = min;
+
+  /* check for an over-subscribed or incomplete set of lengths */
+  left = 1;
+  for (len = 1; len <= MAXBITS; len++)
     {
-      *t = (struct huft *) NULL;
-      *m = 0;
-      return 0;
+      left <<= 1;
+      left -= count[len];
+      if (left < 0)
+	return 1;		/* over-subscribed */
     }
+  if (left > 0 && (type == TABLE_CODES || max != 1))
+    return 1;			/* incomplete set */
+
+  /* generate offsets into symbol table for each length for sorting */
+  offs[1] = 0;
+  for (len = 1; len < MAXBITS; len++)
+    offs[len + 1] = offs[len] + count[len];
 
-  /* Find minimum and maximum length, bound *m by those */
-  l = *m;
-  for (j = 1; j <= BMAX; j++)
-    if (c[j])
+  /* sort symbols by length, by symbol order within each length */
+  for (sym = 0; sym < ncodes; sym++)
+    if (lens[sym] != 0)
+      work[offs[lens[sym]]++] = (ush) sym;
+
+  /* set up for code type */
+  switch (type)
+    {
+    case TABLE_CODES:
+      base = extra = work;	/* dummy value--not used */
+      match = 20;
       break;
-  k = j;			/* minimum code length */
-  if ((unsigned) l < j)
-    l = j;
-  for (i = BMAX; i; i--)
-    if (c[i])
+    case TABLE_LENS:
+      base = cplens;
+      extra = cplext;
+      match = 257;
       break;
-  g = i;			/* maximum code length */
-  if ((unsigned) l > i)
-    l = i;
-  *m = l;
-
-  /* Adjust last length count to fill out codes, if needed */
-  for (y = 1 << j; j < i; j++, y <<= 1)
-    if ((y -= c[j]) < 0)
-      return 2;			/* bad input: more codes than bits */
-  if ((y -= c[i]) < 0)
-    return 2;
-  c[i] += y;
-
-  /* Generate starting offsets into the value table for each length */
-  x[1] = j = 0;
-  p = c + 1;
-  xp = x + 2;
-  while (--i)
-    {				/* note that i == g from above */
-      *xp++ = (j += *p++);
+    default:			/* TABLE_DISTS */
+      base = cpdist;
+      extra = cpdext;
+      match = 0;
     }
 
-  /* Make a table of values in order of bit lengths */
-  p = b;
-  i = 0;
-  do
+  /* initialize state for loop */
+  huff = 0;			/* starting code */
+  sym = 0;			/* starting code symbol */
+  len = min;			/* starting code length */
+  next = *table;		/* current table to fill in */
+  curr = root;			/* current table index bits */
+  drop = 0;			/* current bits to drop from code for index */
+  low = (unsigned) (-1);	/* trigger new sub-table when len > root */
+  used = 1U << root;		/* use root table entries */
+  mask = used - 1;		/* mask for comparing low */
+
+  /* check available table space */
+  if ((type == TABLE_LENS && used > ENOUGH_LENS)
+      || (type == TABLE_DISTS && used > ENOUGH_DISTS))
+    return 1;
+
+  /* process all codes and make table entries */
+  for (;;)
     {
-      if ((j = *p++) != 0)
-	v[x[j]++] = i;
+      /* create table entry */
+      here.bits = (uch) (len - drop);
+      if (work[sym] + 1U < match)
+	{
+	  here.op = 0;
+	  here.val = work[sym];
+	}
+      else if (work[sym] >= match)
+	{
+	  here.op = (uch) extra[work[sym] - match];
+	  here.val = base[work[sym] - match];
+	}
+      else
+	{
+	  here.op = 32 + 64;	/* end of block */
+	  here.val = 0;
+	}
+
+      /* replicate for those indices with low len bits equal to huff */
+      incr = 1U << (len - drop);
+      fill = 1U << curr;
+      min = fill;		/* save offset to next table */
+      do
+	{
+	  fill -= incr;
+	  next[(huff >> drop) + fill] = here;
+	}
+      while (fill != 0);
+
+      /* backwards increment the len-bit code huff */
+      incr = 1U << (len - 1);
+      while (huff & incr)
+	incr >>= 1;
+      if (incr != 0)
+	{
+	  huff &= incr - 1;
+	  huff += incr;
+	}
+      else
+	huff = 0;
+
+      /* go to next symbol, update count, len */
+      sym++;
+      if (--(count[len]) == 0)
+	{
+	  if (len == max)
+	    break;
+	  len = lens[work[sym]];
+	}
+
+      /* create new sub-table if needed */
+      if (len > root && (huff & mask) != low)
+	{
+	  /* if first time, transition to sub-tables */
+	  if (drop == 0)
+	    drop = root;
+
+	  /* increment past last table */
+	  next += min;		/* here min is 1 << curr */
+
+	  /* determine length of next table */
+	  curr = len - drop;
+	  left = (int) (1 << curr);
+	  while (curr + drop < max)
+	    {
+	      left -= count[curr + drop];
+	      if (left <= 0)
+		break;
+	      curr++;
+	      left <<= 1;
+	    }
+
+	  /* check for enough space */
+	  used += 1U << curr;
+	  if ((type == TABLE_LENS && used > ENOUGH_LENS)
+	      || (type == TABLE_DISTS && used > ENOUGH_DISTS))
+	    return 1;
+
+	  /* point entry in root table to sub-table */
+	  low = huff & mask;
+	  (*table)[low].op = (uch) curr;
+	  (*table)[low].bits = (uch) root;
+	  (*table)[low].val = (ush) (next - *table);
+	}
     }
-  while (++i < n);
-
-  /* Generate the Huffman codes and for each, make the table entries */
-  x[0] = i = 0;			/* first Huffman code is zero */
-  p = v;			/* grab values in bit order */
-  h = -1;			/* no tables yet--level -1 */
-  w = -l;			/* bits decoded == (l * h) */
-  u[0] = (struct huft *) NULL;	/* just to keep compilers happy */
-  q = (struct huft *) NULL;	/* ditto */
-  z = 0;			/* ditto */
-
-  /* go through the bit lengths (k already is bits in shortest code) */
-  for (; k <= g; k++)
+
+  /* fill in the remaining table entry if the code is incomplete (there
+     is at most one, since only a single one-bit code gets this far) */
+  if (huff != 0)
     {
-      a = c[k];
-      while (a--)
+      here.op = 64;		/* invalid code marker */
+      here.bits = (uch) (len - drop);
+      here.val = 0;
+      next[huff] = here;
+    }
+
+  /* set return parameters */
+  *table += used;
+  *bits = root;
+  return 0;
+}
+
+
+/*
+ *  Decode literals and matches of the current block straight into the
+ *  window, for as long as there is room in it for the longest match and
+ *  enough input is buffered in inbuf.  None of the checks of the careful
+ *  loop in inflate_codes_in_window are needed under those conditions.
+ *  Return 1 at the end of the block, -1 for bad data, and 0 when the
+ *  careful loop has to take over.
+ */
+
+static int
+inflate_fast (void)
+{
+  const uch *in;		/* next input byte */
+  const uch *in_end;		/* stop before this input byte */
+  uch *out;			/* next output byte */
+  uch *out_end;			/* stop at this output byte */
+  const uch *from;		/* where to copy a match from */
+  struct code here;		/* current table entry */
+  unsigned op;			/* operation or extra bits of an entry */
+  unsigned len;			/* length of a match */
+  unsigned dist;		/* distance back of a match */
+  unsigned lm, dm;		/* masks for bl and bd bits */
+  register bitbuf_t b;		/* bit buffer */
+  register unsigned k;		/* number of bits in bit buffer */
+  int ret = 0;
+
+  in = inbuf + bufloc;
+  in_end = inbuf + INBUFSIZ - FAST_INPUT_SLOP;
+  out = window + wp;
+  out_end = window + WSIZE - FAST_WINDOW_SLOP;
+  b = bb;
+  k = bk;
+  lm = mask_bits[bl];
+  dm = mask_bits[bd];
+
+  while (in < in_end && out < out_end)
+    {
+      /* enough for a literal/length code and its extra bits */
+      FASTREFILL ();
+      here = tl[(unsigned) b & lm];
+
+    dolen:
+      DUMPBITS (here.bits);
+      op = here.op;
+      if (op == 0)
 	{
-	  /* here i is the Huffman code of length k bits for value *p */
-	  /* make tables up to required level */
-	  while (k > w + l)
-	    {
-	      h++;
-	      w += l;		/* previous table always l bits */
-
-	      /* compute minimum size table less than or equal to l bits */
-	      z = (z = g - w) > (unsigned) l ? l : z;	/* upper limit on table size */
-	      if ((f = 1 << (j = k - w)) > a + 1)	/* try a k-w bit table */
-		{		/* too few codes for k-w bit table */
-		  f -= a + 1;	/* deduct codes from patterns left */
-		  xp = c + k;
-		  while (++j < z)	/* try smaller tables up to z bits */
-		    {
-		      if ((f <<= 1) <= *++xp)
-			break;	/* enough codes to use up j bits */
-		      f -= *xp;	/* else deduct codes from patterns */
-		    }
-		}
-	      z = 1 << j;	/* table entries for j-bit table */
+	  *out++ = (uch) here.val;
+	  continue;
+	}
 
-	      /* allocate and link in new table */
-	      q = (struct huft *) linalloc ((z + 1) * sizeof (struct huft));
+      if (op & 16)
+	{
+	  len = here.val;
+	  op &= 15;
+	  if (op)
+	    {
+	      len += (unsigned) b & mask_bits[op];
+	      DUMPBITS (op);
+	    }
 
-	      hufts += z + 1;	/* track memory usage */
-	      *t = q + 1;	/* link to list for huft_free() */
-	      *(t = &(q->v.t)) = (struct huft *) NULL;
-	      u[h] = ++q;	/* table starts after link */
+	  if (k < MAXBITS)
+	    FASTREFILL ();
+	  here = td[(unsigned) b & dm];
 
-	      /* connect to last table, if there is one */
-	      if (h)
+	dodist:
+	  DUMPBITS (here.bits);
+	  op = here.op;
+	  if (! (op & 16))
+	    {
+	      if (op & 64)
 		{
-		  x[h] = i;	/* save pattern for backing up */
-		  r.b = (uch) l;	/* bits to dump before this table */
-		  r.e = (uch) (16 + j);		/* bits in this table */
-		  r.v.t = q;	/* pointer to this table */
-		  j = i >> (w - l);	/* (get around Turbo C bug) */
-		  u[h - 1][j] = r;	/* connect to last table */
+		  ret = -1;
+		  break;
 		}
+
+	      here = td[here.val + ((unsigned) b & mask_bits[op])];
+	      goto dodist;
 	    }
 
-	  /* set up table entry in r */
-	  r.b = (uch) (k - w);
-	  if (p >= v + n)
-	    r.e = 99;		/* out of values--invalid code */
-	  else if (*p < s)
+	  dist = here.val;
+	  op &= 15;
+	  if (k < op)
+	    FASTREFILL ();
+	  dist += (unsigned) b & mask_bits[op];
+	  DUMPBITS (op);
+
+	  if (dist > (unsigned) (out - window))
 	    {
-	      r.e = (uch) (*p < 256 ? 16 : 15);		/* 256 is end-of-block code */
-	      r.v.n = (ush) (*p);	/* simple code is just the value */
-	      p++;		/* one compiler does not like *p++ */
+	      /* the match starts in the window before this one, and may
+		 run on into the start of this one */
+	      unsigned d = ((unsigned) (out - window) - dist) & (WSIZE - 1);
+
+	      do
+		*out++ = history[d++];
+	      while (--len && d < WSIZE);
+
+	      for (from = window; len; len--)
+		*out++ = *from++;
 	    }
 	  else
 	    {
-	      r.e = (uch) e[*p - s];	/* non-simple--look up in lists */
-	      r.v.n = d[*p++ - s];
-	    }
-
-	  /* fill code-like entries with r */
-	  f = 1 << (k - w);
-	  for (j = i >> w; j < z; j += f)
-	    q[j] = r;
-
-	  /* backwards increment the k-bit code i */
-	  for (j = 1 << (k - 1); i & j; j >>= 1)
-	    i ^= j;
-	  i ^= j;
+	      from = out - dist;
+	      if (dist >= sizeof (copy_word_t))
+		for (; len >= sizeof (copy_word_t);
+		     len -= sizeof (copy_word_t))
+		  {
+		    *(copy_word_t *) out = *(const copy_word_t *) from;
+		    out += sizeof (copy_word_t);
+		    from += sizeof (copy_word_t);
+		  }
 
-	  /* backup over finished tables */
-	  while ((i & ((1 << w) - 1)) != x[h])
-	    {
-	      h--;		/* don't need to update q */
-	      w -= l;
+	      /* purposefully use the overlap for extra copies here!! */
+	      while (len--)
+		*out++ = *from++;
 	    }
+	  continue;
+	}
+
+      if (! (op & 64))
+	{
+	  here = tl[here.val + ((unsigned) b & mask_bits[op])];
+	  goto dolen;
 	}
+
+      /* end of block, or an invalid code */
+      ret = (op & 32) ? 1 : -1;
+      break;
     }
 
-  /* Return true (1) if we were given an incomplete table */
-  return y != 0 && g != 1;
+  /* give back the whole bytes still in the bit buffer */
+  in -= k >> 3;
+  k &= 7;
+  b &= mask_bits[k];
+
+  bufloc = in - inbuf;
+  wp = out - window;
+  bb = b;
+  bk = k;
+
+  return ret;
 }
 
 
@@ -725,7 +959,7 @@ inflate_codes_in_window (void)
   register unsigned e;		/* table entry flag/number of extra bits */
   unsigned n, d;		/* length and index for copy */
   unsigned w;			/* current window position */
-  struct huft *t;		/* pointer to table entry */
+  struct code here;		/* current table entry */
   unsigned ml, md;		/* masks for bl and bd bits */
   register ulg b;		/* bit buffer */
   register unsigned k;		/* number of bits in bit buffer */
@@ -744,25 +978,51 @@ inflate_codes_in_window (void)
     {
       if (!code_state)
 	{
-	  NEEDBITS ((unsigned) bl);
-	  if ((e = (t = tl + ((unsigned) b & ml))->e) > 16)
-	    do
-	      {
-		if (e == 99)
-		  {
-		    errnum = ERR_BAD_GZIP_DATA;
-		    return 0;
-		  }
-		DUMPBITS (t->b);
-		e -= 16;
-		NEEDBITS (e);
-	      }
-	    while ((e = (t = t->v.t + ((unsigned) b & mask_bits[e]))->e) > 16);
-	  DUMPBITS (t->b);
-
-	  if (e == 16)		/* then it's a literal */
+	  /* take the fast path while it can run for a while */
+	  if (w < WSIZE - FAST_WINDOW_SLOP
+	      && filepos != gzip_data_offset
+	      && bufloc < INBUFSIZ - 2 * FAST_INPUT_SLOP)
 	    {
-	      slide[w++] = (uch) t->v.n;
+	      int ret;
+
+	      wp = w;
+	      bb = b;
+	      bk = k;
+	      ret = inflate_fast ();
+	      w = wp;
+	      b = bb;
+	      k = bk;
+
+	      if (ret < 0)
+		{
+		  errnum = ERR_BAD_GZIP_DATA;
+		  return 0;
+		}
+
+	      if (ret > 0)
+		{
+		  block_len = 0;
+		  break;
+		}
+
+	      continue;
+	    }
+
+	  NEEDBITS (bl);
+	  here = tl[(unsigned) b & ml];
+	  if (here.op && ! (here.op & 0xf0))
+	    {
+	      /* a long code, finish it in the sub-table */
+	      NEEDBITS (here.bits + here.op);
+	      DUMPBITS (here.bits);
+	      here = tl[here.val + ((unsigned) b & mask_bits[here.op])];
+	    }
+	  DUMPBITS (here.bits);
+
+	  e = here.op;
+	  if (e == 0)		/* then it's a literal */
+	    {
+	      window[w++] = (uch) here.val;
 	      if (w == WSIZE)
 		break;
 	    }
@@ -770,36 +1030,45 @@ inflate_codes_in_window (void)
 	    /* it's an EOB or a length */
 	    {
 	      /* exit if end of block */
-	      if (e == 15)
+	      if ((e & 96) == 96)
 		{
 		  block_len = 0;
 		  break;
 		}
 
+	      if (! (e & 16))
+		{
+		  errnum = ERR_BAD_GZIP_DATA;
+		  return 0;
+		}
+
 	      /* get length of block to copy */
+	      e &= 15;
 	      NEEDBITS (e);
-	      n = t->v.n + ((unsigned) b & mask_bits[e]);
+	      n = here.val + ((unsigned) b & mask_bits[e]);
 	      DUMPBITS (e);
 
 	      /* decode distance of block to copy */
-	      NEEDBITS ((unsigned) bd);
-	      if ((e = (t = td + ((unsigned) b & md))->e) > 16)
-		do
-		  {
-		    if (e == 99)
-		      {
-			errnum = ERR_BAD_GZIP_DATA;
-			return 0;
-		      }
-		    DUMPBITS (t->b);
-		    e -= 16;
-		    NEEDBITS (e);
-		  }
-		while ((e = (t = t->v.t + ((unsigned) b & mask_bits[e]))->e)
-		       > 16);
-	      DUMPBITS (t->b);
+	      NEEDBITS (bd);
+	      here = td[(unsigned) b & md];
+	      if (here.op && ! (here.op & 0xf0))
+		{
+		  NEEDBITS (here.bits + here.op);
+		  DUMPBITS (here.bits);
+		  here = td[here.val + ((unsigned) b & mask_bits[here.op])];
+		}
+	      DUMPBITS (here.bits);
+
+	      e = here.op;
+	      if (! (e & 16))
+		{
+		  errnum = ERR_BAD_GZIP_DATA;
+		  return 0;
+		}
+
+	      e &= 15;
 	      NEEDBITS (e);
-	      d = w - t->v.n - ((unsigned) b & mask_bits[e]);
+	      d = w - here.val - ((unsigned) b & mask_bits[e]);
 	      DUMPBITS (e);
 	      code_state++;
 	    }
@@ -812,9 +1081,16 @@ inflate_codes_in_window (void)
 	    {
 	      n -= (e = (e = WSIZE - ((d &= WSIZE - 1) > w ? d : w)) > n ? n
 		    : e);
-	      if (w - d >= e)
+	      if (d >= w)
 		{
-		  memmove (slide + w, slide + d, e);
+		  /* from the window before this one */
+		  memmove (window + w, history + d, e);
+		  w += e;
+		  d += e;
+		}
+	      else if (w - d >= e)
+		{
+		  memmove (window + w, window + d, e);
 		  w += e;
 		  d += e;
 		}
@@ -822,7 +1098,7 @@ inflate_codes_in_window (void)
 		/* purposefully use the overlap for extra copies here!! */
 		{
 		  while (e--)
-		    slide[w++] = slide[d++];
+		    window[w++] = window[d++];
 		}
 	      if (w == WSIZE)
 		break;
@@ -879,15 +1155,15 @@ init_stored_block (void)
 }
 
 
-/* get header for an inflated type 1 (fixed Huffman codes) block.  We should
-   either replace this with a custom decoder, or at least precompute the
-   Huffman tables. */
+/* get header for an inflated type 1 (fixed Huffman codes) block. */
 
 static void
 init_fixed_block ()
 {
   int i;			/* temporary variable */
-  unsigned l[288];		/* length list for huft_build */
+  ush l[288];			/* length list for inflate_table */
+  ush work[288];		/* work area for inflate_table */
+  struct code *next;		/* next free table space */
 
   /* set up literal table */
   for (i = 0; i < 144; i++)
@@ -898,18 +1174,20 @@ init_fixed_block ()
     l[i] = 7;
   for (; i < 288; i++)		/* make a complete, but wrong code set */
     l[i] = 8;
-  bl = 7;
-  if ((i = huft_build (l, 288, 257, cplens, cplext, &tl, &bl)) != 0)
+  next = tl = codes;
+  bl = lbits;
+  if (inflate_table (TABLE_LENS, l, 288, &next, &bl, work))
     {
       errnum = ERR_BAD_GZIP_DATA;
       return;
     }
 
   /* set up distance table */
-  for (i = 0; i < 30; i++)	/* make an incomplete code set */
+  for (i = 0; i < 32; i++)	/* make a complete, but wrong code set */
     l[i] = 5;
+  td = next;
   bd = 5;
-  if ((i = huft_build (l, 30, 0, cpdist, cpdext, &td, &bd)) > 1)
+  if (inflate_table (TABLE_DISTS, l, 32, &next, &bd, work))
     {
       errnum = ERR_BAD_GZIP_DATA;
       return;
@@ -934,7 +1212,10 @@ init_dynamic_block (void)
   unsigned nb;			/* number of bit length codes */
   unsigned nl;			/* number of literal/length codes */
   unsigned nd;			/* number of distance codes */
-  unsigned ll[286 + 30];	/* literal/length and distance code lengths */
+  ush ll[286 + 30];		/* literal/length and distance code lengths */
+  ush work[288];		/* work area for inflate_table */
+  struct code *next;		/* next free table space */
+  struct code here;		/* current table entry */
   register ulg b;		/* bit buffer */
   register unsigned k;		/* number of bits in bit buffer */
 
@@ -969,8 +1250,9 @@ init_dynamic_block (void)
     ll[bitorder[j]] = 0;
 
   /* build decoding table for trees--single level, 7 bit lookup */
+  next = tl = codes;
   bl = 7;
-  if ((i = huft_build (ll, 19, 19, NULL, NULL, &tl, &bl)) != 0)
+  if (inflate_table (TABLE_CODES, ll, 19, &next, &bl, work))
     {
       errnum = ERR_BAD_GZIP_DATA;
       return;
@@ -982,10 +1264,10 @@ init_dynamic_block (void)
   i = l = 0;
   while ((unsigned) i < n)
     {
-      NEEDBITS ((unsigned) bl);
-      j = (td = tl + ((unsigned) b & m))->b;
-      DUMPBITS (j);
-      j = td->v.n;
+      NEEDBITS (bl);
+      here = tl[(unsigned) b & m];
+      DUMPBITS (here.bits);
+      j = here.val;
       if (j < 16)		/* length of code in bits (0..15) */
 	ll[i++] = l = j;	/* save last length in l */
       else if (j == 16)		/* repeat last length 3 to 6 times */
@@ -1032,33 +1314,30 @@ init_dynamic_block (void)
 	}
     }
 
-  /* free decoding table for trees */
-  reset_linalloc ();
-
   /* restore the global bit buffer */
   bb = b;
   bk = k;
 
-  /* build the decoding tables for literal/length and distance codes */
-  bl = lbits;
-  if ((i = huft_build (ll, nl, 257, cplens, cplext, &tl, &bl)) != 0)
+  /* a block without an end-of-block code could never be left */
+  if (ll[256] == 0)
     {
-#if 0
-      if (i == 1)
-	printf ("gunzip: incomplete literal tree\n");
-#endif
+      errnum = ERR_BAD_GZIP_DATA;
+      return;
+    }
 
+  /* build the decoding tables for literal/length and distance codes,
+     over the table for trees which is no longer needed */
+  next = tl = codes;
+  bl = lbits;
+  if (inflate_table (TABLE_LENS, ll, nl, &next, &bl, work))
+    {
       errnum = ERR_BAD_GZIP_DATA;
       return;
     }
+  td = next;
   bd = dbits;
-  if ((i = huft_build (ll + nl, nd, 0, cpdist, cpdext, &td, &bd)) != 0)
+  if (inflate_table (TABLE_DISTS, ll + nl, nd, &next, &bd, work))
     {
-#if 0
-      if (i == 1)
-	printf ("gunzip: incomplete distance tree\n");
-#endif
-
       errnum = ERR_BAD_GZIP_DATA;
       return;
     }
@@ -1075,8 +1354,6 @@ get_new_block (void)
   register ulg b;		/* bit buffer */
   register unsigned k;		/* number of bits in bit buffer */
 
-  hufts = 0;
-
   /* make local bit buffer */
   b = bb;
   k = bk;
@@ -1104,9 +1381,232 @@ get_new_block (void)
 }
 
 
+/* CRC-32 of the uncompressed data, as in the gzip trailer.  Eight
+   tables let update_crc fold in eight bytes with eight independent
+   lookups at a time instead of one byte per lookup ("slice-by-8").
+   crc_table[0] is the usual byte-at-a-time table, and crc_table[k][n]
+   is the CRC of byte n followed by k zero bytes.  */
+static ulg crc_table[8][256];
+static int crc_table_ready;
+
+typedef ulg __attribute__ ((__may_alias__)) crc_word_t;
+
+static void
+make_crc_table (void)
+{
+  ulg c;
+  int n, k;
+
+  for (n = 0; n < 256; n++)
+    {
+      c = (ulg) n;
+      for (k = 0; k < 8; k++)
+	c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+      crc_table[0][n] = c;
+    }
+
+  for (n = 0; n < 256; n++)
+    {
+      c = crc_table[0][n];
+      for (k = 1; k < 8; k++)
+	{
+	  c = crc_table[0][c & 0xff] ^ (c >> 8);
+	  crc_table[k][n] = c;
+	}
+    }
+
+  crc_table_ready = 1;
+}
+
+/* Fold LEN bytes at P into CRC, which is kept inverted as it goes.  */
+static ulg
+update_crc (ulg crc, const uch *p, unsigned len)
+{
+  while (len && ((unsigned long) p & 3))
+    {
+      crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+      len--;
+    }
+
+  while (len >= 8)
+    {
+      ulg one = *(const crc_word_t *) p ^ crc;
+      ulg two = *(const crc_word_t *) (p + 4);
+
+      crc = (crc_table[7][one & 0xff]
+	     ^ crc_table[6][(one >> 8) & 0xff]
+	     ^ crc_table[5][(one >> 16) & 0xff]
+	     ^ crc_table[4][one >> 24]
+	     ^ crc_table[3][two & 0xff]
+	     ^ crc_table[2][(two >> 8) & 0xff]
+	     ^ crc_table[1][(two >> 16) & 0xff]
+	     ^ crc_table[0][two >> 24]);
+      p += 8;
+      len -= 8;
+    }
+
+  while (len--)
+    crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+  return crc;
+}
+
+
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+
+/*
+ *  Seek index.  During the first pass through a file, the whole state
+ *  of inflate is saved every checkpoint_interval bytes of output, at the
+ *  start of a window: where the input is, the bit buffer, the block
+ *  being decoded and its tables, and the window before, which is all the
+ *  history the rest of the stream can refer back to.  A backward seek
+ *  then resumes from the nearest checkpoint instead of inflating the
+ *  file again from the start, as the loaders do when they go back for
+ *  each program segment.  When the index fills up, every other
+ *  checkpoint is dropped and the interval doubled.
+ */
+
+#define GZIP_CHECKPOINT_INTERVAL	0x100000
+#define GZIP_MAX_CHECKPOINTS		16
+
+struct gzip_checkpoint
+{
+  int outpos;			/* uncompressed offset, a multiple of WSIZE */
+  int inpos;			/* compressed offset of the next input byte */
+  ulg bb;			/* bit buffer */
+  unsigned bk;			/* bits in bit buffer */
+  int block_type;
+  int block_len;
+  int last_block;
+  int code_state;
+  unsigned inflate_n;
+  unsigned inflate_d;
+  unsigned bl;			/* lookup bits for tl */
+  unsigned bd;			/* lookup bits for td */
+  int td;			/* offset of td in codes */
+  ulg crc_value;
+  struct code codes[ENOUGH];	/* tables of the current block */
+  uch dict[WSIZE];		/* the window before this one */
+};
+
+static struct gzip_checkpoint *checkpoints[GZIP_MAX_CHECKPOINTS];
+static int num_checkpoints;
+static int checkpoint_interval = GZIP_CHECKPOINT_INTERVAL;
+
+static void
+free_checkpoints (void)
+{
+  while (num_checkpoints)
+    grub_free_pages (checkpoints[--num_checkpoints],
+		     sizeof (struct gzip_checkpoint));
+
+  checkpoint_interval = GZIP_CHECKPOINT_INTERVAL;
+}
+
+/* Called at the start of each window.  */
+static void
+save_checkpoint (void)
+{
+  struct gzip_checkpoint *cp;
+  int i, j;
+
+  if (! saved_filepos || saved_filepos % checkpoint_interval
+      || (last_block && ! block_len)
+      || (num_checkpoints
+	  && checkpoints[num_checkpoints - 1]->outpos >= saved_filepos))
+    return;
+
+  if (num_checkpoints == GZIP_MAX_CHECKPOINTS)
+    {
+      for (i = j = 0; i < num_checkpoints; i++)
+	if (checkpoints[i]->outpos % (checkpoint_interval * 2))
+	  grub_free_pages (checkpoints[i], sizeof (struct gzip_checkpoint));
+	else
+	  checkpoints[j++] = checkpoints[i];
+
+      num_checkpoints = j;
+      checkpoint_interval *= 2;
+      if (saved_filepos % checkpoint_interval)
+	return;
+    }
+
+  cp = grub_alloc_pages (sizeof (struct gzip_checkpoint));
+  if (! cp)
+    return;
+
+  cp->outpos = saved_filepos;
+  cp->inpos = inbuf_pos + bufloc;
+  cp->bb = bb;
+  cp->bk = bk;
+  cp->block_type = block_type;
+  cp->block_len = block_len;
+  cp->last_block = last_block;
+  cp->code_state = code_state;
+  cp->inflate_n = inflate_n;
+  cp->inflate_d = inflate_d;
+  cp->bl = bl;
+  cp->bd = bd;
+  cp->td = td - codes;
+  cp->crc_value = crc_value;
+  memmove (cp->codes, codes, sizeof (cp->codes));
+  memmove (cp->dict, history, WSIZE);
+
+  checkpoints[num_checkpoints++] = cp;
+}
+
+/* Move inflate to the last checkpoint from which gzip_filepos can be
+   reached, if it is past the window inflate is at or if RESTART (the
+   window inflate is at being past gzip_filepos).  Return non-zero if
+   a checkpoint was used.  */
+static int
+load_checkpoint (int restart)
+{
+  struct gzip_checkpoint *cp = 0;
+  int i;
+
+  for (i = 0; i < num_checkpoints; i++)
+    if (checkpoints[i]->outpos <= gzip_filepos + WSIZE)
+      cp = checkpoints[i];
+
+  if (! cp || (! restart && cp->outpos <= saved_filepos))
+    return 0;
+
+  saved_filepos = cp->outpos;
+
+  /* make get_byte read again from the saved input position */
+  filepos = cp->inpos;
+  inbuf_pos = cp->inpos - INBUFSIZ;
+  bufloc = INBUFSIZ;
+
+  bb = cp->bb;
+  bk = cp->bk;
+  block_type = cp->block_type;
+  block_len = cp->block_len;
+  last_block = cp->last_block;
+  code_state = cp->code_state;
+  inflate_n = cp->inflate_n;
+  inflate_d = cp->inflate_d;
+  tl = codes;
+  td = codes + cp->td;
+  bl = cp->bl;
+  bd = cp->bd;
+  crc_value = cp->crc_value;
+  memmove (codes, cp->codes, sizeof (cp->codes));
+  memmove (slide, cp->dict, WSIZE);
+
+  return 1;
+}
+
+#endif /* PLATFORM_EFI || GRUB_UTIL */
+
+
 static void
 inflate_window (void)
 {
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+  save_checkpoint ();
+#endif
+
   /* initialize window */
   wp = 0;
 
@@ -1143,7 +1643,7 @@ inflate_window (void)
 
 	  while (block_len && w < WSIZE && !errnum)
 	    {
-	      slide[w++] = get_byte ();
+	      window[w++] = get_byte ();
 	      block_len--;
 	    }
 
@@ -1156,13 +1656,23 @@ inflate_window (void)
        *  Expand other kind of block.
        */
 
-      if (inflate_codes_in_window ())
-	reset_linalloc ();
+      inflate_codes_in_window ();
     }
 
+  /* The window was just written and is still hot in the cache, so
+     this costs no extra trip through memory.  */
+  crc_value = update_crc (crc_value, window, wp);
+
   saved_filepos += WSIZE;
 
-  /* XXX do CRC calculation here! */
+  /*
+   *  At the end of the stream, check what came out against the gzip
+   *  trailer, so that a damaged image is refused here and not handed on.
+   */
+  if (last_block && !block_len && !errnum
+      && (~crc_value != gzip_crc
+	  || (unsigned) (saved_filepos - WSIZE + wp) != (unsigned) gzip_filemax))
+    errnum = ERR_BAD_GZIP_CRC;
 }
 
 
@@ -1172,16 +1682,33 @@ initialize_tables (void)
   saved_filepos = 0;
   filepos = gzip_data_offset;
 
-  /* initialize window, bit buffer */
+  /* initialize window, bit buffer, check value */
   bk = 0;
   bb = 0;
+  if (! crc_table_ready)
+    make_crc_table ();
+  crc_value = 0xffffffff;
 
   /* reset partial decompression code */
   last_block = 0;
   block_len = 0;
 
-  /* reset memory allocation stuff */
+  /* set aside the space for the decoding tables */
   reset_linalloc ();
+  codes = linalloc (ENOUGH * sizeof (struct code));
+}
+
+
+/* Bring the last window decoded into a caller's buffer back to SLIDE,
+   where the next pass expects it.  */
+static void
+save_history (void)
+{
+  if (history != slide)
+    {
+      memmove (slide, history, WSIZE);
+      history = slide;
+    }
 }
 
 
@@ -1190,6 +1717,7 @@ gunzip_read (char *buf, int len)
 {
   int ret = 0;
 
+  bootprof_begin (BOOTPROF_INFLATE, "gzip");
   compressed_file = 0;
   gunzip_swap_values ();
   /*
@@ -1197,8 +1725,18 @@ gunzip_read (char *buf, int len)
    */
 
   /* do we reset decompression to the beginning of the file? */
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+  if (saved_filepos > gzip_filepos + WSIZE)
+    {
+      if (! load_checkpoint (1))
+	initialize_tables ();
+    }
+  else
+    load_checkpoint (0);
+#else
   if (saved_filepos > gzip_filepos + WSIZE)
     initialize_tables ();
+#endif
 
   /*
    *  This loop operates upon uncompressed data only.  The only
@@ -1211,6 +1749,29 @@ gunzip_read (char *buf, int len)
       register int size;
       register char *srcaddr;
 
+      /*
+       *  A read of a whole window or more that starts just where the
+       *  output so far ends, as when a module or an initrd is loaded, is
+       *  inflated straight into the caller's buffer, a window at a time,
+       *  each window using the one before it as its history.  This
+       *  writes each byte once, not once to SLIDE and again to BUF.
+       */
+      if (gzip_filepos == saved_filepos && len >= WSIZE)
+	{
+	  window = (uch *) buf;
+	  inflate_window ();
+	  history = window;
+	  window = slide;
+
+	  buf += WSIZE;
+	  len -= WSIZE;
+	  gzip_filepos += WSIZE;
+	  ret += WSIZE;
+	  continue;
+	}
+
+      save_history ();
+
       while (gzip_filepos >= saved_filepos)
 	inflate_window ();
 
@@ -1227,7 +1788,18 @@ gunzip_read (char *buf, int len)
       ret += size;
     }
 
-  compressed_file = 1;
+  save_history ();
+
+  /*
+   *  Once the last byte has been read, run on to the end of the stream
+   *  so that the trailer gets checked: the end-of-block code may not have
+   *  fit in the window that held the last byte.
+   */
+  while (gzip_filepos == gzip_filemax && !errnum
+	 && ! (last_block && !block_len))
+    inflate_window ();
+
+  compressed_file = COMPRESSED_GZIP;
   gunzip_swap_values ();
   /*
    *  Now "gzip_*" values refer to the compressed data.
@@ -1236,7 +1808,17 @@ gunzip_read (char *buf, int len)
   if (errnum)
     ret = 0;
 
+  bootprof_end (ret);
   return ret;
 }
 
+
+void
+gunzip_close (void)
+{
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+  free_checkpoints ();
+#endif
+}
+
 #endif /* ! NO_DECOMPRESSION */
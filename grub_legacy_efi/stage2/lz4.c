@@ -0,0 +1,856 @@
+/* lz4.c - read files compressed in the LZ4 frame format */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2014  Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Files in the LZ4 frame format, as written by the lz4 utility, are
+ * read through transparently the same way gunzip.c reads gzip files.
+ * LZ4 decodes several times faster than inflate, for about the same
+ * size on kernels and ramdisks.
+ *
+ * The frame is read a block at a time.  When the blocks are
+ * independent, a block that a read covers as a whole is decoded
+ * straight into the caller's buffer.  Otherwise the block goes to
+ * lz4_outbuf, after the last 64K of output, which linked blocks refer
+ * back to.  The start of each block is noted as it is reached, so that
+ * with independent blocks a seek restarts at the block it lands in
+ * rather than at the start of the file.  Block and content checksums
+ * are checked when the frame has them.  Preset dictionaries are not
+ * supported.
+ *
+ * The buffers come from grub_alloc_pages, so this is only built where
+ * there is one.
+ */
+
+#ifndef NO_DECOMPRESSION
+
+#include "shared.h"
+
+#include "filesys.h"
+
+/* config.h, through shared.h, says which platform this is.  */
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+
+typedef unsigned char uch;
+typedef unsigned int ulg;
+
+#define LZ4_MAGIC		0x184D2204
+
+/* frame descriptor flag byte */
+#define LZ4_FLG_VERSION_MASK	0xC0
+#define LZ4_FLG_VERSION		0x40
+#define LZ4_FLG_BLOCK_INDEP	0x20
+#define LZ4_FLG_BLOCK_CSUM	0x10
+#define LZ4_FLG_CONTENT_SIZE	0x08
+#define LZ4_FLG_CONTENT_CSUM	0x04
+#define LZ4_FLG_RESERVED	0x02
+#define LZ4_FLG_DICT_ID		0x01
+
+/* frame descriptor block maximum size byte */
+#define LZ4_BD_RESERVED		0x8F
+#define LZ4_BD_SIZE_SHIFT	4
+
+/* high bit of a block size: the block is stored uncompressed */
+#define LZ4_BLOCK_UNCOMPRESSED	0x80000000
+
+/* matches reach back at most this far */
+#define LZ4_DICT_SIZE		0x10000
+
+/* a match is at least this long */
+#define LZ4_MIN_MATCH		4
+
+/* room needed at both ends to copy a short sequence a word at a time */
+#define LZ4_FAST_SLOP		48
+
+/* block starts remembered for seeking */
+#define LZ4_MAX_INDEX		1024
+
+/* internal variables only */
+static int lz4_data_offset;	/* compressed offset of the first block */
+static int lz4_filepos;
+static int lz4_filemax;
+static int lz4_fsmax;
+static int lz4_flags;		/* frame descriptor flags */
+static int lz4_block_max;	/* largest block the frame can hold */
+
+static uch *lz4_inbuf;		/* one compressed block and its checksum */
+static uch *lz4_outbuf;		/* LZ4_DICT_SIZE of history, then a block */
+
+static int cur_outpos;		/* uncompressed offset of the last block */
+static int cur_len;		/* and its length, if it is in lz4_outbuf */
+static int hist_len;		/* bytes of history before it */
+static int next_inpos;		/* compressed offset of the next block */
+static int next_outpos;		/* uncompressed offset of the next block */
+static int lz4_done;		/* the end mark has been reached */
+
+struct lz4_index_entry
+{
+  int inpos;
+  int outpos;
+};
+
+static struct lz4_index_entry lz4_index[LZ4_MAX_INDEX];
+static int lz4_index_len;
+
+
+/*
+ *  xxHash32, used by the LZ4 frame format for all of its checksums.
+ */
+
+#define PRIME32_1	0x9E3779B1U
+#define PRIME32_2	0x85EBCA77U
+#define PRIME32_3	0xC2B2AE3DU
+#define PRIME32_4	0x27D4EB2FU
+#define PRIME32_5	0x165667B1U
+
+#define ROTL32(x, r)	(((x) << (r)) | ((x) >> (32 - (r))))
+
+struct xxh32_state
+{
+  ulg total;			/* bytes hashed */
+  ulg v[4];			/* the four lanes */
+  uch mem[16];			/* a partial stripe */
+  unsigned memsize;
+};
+
+static struct xxh32_state content_hash;
+static int hash_pos;		/* how much of the output is hashed */
+
+static ulg
+get32 (const uch *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((ulg) p[3] << 24);
+}
+
+static ulg
+xxh32_round (ulg acc, ulg input)
+{
+  acc += input * PRIME32_2;
+  acc = ROTL32 (acc, 13);
+  return acc * PRIME32_1;
+}
+
+static void
+xxh32_stripe (struct xxh32_state *s, const uch *p)
+{
+  s->v[0] = xxh32_round (s->v[0], get32 (p));
+  s->v[1] = xxh32_round (s->v[1], get32 (p + 4));
+  s->v[2] = xxh32_round (s->v[2], get32 (p + 8));
+  s->v[3] = xxh32_round (s->v[3], get32 (p + 12));
+}
+
+static void
+xxh32_reset (struct xxh32_state *s)
+{
+  s->total = 0;
+  s->v[0] = PRIME32_1 + PRIME32_2;
+  s->v[1] = PRIME32_2;
+  s->v[2] = 0;
+  s->v[3] = - PRIME32_1;
+  s->memsize = 0;
+}
+
+static void
+xxh32_update (struct xxh32_state *s, const uch *p, unsigned len)
+{
+  s->total += len;
+
+  if (s->memsize + len < 16)
+    {
+      memmove (s->mem + s->memsize, p, len);
+      s->memsize += len;
+      return;
+    }
+
+  if (s->memsize)
+    {
+      unsigned fill = 16 - s->memsize;
+
+      memmove (s->mem + s->memsize, p, fill);
+      xxh32_stripe (s, s->mem);
+      p += fill;
+      len -= fill;
+      s->memsize = 0;
+    }
+
+  for (; len >= 16; p += 16, len -= 16)
+    xxh32_stripe (s, p);
+
+  if (len)
+    {
+      memmove (s->mem, p, len);
+      s->memsize = len;
+    }
+}
+
+static ulg
+xxh32_digest (struct xxh32_state *s)
+{
+  const uch *p = s->mem;
+  unsigned len = s->memsize;
+  ulg h;
+
+  if (s->total >= 16)
+    h = (ROTL32 (s->v[0], 1) + ROTL32 (s->v[1], 7)
+	 + ROTL32 (s->v[2], 12) + ROTL32 (s->v[3], 18));
+  else
+    h = PRIME32_5;		/* the seed is always zero here */
+
+  h += s->total;
+
+  for (; len >= 4; p += 4, len -= 4)
+    {
+      h += get32 (p) * PRIME32_3;
+      h = ROTL32 (h, 17) * PRIME32_4;
+    }
+
+  for (; len; p++, len--)
+    {
+      h += *p * PRIME32_5;
+      h = ROTL32 (h, 11) * PRIME32_1;
+    }
+
+  h ^= h >> 15;
+  h *= PRIME32_2;
+  h ^= h >> 13;
+  h *= PRIME32_3;
+  h ^= h >> 16;
+
+  return h;
+}
+
+static ulg
+xxh32 (const uch *p, unsigned len)
+{
+  struct xxh32_state s;
+
+  xxh32_reset (&s);
+  xxh32_update (&s, p, len);
+  return xxh32_digest (&s);
+}
+
+
+/*
+ *  Block decoding.
+ */
+
+typedef unsigned long long __attribute__ ((__may_alias__, __aligned__ (1))) copy_word_t;
+
+/* Decode the LZ4 block of SRCLEN bytes at SRC to DST, which has room
+   for DSTLEN bytes, and is preceded by DICTLEN bytes of output that
+   matches may refer back to.  Return the length decoded, or -1 if the
+   block is corrupt.  */
+static int
+lz4_decode_block (const uch *src, int srclen, uch *dst, int dstlen,
+		  int dictlen)
+{
+  const uch *ip = src;
+  const uch *iend = src + srclen;
+  uch *op = dst;
+  uch *oend = dst + dstlen;
+
+  for (;;)
+    {
+      unsigned token, len, off, c;
+      const uch *match;
+
+      if (ip >= iend)
+	return -1;
+      token = *ip++;
+
+      /* literals */
+      len = token >> 4;
+
+      /* Most sequences are short and far from either end, where it is
+	 cheaper to copy a fixed two words than to call memmove.  */
+      if (len < 15 && iend - ip >= LZ4_FAST_SLOP && oend - op >= LZ4_FAST_SLOP)
+	{
+	  ((copy_word_t *) op)[0] = ((const copy_word_t *) ip)[0];
+	  ((copy_word_t *) op)[1] = ((const copy_word_t *) ip)[1];
+	  op += len;
+	  ip += len;
+
+	  off = ip[0] | (ip[1] << 8);
+	  len = token & 15;
+	  if (len < 15 && off >= sizeof (copy_word_t)
+	      && off <= (unsigned) (op - dst) + dictlen)
+	    {
+	      ip += 2;
+	      match = op - off;
+	      ((copy_word_t *) op)[0] = ((const copy_word_t *) match)[0];
+	      ((copy_word_t *) op)[1] = ((const copy_word_t *) match)[1];
+	      ((copy_word_t *) op)[2] = ((const copy_word_t *) match)[2];
+	      op += len + LZ4_MIN_MATCH;
+	      continue;
+	    }
+	  goto match;
+	}
+
+      if (len == 15)
+	do
+	  {
+	    if (ip >= iend)
+	      return -1;
+	    c = *ip++;
+	    len += c;
+	  }
+	while (c == 255);
+
+      if (len > (unsigned) (iend - ip) || len > (unsigned) (oend - op))
+	return -1;
+      memmove (op, ip, len);
+      op += len;
+      ip += len;
+
+      /* the last sequence has only literals */
+      if (ip == iend)
+	break;
+
+    match:
+      if (iend - ip < 2)
+	return -1;
+      off = ip[0] | (ip[1] << 8);
+      ip += 2;
+      if (off == 0 || off > (unsigned) (op - dst) + dictlen)
+	return -1;
+
+      len = token & 15;
+      if (len == 15)
+	do
+	  {
+	    if (ip >= iend)
+	      return -1;
+	    c = *ip++;
+	    len += c;
+	  }
+	while (c == 255);
+      len += LZ4_MIN_MATCH;
+
+      if (len > (unsigned) (oend - op))
+	return -1;
+
+      match = op - off;
+      if (off >= sizeof (copy_word_t))
+	for (; len >= sizeof (copy_word_t); len -= sizeof (copy_word_t))
+	  {
+	    *(copy_word_t *) op = *(const copy_word_t *) match;
+	    op += sizeof (copy_word_t);
+	    match += sizeof (copy_word_t);
+	  }
+
+      /* purposefully use the overlap for short offsets */
+      while (len--)
+	*op++ = *match++;
+    }
+
+  return op - dst;
+}
+
+/* Return the length the LZ4 block of SRCLEN bytes at SRC decodes to,
+   without decoding it, or -1 if it is corrupt.  */
+static int
+lz4_block_length (const uch *src, int srclen)
+{
+  const uch *ip = src;
+  const uch *iend = src + srclen;
+  unsigned out = 0;
+
+  for (;;)
+    {
+      unsigned token, len, c;
+
+      if (ip >= iend)
+	return -1;
+      token = *ip++;
+
+      len = token >> 4;
+      if (len == 15)
+	do
+	  {
+	    if (ip >= iend)
+	      return -1;
+	    c = *ip++;
+	    len += c;
+	  }
+	while (c == 255);
+
+      if (len > (unsigned) (iend - ip))
+	return -1;
+      ip += len;
+      out += len;
+
+      if (ip == iend)
+	break;
+
+      if (iend - ip < 2)
+	return -1;
+      ip += 2;
+
+      len = token & 15;
+      if (len == 15)
+	do
+	  {
+	    if (ip >= iend)
+	      return -1;
+	    c = *ip++;
+	    len += c;
+	  }
+	while (c == 255);
+      out += len + LZ4_MIN_MATCH;
+
+      if (out > (unsigned) lz4_block_max)
+	return -1;
+    }
+
+  return out;
+}
+
+
+/* internal variable swap function */
+static void
+lz4_swap_values (void)
+{
+  register int itmp;
+
+  /* swap filepos */
+  itmp = filepos;
+  filepos = lz4_filepos;
+  lz4_filepos = itmp;
+
+  /* swap filemax */
+  itmp = filemax;
+  filemax = lz4_filemax;
+  lz4_filemax = itmp;
+
+  /* swap fsmax */
+  itmp = fsmax;
+  fsmax = lz4_fsmax;
+  lz4_fsmax = itmp;
+}
+
+/* Read LEN bytes of the compressed file at POS into BUF.  Return
+   non-zero if that worked.  */
+static int
+lz4_read_at (int pos, void *buf, int len)
+{
+  filepos = pos;
+  if (grub_read (buf, len) == len)
+    return 1;
+
+  if (! errnum)
+    errnum = ERR_BAD_GZIP_DATA;
+  return 0;
+}
+
+static void
+lz4_free_buffers (void)
+{
+  if (lz4_inbuf)
+    grub_free_pages (lz4_inbuf, lz4_block_max + 4);
+  if (lz4_outbuf)
+    grub_free_pages (lz4_outbuf, LZ4_DICT_SIZE + lz4_block_max);
+
+  lz4_inbuf = lz4_outbuf = 0;
+}
+
+/* Go back to the first block.  */
+static void
+lz4_rewind (void)
+{
+  next_inpos = lz4_data_offset;
+  next_outpos = 0;
+  cur_outpos = 0;
+  cur_len = 0;
+  hist_len = 0;
+  lz4_done = 0;
+}
+
+/* Note that the next block starts where it does, if it is past the
+   last block noted.  */
+static void
+lz4_note_block (void)
+{
+  if (lz4_index_len < LZ4_MAX_INDEX
+      && next_outpos > lz4_index[lz4_index_len - 1].outpos)
+    {
+      lz4_index[lz4_index_len].inpos = next_inpos;
+      lz4_index[lz4_index_len].outpos = next_outpos;
+      lz4_index_len++;
+    }
+}
+
+/* Work out the uncompressed size of a frame that does not record it, by
+   adding up what each block decodes to.  Return the size, or -1 on
+   error.  */
+static int
+lz4_measure (void)
+{
+  uch buf[4];
+  ulg size;
+  int len, out;
+
+  while (lz4_read_at (next_inpos, buf, 4))
+    {
+      size = get32 (buf);
+      if (! size)
+	{
+	  out = next_outpos;
+	  lz4_rewind ();
+	  return out;
+	}
+
+      len = size & ~LZ4_BLOCK_UNCOMPRESSED;
+      if (len > lz4_block_max)
+	break;
+
+      if (size & LZ4_BLOCK_UNCOMPRESSED)
+	out = len;
+      else if (! lz4_read_at (next_inpos + 4, lz4_inbuf, len)
+	       || (out = lz4_block_length (lz4_inbuf, len)) < 0)
+	break;
+
+      if (next_outpos > MAXINT - out)
+	break;
+
+      lz4_note_block ();
+      next_inpos += 4 + len + ((lz4_flags & LZ4_FLG_BLOCK_CSUM) ? 4 : 0);
+      next_outpos += out;
+    }
+
+  if (! errnum)
+    errnum = ERR_BAD_GZIP_DATA;
+  return -1;
+}
+
+/* At the end mark, check the length of the output and, if all of it
+   went through the hash, the content checksum.  */
+static void
+lz4_end (void)
+{
+  uch buf[4];
+
+  lz4_done = 1;
+
+  if (next_outpos != lz4_filemax)
+    errnum = ERR_BAD_GZIP_CRC;
+  else if ((lz4_flags & LZ4_FLG_CONTENT_CSUM) && hash_pos == next_outpos
+	   && lz4_read_at (next_inpos + 4, buf, 4)
+	   && get32 (buf) != xxh32_digest (&content_hash))
+    errnum = ERR_BAD_GZIP_CRC;
+}
+
+/* Decode the next block to DST, which has room for a whole block and
+   HIST bytes of history before it.  Return its length, or -1 at the
+   end mark or on error.  */
+static int
+lz4_next_block (uch *dst, int hist)
+{
+  uch buf[4];
+  ulg size;
+  int len, csum;
+
+  if (! lz4_read_at (next_inpos, buf, 4))
+    return -1;
+
+  size = get32 (buf);
+  if (! size)
+    {
+      lz4_end ();
+      return -1;
+    }
+
+  len = size & ~LZ4_BLOCK_UNCOMPRESSED;
+  csum = (lz4_flags & LZ4_FLG_BLOCK_CSUM) ? 4 : 0;
+  if (len > lz4_block_max)
+    {
+      errnum = ERR_BAD_GZIP_DATA;
+      return -1;
+    }
+
+  lz4_note_block ();
+
+  if (size & LZ4_BLOCK_UNCOMPRESSED)
+    {
+      /* stored as it is: read it straight to DST */
+      if (! lz4_read_at (next_inpos + 4, dst, len)
+	  || (csum && ! lz4_read_at (next_inpos + 4 + len, buf, 4)))
+	return -1;
+
+      if (csum && get32 (buf) != xxh32 (dst, len))
+	{
+	  errnum = ERR_BAD_GZIP_CRC;
+	  return -1;
+	}
+      size = len;
+    }
+  else
+    {
+      if (! lz4_read_at (next_inpos + 4, lz4_inbuf, len + csum))
+	return -1;
+
+      if (csum && get32 (lz4_inbuf + len) != xxh32 (lz4_inbuf, len))
+	{
+	  errnum = ERR_BAD_GZIP_CRC;
+	  return -1;
+	}
+
+      size = lz4_decode_block (lz4_inbuf, len, dst, lz4_block_max, hist);
+      if ((int) size < 0)
+	{
+	  errnum = ERR_BAD_GZIP_DATA;
+	  return -1;
+	}
+    }
+
+  /* the content checksum covers the output in order from the start */
+  if (hash_pos == next_outpos)
+    {
+      xxh32_update (&content_hash, dst, size);
+      hash_pos += size;
+    }
+
+  cur_outpos = next_outpos;
+  next_outpos += size;
+  next_inpos += 4 + len + csum;
+
+  return size;
+}
+
+/* Move to the last block known to start at or before lz4_filepos, if
+   inflate has gone past it or if it is past the next block.  Linked
+   blocks can only be decoded from the start.  */
+static void
+lz4_seek (void)
+{
+  int i = 0;
+
+  if (lz4_flags & LZ4_FLG_BLOCK_INDEP)
+    for (i = lz4_index_len - 1; i && lz4_index[i].outpos > lz4_filepos; i--)
+      ;
+
+  if (lz4_filepos >= next_outpos && lz4_index[i].outpos <= next_outpos)
+    return;
+
+  next_inpos = lz4_index[i].inpos;
+  next_outpos = lz4_index[i].outpos;
+  cur_len = 0;
+  hist_len = 0;
+  lz4_done = 0;
+}
+
+
+int
+lz4_test_header (void)
+{
+  uch buf[15];
+  int len;
+
+  /* "compressed_file" is already reset to zero by this point */
+
+  lz4_close ();
+
+  /*
+   *  This checks if the file is in the LZ4 frame format.  If a problem
+   *  occurs here (other than a real error with the disk) then we don't
+   *  think it is a compressed file, and simply mark it as such.
+   */
+  if (no_decompression
+      || grub_read ((char *) buf, 6) != 6
+      || get32 (buf) != LZ4_MAGIC)
+    {
+      filepos = 0;
+      return ! errnum;
+    }
+
+  /*
+   *  This does consistency checking on the frame descriptor.  If a
+   *  problem occurs from here on, then we have corrupt or otherwise
+   *  bad data, and the error should be reported to the user.
+   */
+  lz4_flags = buf[4];
+  len = 2 + ((lz4_flags & LZ4_FLG_CONTENT_SIZE) ? 8 : 0);
+  if ((lz4_flags & LZ4_FLG_VERSION_MASK) != LZ4_FLG_VERSION
+      || (lz4_flags & (LZ4_FLG_RESERVED | LZ4_FLG_DICT_ID))
+      || (buf[5] & LZ4_BD_RESERVED)
+      || (buf[5] >> LZ4_BD_SIZE_SHIFT) < 4
+      || grub_read ((char *) buf + 6, len - 1) != len - 1
+      || buf[4 + len] != ((xxh32 (buf + 4, len) >> 8) & 0xff)
+      || ((lz4_flags & LZ4_FLG_CONTENT_SIZE)
+	  && (get32 (buf + 10) || get32 (buf + 6) > MAXINT)))
+    {
+      if (! errnum)
+	errnum = ERR_BAD_GZIP_HEADER;
+
+      return 0;
+    }
+
+  /* 64K, 256K, 1M or 4M */
+  lz4_block_max = 1 << (8 + 2 * (buf[5] >> LZ4_BD_SIZE_SHIFT));
+  lz4_data_offset = filepos;
+
+  lz4_inbuf = grub_alloc_pages (lz4_block_max + 4);
+  lz4_outbuf = grub_alloc_pages (LZ4_DICT_SIZE + lz4_block_max);
+  if (! lz4_inbuf || ! lz4_outbuf)
+    {
+      lz4_free_buffers ();
+      errnum = ERR_WONT_FIT;
+      return 0;
+    }
+
+  lz4_rewind ();
+  lz4_index[0].inpos = lz4_data_offset;
+  lz4_index[0].outpos = 0;
+  lz4_index_len = 1;
+  xxh32_reset (&content_hash);
+  hash_pos = 0;
+
+  if (lz4_flags & LZ4_FLG_CONTENT_SIZE)
+    lz4_fsmax = lz4_filemax = get32 (buf + 6);
+  else if ((lz4_fsmax = lz4_filemax = lz4_measure ()) < 0)
+    {
+      lz4_free_buffers ();
+      return 0;
+    }
+
+  compressed_file = COMPRESSED_LZ4;
+  lz4_swap_values ();
+  /*
+   *  Now "lz4_*" values refer to the compressed data.
+   */
+
+  filepos = 0;
+
+  return 1;
+}
+
+
+int
+lz4_read (char *buf, int len)
+{
+  int ret = 0;
+
+  bootprof_begin (BOOTPROF_INFLATE, "lz4");
+  compressed_file = 0;
+  lz4_swap_values ();
+  /*
+   *  Now "lz4_*" values refer to the uncompressed data.
+   */
+
+  while (len > 0 && !errnum)
+    {
+      register int size;
+
+      /* already in the block decoded last? */
+      if (lz4_filepos >= cur_outpos && lz4_filepos < cur_outpos + cur_len)
+	{
+	  size = cur_outpos + cur_len - lz4_filepos;
+	  if (size > len)
+	    size = len;
+
+	  memmove (buf, lz4_outbuf + LZ4_DICT_SIZE
+		   + (lz4_filepos - cur_outpos), size);
+
+	  buf += size;
+	  len -= size;
+	  lz4_filepos += size;
+	  ret += size;
+	  continue;
+	}
+
+      lz4_seek ();
+      if (lz4_done)
+	{
+	  errnum = ERR_BAD_GZIP_DATA;
+	  break;
+	}
+
+      /*
+       *  An independent block that the read covers as a whole is
+       *  decoded straight into the caller's buffer.
+       */
+      if ((lz4_flags & LZ4_FLG_BLOCK_INDEP)
+	  && lz4_filepos == next_outpos && len >= lz4_block_max)
+	{
+	  size = lz4_next_block ((uch *) buf, 0);
+	  cur_len = 0;
+	  if (size < 0)
+	    break;
+
+	  buf += size;
+	  len -= size;
+	  lz4_filepos += size;
+	  ret += size;
+	  continue;
+	}
+
+      /* keep the last 64K of output for linked blocks to refer to */
+      if (! (lz4_flags & LZ4_FLG_BLOCK_INDEP))
+	{
+	  hist_len += cur_len;
+	  if (hist_len > LZ4_DICT_SIZE)
+	    hist_len = LZ4_DICT_SIZE;
+
+	  memmove (lz4_outbuf + LZ4_DICT_SIZE - hist_len,
+		   lz4_outbuf + LZ4_DICT_SIZE + cur_len - hist_len, hist_len);
+	}
+
+      size = lz4_next_block (lz4_outbuf + LZ4_DICT_SIZE, hist_len);
+      cur_len = size < 0 ? 0 : size;
+    }
+
+  /*
+   *  Once the last byte has been read, make sure the end mark comes
+   *  next, so that the content checksum gets checked.
+   */
+  if (lz4_filepos == lz4_filemax && !errnum && !lz4_done
+      && next_outpos == lz4_filemax)
+    {
+      uch mark[4];
+
+      if (lz4_read_at (next_inpos, mark, 4))
+	{
+	  if (get32 (mark))
+	    errnum = ERR_BAD_GZIP_CRC;
+	  else
+	    lz4_end ();
+	}
+    }
+
+  compressed_file = COMPRESSED_LZ4;
+  lz4_swap_values ();
+  /*
+   *  Now "lz4_*" values refer to the compressed data.
+   */
+
+  if (errnum)
+    ret = 0;
+
+  bootprof_end (ret);
+  return ret;
+}
+
+
+void
+lz4_close (void)
+{
+  lz4_free_buffers ();
+}
+
+#endif /* PLATFORM_EFI || GRUB_UTIL */
+#endif /* ! NO_DECOMPRESSION */
@@ -0,0 +1,363 @@
+/* preload.c - read the default entry's files during the menu countdown */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2014  Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * While the menu counts down to the default entry, nothing is being
+ * read.  The files named by that entry's kernel, module, modulenounzip
+ * and initrd commands are read into memory meanwhile, a slice between
+ * each look at the keyboard, decompressed as they would be when the
+ * entry runs.  When the entry does run, grub_open finds each file here
+ * and reads it from memory, or, if the countdown ran out before all of
+ * it was read, reads only the rest of it from the disk.
+ *
+ * A file is known by the drive and partition it is on and its path
+ * there, worked out as the entry would, so a root command earlier in
+ * the entry counts.  Anything else opening a file stops the reading
+ * ahead, as the file systems can only have one file open at a time.
+ */
+
+#include "shared.h"
+
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+
+/* The most read at a time, which bounds how long a key waits.  */
+#define PRELOAD_SLICE		0x10000
+
+/* The most memory spent on the files of an entry.  */
+#define PRELOAD_MAX_BYTES	(64 << 20)
+
+static struct preload_file files[PRELOAD_FILES];
+static int num_files;
+
+/* The file being read ahead now, and whether it is open.  */
+static int cur;
+static int cur_open;
+
+/* Set while a file is opened to be read ahead.  */
+static int stepping;
+
+static unsigned long total;
+
+/* Return true if CMD is the command WORD.  */
+static int
+is_command (char *cmd, char *word)
+{
+  int len = grub_strlen (word);
+
+  return (grub_memcmp (cmd, word, len) == 0
+	  && (! cmd[len] || cmd[len] == '=' || isspace (cmd[len])));
+}
+
+/* Return true if the path A is the path B, which runs to a space.  */
+int
+same_file_path (char *a, char *b)
+{
+  while (*a && *a == *b)
+    a++, b++;
+
+  return ! *a && (! *b || isspace (*b));
+}
+
+static struct preload_file *
+find (unsigned long drive, unsigned long partition, char *path, int nounzip)
+{
+  int i;
+
+  for (i = 0; i < num_files; i++)
+    if (files[i].drive == drive && files[i].partition == partition
+	&& files[i].nounzip == nounzip && same_file_path (files[i].path, path))
+      return &files[i];
+
+  return 0;
+}
+
+static void
+add_file (char *name, unsigned long drive, unsigned long partition,
+	  int nounzip)
+{
+  struct preload_file *f;
+  char *path;
+  int i;
+
+  if (num_files == PRELOAD_FILES)
+    return;
+
+  /* Block lists are not worth the trouble.  A file on the network is
+     downloaded whole by its first read, which would hold up the
+     countdown, and is read straight into place when the entry runs.  */
+  path = resolve_file_name (name, &drive, &partition);
+  if (! path || *path != '/' || drive == NETWORK_DRIVE
+      || find (drive, partition, path, nounzip))
+    return;
+
+  f = &files[num_files];
+  for (i = 0; path[i] && ! isspace (path[i]); i++)
+    {
+      if (i == PRELOAD_PATH_LEN - 1)
+	return;
+      f->path[i] = path[i];
+    }
+  f->path[i] = 0;
+
+  f->drive = drive;
+  f->partition = partition;
+  f->nounzip = nounzip;
+  f->buf = 0;
+  f->size = 0;
+  f->loaded = 0;
+  num_files++;
+}
+
+/* Find the files that SCRIPT, a menu entry, will load, and get ready to
+   read them ahead.  */
+void
+preload_start (char *script)
+{
+  preload_discard ();
+  scan_entry_files (script, add_file);
+  cur = 0;
+}
+
+/* Open F and make room for it.  */
+static int
+open_ahead (struct preload_file *f)
+{
+  unsigned long old_saved_drive = saved_drive;
+  unsigned long old_saved_partition = saved_partition;
+  int old_nounzip = no_decompression;
+  int ret;
+
+  saved_drive = f->drive;
+  saved_partition = f->partition;
+  no_decompression = f->nounzip;
+
+  stepping = 1;
+  ret = grub_open (f->path);
+  stepping = 0;
+
+  saved_drive = old_saved_drive;
+  saved_partition = old_saved_partition;
+  no_decompression = old_nounzip;
+
+  if (! ret)
+    return 0;
+
+  if (filemax <= 0 || total + filemax > PRELOAD_MAX_BYTES
+      || ! (f->buf = grub_alloc_pages (filemax)))
+    {
+      grub_close ();
+      return 0;
+    }
+
+  f->size = filemax;
+  f->media_id = get_media_id (f->drive);
+  total += f->size;
+  cur_open = 1;
+  return 1;
+}
+
+/* Read the next slice ahead.  Return zero once there is nothing left
+   to read.  */
+int
+preload_step (void)
+{
+  struct preload_file *f;
+  grub_error_t old_errnum = errnum;
+  int len;
+
+  if (cur >= num_files)
+    return 0;
+
+  f = &files[cur];
+  if (! cur_open)
+    {
+      /* Opening is a slice of its own.  */
+      if (! open_ahead (f))
+	cur++;
+    }
+  else
+    {
+      len = f->size - f->loaded;
+      if (len > PRELOAD_SLICE)
+	len = PRELOAD_SLICE;
+
+      filepos = f->loaded;
+      if (grub_read (f->buf + f->loaded, len) == len)
+	f->loaded += len;
+      else
+	len = 0;
+
+      /* Keep what was read of a file that could not be read to the
+	 end.  The rest of it will fail again when the entry runs.  */
+      if (! len || f->loaded == f->size)
+	{
+	  grub_close ();
+	  cur_open = 0;
+	  cur++;
+	}
+    }
+
+  errnum = old_errnum;
+  return cur < num_files;
+}
+
+/* Stop reading ahead, keeping what was read.  */
+void
+preload_stop (void)
+{
+  if (cur_open)
+    {
+      grub_close ();
+      cur_open = 0;
+    }
+
+  cur = num_files;
+}
+
+/* Stop reading ahead, and throw away what was read.  */
+void
+preload_discard (void)
+{
+  int i;
+
+  preload_stop ();
+
+  for (i = 0; i < num_files; i++)
+    if (files[i].buf)
+      grub_free_pages (files[i].buf, files[i].size);
+
+  num_files = 0;
+  cur = 0;
+  total = 0;
+}
+
+/* Return what was read ahead of FILENAME, or null if none of it was.
+   Set CURRENT_DRIVE and CURRENT_PARTITION to where it is, as opening it
+   would.  */
+struct preload_file *
+preload_lookup (char *filename)
+{
+  unsigned long drive = saved_drive, partition = saved_partition;
+  struct preload_file *f;
+  char *path;
+
+  if (stepping || ! num_files)
+    return 0;
+
+  preload_stop ();
+
+  path = resolve_file_name (filename, &drive, &partition);
+  if (! path || *path != '/')
+    return 0;
+
+  f = find (drive, partition, path, no_decompression);
+  if (! f || ! f->loaded || f->media_id != get_media_id (drive))
+    return 0;
+
+  current_drive = drive;
+  current_partition = partition;
+  return f;
+}
+
+/* Return the path within its partition of the file NAME, which is on
+   DRIVE and PARTITION unless it names a device of its own, in which
+   case set those.  Return null if NAME is not good.  */
+char *
+resolve_file_name (char *name, unsigned long *drive, unsigned long *partition)
+{
+  unsigned long old_drive = current_drive;
+  unsigned long old_partition = current_partition;
+  unsigned long old_saved_drive = saved_drive;
+  unsigned long old_saved_partition = saved_partition;
+  grub_error_t old_errnum = errnum;
+
+  if (*name != '(')
+    return name;
+
+  /* A device of just a disk means the root partition on it.  */
+  saved_drive = *drive;
+  saved_partition = *partition;
+
+  name = set_device (name);
+  if (name)
+    {
+      *drive = current_drive;
+      *partition = current_partition;
+    }
+
+  current_drive = old_drive;
+  current_partition = old_partition;
+  saved_drive = old_saved_drive;
+  saved_partition = old_saved_partition;
+  errnum = old_errnum;
+
+  return name;
+}
+
+/* Call FUNC for each file that SCRIPT, the commands of a menu entry,
+   will load with its kernel, module, modulenounzip or initrd commands,
+   with the file name, the root device it is relative to and the value
+   of no_decompression it will be opened with.  */
+void
+scan_entry_files (char *script,
+		  void (*func) (char *name, unsigned long drive,
+				unsigned long partition, int nounzip))
+{
+  unsigned long drive = saved_drive, partition = saved_partition;
+
+  for (; *script; script += grub_strlen (script) + 1)
+    {
+      char *cmd = script, *arg;
+      int nounzip = no_decompression;
+
+      while (isspace (*cmd))
+	cmd++;
+      arg = skip_to (1, cmd);
+
+      if (is_command (cmd, "root") || is_command (cmd, "rootnoverify"))
+	{
+	  unsigned long new_drive = drive, new_partition = partition;
+
+	  if (*arg == '('
+	      && resolve_file_name (arg, &new_drive, &new_partition))
+	    {
+	      drive = new_drive;
+	      partition = new_partition;
+	    }
+	  continue;
+	}
+
+      if (is_command (cmd, "modulenounzip"))
+	nounzip = 1;
+      else if (! is_command (cmd, "kernel") && ! is_command (cmd, "module")
+	       && ! is_command (cmd, "initrd"))
+	continue;
+
+      /* The options come first.  A file in SPI flash is no file.  */
+      while (grub_memcmp (arg, "--", 2) == 0
+	     && grub_memcmp (arg, "--spi", 5) != 0)
+	arg = skip_to (0, arg);
+
+      if (*arg && *arg != '-')
+	(*func) (arg, drive, partition, nounzip);
+    }
+}
+
+#endif /* PLATFORM_EFI || GRUB_UTIL */
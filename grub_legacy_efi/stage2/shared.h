@@ -403,6 +403,10 @@ extern void *grub_scratch_mem;
 #include "mb_header.h"
 #include "mb_info.h"
 
+/* the boot profile handed to the OS */
+
+#include "bootprof.h"
+
 /* For the Linux/i386 boot protocol version 2.03.  */
 struct linux_kernel_header
 {
@@ -569,6 +573,9 @@ typedef enum
   ERR_NUMBER_OVERFLOW,
   ERR_CLN_VERIFICATION,
   ERR_SGN_FILE_NOT_FOUND,
+  ERR_BAD_GZIP_CRC,
+  ERR_BAD_BOOTMAP,
+  ERR_FILE_HOLES,
 
   MAX_ERR_NUM
 } grub_error_t;
@@ -605,6 +612,8 @@ extern int floppy_disks;
 extern char **device_map;
 /* The filename which stores the information about a device map.  */
 extern char *device_map_file;
+/* The Clanton SPI flash image to read flash assets from.  */
+extern char *flash_image_file;
 /* The array of geometries.  */
 extern struct geometry *disks;
 /* Assign DRIVE to a device name DEVICE.  */
@@ -643,6 +652,10 @@ extern int use_pager;
 #ifndef NO_DECOMPRESSION
 extern int no_decompression;
 extern int compressed_file;
+
+/* What compressed_file is set to for each format read through.  */
+#define COMPRESSED_GZIP	1
+#define COMPRESSED_LZ4	2
 #endif
 
 /* instrumentation variables */
@@ -684,6 +697,10 @@ struct geometry
   unsigned long sector_size;
   /* Flags */
   unsigned long flags;
+  /* On an LBA device, the number of sectors that reads are best made
+     in multiples of, and the first sector of the medium so aligned.  */
+  unsigned long io_sectors;
+  unsigned long io_first;
 };
 
 extern unsigned long part_start;
@@ -695,6 +712,123 @@ extern int buf_drive;
 extern int buf_track;
 extern struct geometry buf_geom;
 
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+/* The number of tracks kept by the disk cache, by default.  */
+#define DISK_CACHE_ENTRIES	64
+
+extern int disk_cache_entries;
+extern int disk_cache_used;
+extern unsigned long disk_cache_hits;
+extern unsigned long disk_cache_misses;
+
+int disk_cache_resize (int entries);
+void disk_cache_flush (int drive);
+#endif /* PLATFORM_EFI || GRUB_UTIL */
+
+#if (defined(PLATFORM_EFI) || defined(GRUB_UTIL)) && ! defined(STAGE1_5)
+/* The filesystems remember the paths they look up.  */
+#define DENTRY_CACHE		1
+
+/* The number of paths kept by the path cache, the longest path kept and
+   the most bytes of location a filesystem may keep with a path.  */
+#define DENTRY_ENTRIES		32
+#define DENTRY_PATH_LEN		64
+#define DENTRY_LOC_SIZE		16
+
+extern unsigned long dentry_hits;
+extern unsigned long dentry_misses;
+
+int dentry_lookup (char *path, char **rest, void *loc, int size);
+void dentry_enter (char *path, int len, void *loc, int size);
+#endif
+
+#if (defined(PLATFORM_EFI) || defined(GRUB_UTIL)) && ! defined(STAGE1_5)
+/* The number of events kept by the boot profile.  */
+#define BOOTPROF_RING_SIZE	4096
+
+/* The time spent in each phase, in TSC cycles.  */
+struct bootprof_stats
+{
+  unsigned long count;
+  /* Time in the outermost spans of the phase */
+  unsigned long long total;
+  /* Time in the spans less the spans nested in them */
+  unsigned long long self;
+  /* Bytes moved by the outermost spans */
+  unsigned long long bytes;
+};
+
+extern struct bootprof_stats bootprof_stats[BOOTPROF_PHASES];
+extern const char *bootprof_phase_names[BOOTPROF_PHASES];
+extern unsigned long bootprof_dropped;
+
+void bootprof_begin (int phase, const char *name);
+void bootprof_end (unsigned long bytes);
+void bootprof_mark (const char *name);
+void bootprof_unwind (void);
+void bootprof_reset (void);
+int bootprof_count (void);
+struct bootprof_event *bootprof_event (int n);
+unsigned long long bootprof_tsc (void);
+unsigned long bootprof_tsc_khz (void);
+unsigned long long bootprof_usecs (unsigned long long cycles);
+int bootprof_export_size (void);
+int bootprof_export (void *buf, int size);
+#else
+# define bootprof_begin(phase, name)	do { } while (0)
+# define bootprof_end(bytes)		do { } while (0)
+# define bootprof_mark(name)		do { } while (0)
+# define bootprof_unwind()		do { } while (0)
+#endif
+
+#if (defined(PLATFORM_EFI) || defined(GRUB_UTIL)) && ! defined(STAGE1_5)
+/* The files of one menu entry that can be read ahead.  */
+#define PRELOAD_FILES		8
+#define PRELOAD_PATH_LEN	128
+
+/* A file read ahead, or being read ahead, into memory.  */
+struct preload_file
+{
+  unsigned long drive;
+  unsigned long partition;
+  unsigned long media_id;
+  char path[PRELOAD_PATH_LEN];
+  /* The value of no_decompression it was opened with */
+  int nounzip;
+  char *buf;
+  /* FILEMAX as opened, and how much of it is in BUF so far */
+  int size;
+  int loaded;
+};
+
+void preload_start (char *script);
+int preload_step (void);
+void preload_stop (void);
+void preload_discard (void);
+struct preload_file *preload_lookup (char *filename);
+
+char *resolve_file_name (char *name, unsigned long *drive,
+			 unsigned long *partition);
+int same_file_path (char *a, char *b);
+void scan_entry_files (char *script,
+		       void (*func) (char *name, unsigned long drive,
+				     unsigned long partition, int nounzip));
+
+/* Block lists saved ahead of time for the files of the menu entries.  */
+extern unsigned long bootmap_hits;
+extern unsigned long bootmap_stale;
+
+char *bootmap_lookup (char *filename, int *size);
+int bootmap_verify (void);
+int bootmap_load (char *mapfile);
+void bootmap_unload (void);
+int bootmap_count (void);
+int bootmap_make (char *mapfile, int entryno);
+
+/* The commands of menu entry ENTRYNO, or null if there is none.  */
+char *get_menu_entry (int entryno);
+#endif
+
 /* these are the current file position and maximum file position */
 extern int filepos;
 extern int filemax;
@@ -814,6 +948,10 @@ int get_code_end (void);
 /* low-level timing info */
 int getrtsecs (void);
 int currticks (void);
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+/* Wait for USECS microseconds.  */
+void microdelay (unsigned long usecs);
+#endif
 
 /* Clear the screen. */
 void cls (void);
@@ -849,6 +987,19 @@ keystatus (void);
 int get_diskinfo (int drive, struct geometry *geometry);
 int biosdisk (int subfunc, int drive, struct geometry *geometry,
 	      int sector, int nsec, int segment);
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+/* Same as biosdisk, but transfer to or from BUF instead of a real-mode
+   segment, so that a read can land anywhere in memory.  */
+int biosdisk_direct (int subfunc, int drive, struct geometry *geometry,
+		     int sector, int nsec, char *buf);
+/* Return an identifier for the medium in DRIVE.  It changes whenever the
+   medium may have been replaced, so that cached data can be dropped.  */
+unsigned long get_media_id (int drive);
+/* Allocate and free whole pages, for buffers that do not fit in the
+   fixed areas of the scratch memory.  */
+void *grub_alloc_pages (unsigned long size);
+void grub_free_pages (void *addr, unsigned long size);
+#endif
 void stop_floppy (void);
 int get_sector_size (int drive);
 int get_sector_bits (int drive);
@@ -980,6 +1131,12 @@ void grub_putstr (const char *str);
 /* Compression support. */
 int gunzip_test_header (void);
 int gunzip_read (char *buf, int len);
+void gunzip_close (void);
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+int lz4_test_header (void);
+int lz4_read (char *buf, int len);
+void lz4_close (void);
+#endif
 #endif /* NO_DECOMPRESSION */
 
 int rawread (int drive, int sector, int byte_offset, int byte_len, char *buf);
@@ -1072,6 +1229,23 @@ int grub_save_saved_default (int new_default);
 extern int check_device (const char *device);
 extern void assign_device_name (int drive, const char *device);
 int grub_load_multiboot (char *kernel, char *arg);
+
+/* What the heap behind grub_malloc holds, in bytes where not said.  */
+struct grub_heap_stats
+{
+  /* Reserved from the firmware */
+  unsigned long size;
+  unsigned long in_use;
+  /* The most that was ever in use */
+  unsigned long peak;
+  /* The number of reservations, and of slab pages */
+  unsigned long arenas;
+  unsigned long slabs;
+  /* The number of requests that went to the firmware pool instead */
+  unsigned long pool;
+};
+
+void grub_heap_stats (struct grub_heap_stats *stats);
 #endif
 int grub_load_linux (char *kernel, char *arg);
 int grub_load_initrd (char *initrd);
@@ -1081,6 +1255,7 @@ int grub_chainloader (char *filename);
 void grub_cln_recovery_shell (unsigned short int);
 int grub_cln_sdio_program (char *s, int i);
 int grub_cln_spi_program (char *s, int i);
+int grub_cln_spi_bench (char *arg, int flags);
 void grub_cln_event_append (const char *tag);
 void grub_cln_load_config_file (char **buf, int *size);
 void grub_cln_detect_secure_sku (void);
@@ -109,6 +109,7 @@ load_timer2 (unsigned int ticks)
   outb(ticks >> 8, TIMER2_PORT);
 }
 
+#if ! defined(PLATFORM_EFI) && ! defined(GRUB_UTIL)
 /* Rely on i8254 timer2 instead of RTC. */
 static void
 wait_one_second (void)
@@ -119,6 +120,32 @@ wait_one_second (void)
     waiton_timer2 (PIT_MAXTICKS);
   waiton_timer2 (PIT_CLOCK_TICK_RATE % PIT_MAXTICKS);
 }
+#endif
+
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+/* The entries of the configuration file, for commands that look at
+   them.  */
+static char *menu_config_entries;
+static int menu_num_entries;
+#endif
+
+/* Wait out a second of the menu countdown.  Where files can be read
+   ahead, the default entry's are read meanwhile, in slices short enough
+   that a key ends the wait at once.  */
+static void
+countdown_wait (void)
+{
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+  unsigned long long start = bootprof_tsc ();
+
+  while (checkkey () == -1
+	 && bootprof_usecs (bootprof_tsc () - start) < 1000000)
+    if (! preload_step ())
+      microdelay (10000);
+#else
+  wait_one_second ();
+#endif
+}
 
 static char *
 get_entry (char *list, int num, int nested)
@@ -137,6 +164,17 @@ get_entry (char *list, int num, int nested)
   return list;
 }
 
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+char *
+get_menu_entry (int entryno)
+{
+  if (entryno < 0 || entryno >= menu_num_entries)
+    return 0;
+
+  return get_entry (menu_config_entries, entryno, 1);
+}
+#endif
+
 /* Print an entry in a line of the menu box.  */
 static void
 print_entry (int y, int highlight, char *entry)
@@ -302,6 +340,10 @@ restart:
      interface. */
   if (grub_timeout < 0)
     show_menu = 1;
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+  else if (grub_timeout > 0 && config_entries)
+    preload_start (get_entry (config_entries, first_entry + entryno, 1));
+#endif
 
   /* If SHOW_MENU is false, don't display the menu until ESC is pressed.  */
   if (! show_menu)
@@ -320,6 +362,9 @@ restart:
 	      grub_timeout = -1;
 	      show_menu = 1;
 	      getkey ();
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+	      preload_discard ();
+#endif
 	      break;
 	    }
 
@@ -328,6 +373,9 @@ restart:
 	    {
 	      grub_timeout = -1;
 	      show_menu = 1;
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+	      preload_discard ();
+#endif
 	      break;
 	    }
 
@@ -348,7 +396,7 @@ restart:
 		             get_entry(menu_entries, first_entry + entryno, 0),
 		             grub_timeout);
 
-	      wait_one_second ();
+	      countdown_wait ();
 	    }
 	}
     }
@@ -427,7 +475,7 @@ restart:
 	  
 	  grub_timeout--;
 
-	  wait_one_second ();
+	  countdown_wait ();
 	}
 
       /* Check for a keypress, however if TIMEOUT has been expired
@@ -454,6 +502,10 @@ restart:
 	      printf ("                                                                    ");
 	      grub_timeout = -1;
 	      fallback_entryno = -1;
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+	      /* Whatever the key is for, it is not the default entry.  */
+	      preload_discard ();
+#endif
 	      if (! (current_term->flags & TERM_DUMB))
 		gotoxy (74, 4 + entryno);
 	    }
@@ -888,6 +940,11 @@ restart:
 
   if (silent_grub)
     setcursor(0);
+
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+  /* The countdown is over, so whatever was read ahead is all there is.  */
+  preload_stop ();
+#endif
   
   while (1)
     {
@@ -922,6 +979,10 @@ restart:
 	break;
     }
 
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+  preload_discard ();
+#endif
+
   /* if we get back here, we should go back to what our term was before */
   current_term = prev_term;
   if (current_term->startup)
@@ -1036,6 +1097,9 @@ cmain (void)
   
   /* Initialize the environment for restarting Stage 2.  */
   grub_setjmp (restart_env);
+
+  /* Close the spans of the command that restarted it, if any.  */
+  bootprof_unwind ();
   
   /* Initialize the kill buffer.  */
   *kill_buf = 0;
@@ -1062,6 +1126,8 @@ cmain (void)
 	{
 	  int i;
 
+	  bootprof_begin (BOOTPROF_CONFIG, config_file);
+
 	  do
 	    {
 	      /* STATE 0:  Before any title command.
@@ -1217,8 +1283,15 @@ cmain (void)
 		grub_close ();
 	    }
 	  while (is_preset);
+
+	  bootprof_end (0);
 	}
 
+#if defined(PLATFORM_EFI) || defined(GRUB_UTIL)
+      menu_config_entries = config_entries;
+      menu_num_entries = num_entries;
+#endif
+
       /* go ahead and make sure the terminal is setup */
       if (current_term->startup)
         (*current_term->startup)();
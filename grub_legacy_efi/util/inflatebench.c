@@ -0,0 +1,347 @@
+/* inflatebench - compare the old and new inflate of stage2/gunzip.c */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2014  Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * A host benchmark, not part of the build.  gunzip.c is too large to
+ * copy here, so this file is compiled once around each decoder, with its
+ * GRUB names given a prefix, and once more for the driver.  From the top
+ * of the source tree, after configure:
+ *
+ *   git show 0afd6ee:grub_legacy_efi/stage2/gunzip.c > gunzip-old.c
+ *   F="-O2 -DGRUB_UTIL -I. -Istage2 -Istage1"
+ *   gcc $F -DNAME=old -DDECODER='"gunzip-old.c"' -c -o old.o util/inflatebench.c
+ *   gcc $F -DNAME=new -DDECODER='"gunzip.c"' -c -o new.o util/inflatebench.c
+ *   gcc -O2 -o inflatebench util/inflatebench.c old.o new.o
+ *   ./inflatebench FILE.gz...
+ *
+ * The old decoder is that of the original gunzip.c, and the new one is
+ * gunzip.c as it is now.  For each file, the output of the two is checked
+ * to be the same, both in one read and in reads of odd sizes, then the
+ * best time of one read of the whole file is printed with its MB/s.
+ *
+ * gunzip.c now also checks the CRC32 of the output, which the old code
+ * never did.  To time the new decode loop alone, build new.o from the
+ * gunzip.c of commit f366508 instead, fetched as above.
+ */
+
+#ifdef DECODER
+
+/* Give the names that gunzip.c shares with the rest of GRUB a prefix, so
+   that both decoders, each with its own stubs, link into one program.  */
+#define GLUE(a, b)	a ## _ ## b
+#define XGLUE(a, b)	GLUE (a, b)
+#define PREFIXED(n)	XGLUE (NAME, n)
+
+#define compressed_file		PREFIXED (compressed_file)
+#define no_decompression	PREFIXED (no_decompression)
+#define gunzip_test_header	PREFIXED (gunzip_test_header)
+#define gunzip_read		PREFIXED (gunzip_read)
+#define gunzip_close		PREFIXED (gunzip_close)
+#define errnum			PREFIXED (errnum)
+#define filepos			PREFIXED (filepos)
+#define filemax			PREFIXED (filemax)
+#define fsmax			PREFIXED (fsmax)
+#define mbi			PREFIXED (mbi)
+#define grub_read		PREFIXED (grub_read)
+#define grub_scratch_mem	PREFIXED (grub_scratch_mem)
+#define grub_alloc_pages	PREFIXED (grub_alloc_pages)
+#define grub_free_pages		PREFIXED (grub_free_pages)
+#define grub_memmove		PREFIXED (grub_memmove)
+#define grub_memset		PREFIXED (grub_memset)
+#define bootprof_begin		PREFIXED (bootprof_begin)
+#define bootprof_end		PREFIXED (bootprof_end)
+
+/* Before shared.h, which renames the C library string functions.  */
+#include <stdlib.h>
+#include <string.h>
+
+#include DECODER
+
+#undef memmove
+#undef memcpy
+#undef memset
+
+grub_error_t errnum;
+int filepos;
+int filemax;
+int fsmax;
+struct multiboot_info mbi;
+void *grub_scratch_mem;
+
+/* The compressed file, in memory.  */
+static const unsigned char *stream;
+
+int
+grub_read (char *buf, int len)
+{
+  if (len > filemax - filepos)
+    len = filemax - filepos;
+  if (len < 0)
+    len = 0;
+
+  memcpy (buf, stream + filepos, len);
+  filepos += len;
+  return len;
+}
+
+void *
+grub_alloc_pages (unsigned long size)
+{
+  return malloc (size);
+}
+
+void
+grub_free_pages (void *addr, unsigned long size)
+{
+  free (addr);
+}
+
+void *
+grub_memmove (void *to, const void *from, int len)
+{
+  return memmove (to, from, len);
+}
+
+void *
+grub_memset (void *start, int c, int len)
+{
+  return memset (start, c, len);
+}
+
+void
+bootprof_begin (int phase, const char *name)
+{
+}
+
+void
+bootprof_end (unsigned long bytes)
+{
+}
+
+/* Open the gzip file IN of INSIZE bytes.  Return the size of its
+   contents, or -1 if it is not a good gzip file.  */
+int
+PREFIXED (open) (const unsigned char *in, int insize)
+{
+  if (! grub_scratch_mem)
+    {
+      grub_scratch_mem = malloc (GRUB_SCRATCH_MEM_SIZE);
+      if (! grub_scratch_mem)
+	return -1;
+      /* So that the linear allocator tops out at the end of it.  */
+      mbi.mem_upper = (GRUB_SCRATCH_MEM_SIZE - 0x100000) >> 10;
+    }
+
+  stream = in;
+  filepos = 0;
+  filemax = fsmax = insize;
+  errnum = ERR_NONE;
+
+  if (! gunzip_test_header () || ! compressed_file)
+    return -1;
+  return filemax;
+}
+
+/* Read LEN bytes at POS of the file last opened into BUF.  Return the
+   number of bytes read, or -1 on an error.  */
+int
+PREFIXED (read) (char *buf, int pos, int len)
+{
+  int ret;
+
+  filepos = pos;
+  ret = gunzip_read (buf, len);
+  return errnum ? -1 : ret;
+}
+
+#else /* ! DECODER */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+int old_open (const unsigned char *in, int insize);
+int old_read (char *buf, int pos, int len);
+int new_open (const unsigned char *in, int insize);
+int new_read (char *buf, int pos, int len);
+
+struct decoder
+{
+  const char *name;
+  int (*open) (const unsigned char *in, int insize);
+  int (*read) (char *buf, int pos, int len);
+};
+
+static struct decoder decoders[2] =
+{
+  { "old", old_open, old_read },
+  { "new", new_open, new_read },
+};
+
+/* The number of times each file is decompressed; the best time is kept.  */
+#define REPS	10
+
+static double
+now (void)
+{
+  struct timespec t;
+
+  clock_gettime (CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static unsigned char *
+load (const char *name, int *size)
+{
+  FILE *fp = fopen (name, "rb");
+  unsigned char *data;
+  long len;
+
+  if (! fp)
+    return 0;
+
+  fseek (fp, 0, SEEK_END);
+  len = ftell (fp);
+  rewind (fp);
+  data = malloc (len + 1);
+  if (data && fread (data, 1, len, fp) != (size_t) len)
+    {
+      free (data);
+      data = 0;
+    }
+  fclose (fp);
+
+  *size = len;
+  return data;
+}
+
+/* Decompress IN with D into OUT of SIZE bytes, in one read if STEP is
+   zero and otherwise in reads of every size from 1 to STEP in turn.
+   Return zero on an error.  */
+static int
+inflate (struct decoder *d, const unsigned char *in, int insize,
+	 char *out, int size, int step)
+{
+  int pos, len;
+
+  if (d->open (in, insize) != size)
+    return 0;
+
+  if (! step)
+    return d->read (out, 0, size) == size;
+
+  for (pos = 0, len = 1; pos < size; pos += len, len = len % step + 1)
+    {
+      if (len > size - pos)
+	len = size - pos;
+      if (d->read (out + pos, pos, len) != len)
+	return 0;
+    }
+
+  return 1;
+}
+
+int
+main (int argc, char *argv[])
+{
+  int i, k, r;
+
+  if (argc < 2)
+    {
+      fprintf (stderr, "Usage: %s FILE.gz...\n", argv[0]);
+      return 1;
+    }
+
+  printf ("%-24s %10s %10s %9s %9s %9s %9s\n", "file", "packed", "size",
+	  "old_ms", "new_ms", "old_MB/s", "new_MB/s");
+
+  for (i = 1; i < argc; i++)
+    {
+      unsigned char *in;
+      char *out[2];
+      int insize, size;
+      double best[2];
+
+      in = load (argv[i], &insize);
+      if (! in)
+	{
+	  perror (argv[i]);
+	  return 1;
+	}
+
+      size = decoders[0].open (in, insize);
+      if (size < 0 || decoders[1].open (in, insize) != size)
+	{
+	  printf ("%s: not a gzip file the two decoders agree on\n", argv[i]);
+	  return 1;
+	}
+
+      for (k = 0; k < 2; k++)
+	out[k] = malloc (size + 1);
+
+      /* The check: one read, then reads of odd sizes that start and
+	 stop at every offset within a window.  */
+      for (k = 0; k < 2; k++)
+	if (! inflate (&decoders[k], in, insize, out[k], size, 0))
+	  {
+	    printf ("%s: the %s decoder failed\n", argv[i], decoders[k].name);
+	    return 1;
+	  }
+      if (memcmp (out[0], out[1], size) != 0)
+	{
+	  printf ("%s: the output differs!\n", argv[i]);
+	  return 1;
+	}
+      memset (out[1], 0, size);
+      if (! inflate (&decoders[1], in, insize, out[1], size, 4099)
+	  || memcmp (out[0], out[1], size) != 0)
+	{
+	  printf ("%s: the output differs in short reads!\n", argv[i]);
+	  return 1;
+	}
+
+      for (k = 0; k < 2; k++)
+	{
+	  best[k] = 1e9;
+	  for (r = 0; r < REPS; r++)
+	    {
+	      double t = now ();
+
+	      inflate (&decoders[k], in, insize, out[k], size, 0);
+	      t = now () - t;
+	      if (t < best[k])
+		best[k] = t;
+	    }
+	}
+
+      printf ("%-24s %10d %10d %9.2f %9.2f %9.1f %9.1f\n", argv[i], insize,
+	      size, best[0] * 1e3, best[1] * 1e3, size / best[0] / 1e6,
+	      size / best[1] / 1e6);
+
+      free (out[0]);
+      free (out[1]);
+      free (in);
+    }
+
+  return 0;
+}
+
+#endif /* ! DECODER */
@@ -0,0 +1,368 @@
+/* membench - compare the old and new memory moves of stage2/char_io.c */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2014  Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * A host benchmark, not part of the build.  Compile and run it with
+ *
+ *   gcc -O2 -o membench util/membench.c && ./membench
+ *
+ * or with -m32 for the ia32 code that Quark runs.  It first checks the
+ * new routines against the C library, then prints MB/s for each size:
+ * grub_memcpy, grub_memmove to a higher address without overlap (which
+ * the old code did backwards with STD) and grub_memset, the old code
+ * against the new.  With `--words' the new code takes the word path
+ * even where the processor has Enhanced REP MOVSB.  The last column is
+ * a non-temporal SSE2 copy, which was tried and dropped.
+ *
+ * The old routines are those of the original char_io.c, and the new
+ * ones are copied from char_io.c as it is now; keep them in step.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+/* The largest size measured.  */
+#define MAX_SIZE	(64 << 20)
+
+static int force_words;
+
+/* The old routines.  */
+
+static void
+old_memcpy (void *dest, const void *src, int len)
+{
+  int i;
+  volatile char *d = (char *) dest;
+  const char *s = (const char *) src;
+
+  for (i = 0; i < len; i++)
+    d[i] = s[i];
+}
+
+static void
+old_memmove (void *to, const void *from, int len)
+{
+  long d0, d1, d2;
+
+  if (to < from)
+    asm volatile ("cld\n\t"
+		  "rep\n\t"
+		  "movsb"
+		  : "=&c" (d0), "=&S" (d1), "=&D" (d2)
+		  : "0" ((long) len), "1" (from), "2" (to)
+		  : "memory");
+  else
+    asm volatile ("std\n\t"
+		  "rep\n\t"
+		  "movsb\n\t"
+		  "cld"
+		  : "=&c" (d0), "=&S" (d1), "=&D" (d2)
+		  : "0" ((long) len),
+		  "1" (len - 1 + (const char *) from),
+		  "2" (len - 1 + (char *) to)
+		  : "memory");
+}
+
+static void
+old_memset (void *start, int c, int len)
+{
+  volatile char *p = start;
+
+  while (len -- > 0)
+    *p ++ = c;
+}
+
+/* The new routines, from char_io.c.  */
+
+#ifdef __x86_64__
+# define MOVS_WORD	"movsq"
+# define STOS_WORD	"stosq"
+#else
+# define MOVS_WORD	"movsl"
+# define STOS_WORD	"stosl"
+#endif
+#define WORD_SIZE	(sizeof (unsigned long))
+
+#define REP_MOVS(insn, count, to, from)				\
+  asm volatile ("rep\n\t" insn					\
+		: "+c" (count), "+S" (from), "+D" (to) : : "memory")
+#define REP_STOS(insn, count, to, val)				\
+  asm volatile ("rep\n\t" insn					\
+		: "+c" (count), "+D" (to) : "a" (val) : "memory")
+
+#ifdef __x86_64__
+static int
+fast_strings (void)
+{
+  static int fast = -1;
+  unsigned int eax, ebx, ecx, edx;
+
+  if (force_words)
+    return 0;
+
+  if (fast < 0)
+    {
+      asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+	   : "0" (0));
+      fast = 0;
+      if (eax >= 7)
+	{
+	  asm ("cpuid" : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+	       : "0" (7), "2" (0));
+	  /* Enhanced REP MOVSB/STOSB */
+	  fast = (ebx >> 9) & 1;
+	}
+    }
+
+  return fast;
+}
+#else
+# define fast_strings()	0
+#endif
+
+static void
+copy_forward (char *to, const char *from, unsigned long len)
+{
+  unsigned long n;
+
+  if (len >= 4 * WORD_SIZE && ! fast_strings ())
+    {
+      n = -(unsigned long) to & (WORD_SIZE - 1);
+      len -= n;
+      REP_MOVS ("movsb", n, to, from);
+
+      n = len / WORD_SIZE;
+      len %= WORD_SIZE;
+      REP_MOVS (MOVS_WORD, n, to, from);
+    }
+
+  REP_MOVS ("movsb", len, to, from);
+}
+
+static void
+fill (char *to, int c, unsigned long len)
+{
+  unsigned long n;
+
+  if (len >= 4 * WORD_SIZE && ! fast_strings ())
+    {
+      n = -(unsigned long) to & (WORD_SIZE - 1);
+      len -= n;
+      REP_STOS ("stosb", n, to, c);
+
+      n = len / WORD_SIZE;
+      len %= WORD_SIZE;
+      REP_STOS (STOS_WORD, n, to, (unsigned char) c * (~0UL / 0xff));
+    }
+
+  REP_STOS ("stosb", len, to, c);
+}
+
+/* A non-temporal copy, for comparison only.  */
+static void
+nt_copy (char *to, const char *from, unsigned long len)
+{
+#ifdef __SSE2__
+  unsigned long n = -(unsigned long) to & 15;
+
+  if (len >= 64 + n)
+    {
+      copy_forward (to, from, n);
+      to += n;
+      from += n;
+      len -= n;
+
+      for (; len >= 64; len -= 64, to += 64, from += 64)
+	{
+	  __m128i a = _mm_loadu_si128 ((const __m128i *) from);
+	  __m128i b = _mm_loadu_si128 ((const __m128i *) (from + 16));
+	  __m128i c = _mm_loadu_si128 ((const __m128i *) (from + 32));
+	  __m128i d = _mm_loadu_si128 ((const __m128i *) (from + 48));
+
+	  _mm_stream_si128 ((__m128i *) to, a);
+	  _mm_stream_si128 ((__m128i *) (to + 16), b);
+	  _mm_stream_si128 ((__m128i *) (to + 32), c);
+	  _mm_stream_si128 ((__m128i *) (to + 48), d);
+	}
+      _mm_sfence ();
+    }
+#endif
+  copy_forward (to, from, len);
+}
+
+/* Check the new routines against the C library at every alignment.  */
+static int
+check (void)
+{
+  static unsigned char src[8192], got[8192], want[8192];
+  int i, k;
+
+  srand (2);
+  for (k = 0; k < 20000; k++)
+    {
+      int len = rand () % 3000;
+      int soff = rand () % 64;
+      int doff = rand () % 64;
+
+      for (i = 0; i < (int) sizeof (src); i++)
+	src[i] = rand ();
+
+      memcpy (got, src, sizeof (got));
+      memcpy (want, src, sizeof (want));
+      copy_forward ((char *) got + doff, (char *) src + soff + 4000, len);
+      memcpy (want + doff, src + soff + 4000, len);
+      if (memcmp (got, want, sizeof (got)) != 0)
+	return 0;
+
+      fill ((char *) got + doff, k & 0xff, len);
+      memset (want + doff, k & 0xff, len);
+      if (memcmp (got, want, sizeof (got)) != 0)
+	return 0;
+
+      nt_copy ((char *) got + doff, (char *) src + soff, len);
+      memcpy (want + doff, src + soff, len);
+      if (memcmp (got, want, sizeof (got)) != 0)
+	return 0;
+    }
+
+  return 1;
+}
+
+static double
+now (void)
+{
+  struct timespec t;
+
+  clock_gettime (CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* Keep the compiler from dropping a move whose result is not used.  */
+#define USE(p)	asm volatile ("" : : "r" (p) : "memory")
+
+int
+main (int argc, char *argv[])
+{
+  char *src, *buf;
+  long size;
+
+  if (argc > 1 && strcmp (argv[1], "--words") == 0)
+    force_words = 1;
+  else if (argc > 1)
+    {
+      fprintf (stderr, "Usage: %s [--words]\n", argv[0]);
+      return 1;
+    }
+
+  if (! check ())
+    {
+      printf ("The new routines are wrong!\n");
+      return 1;
+    }
+
+  src = aligned_alloc (4096, MAX_SIZE + 4096);
+  buf = aligned_alloc (4096, 2 * MAX_SIZE + 8192);
+  if (! src || ! buf)
+    {
+      perror ("aligned_alloc");
+      return 1;
+    }
+  memset (src, 1, MAX_SIZE + 4096);
+  memset (buf, 2, 2 * MAX_SIZE + 8192);
+
+  printf ("%9s %9s %9s %9s %9s %9s %9s %9s  (MB/s)\n", "size",
+	  "cpy_old", "cpy_new", "mv_old", "mv_new", "set_old", "set_new",
+	  "cpy_nt");
+
+  for (size = 16; size <= MAX_SIZE; size *= 4)
+    {
+      long reps = (256L << 20) / size;
+      /* A move to a higher address, as loading a kernel above its
+	 buffer does.  */
+      char *lo = buf, *hi = buf + 1 + (size < 4096 ? 4096 : size);
+      double t[7];
+      long i;
+      int k;
+
+      if (reps < 4)
+	reps = 4;
+      if (reps > 2000000)
+	reps = 2000000;
+
+      t[0] = now ();
+      for (i = 0; i < reps; i++)
+	old_memcpy (lo, src + 1, size);
+      t[0] = now () - t[0];
+
+      t[1] = now ();
+      for (i = 0; i < reps; i++)
+	{
+	  copy_forward (lo, src + 1, size);
+	  USE (lo);
+	}
+      t[1] = now () - t[1];
+
+      t[2] = now ();
+      for (i = 0; i < reps; i++)
+	old_memmove (hi, lo, size);
+      t[2] = now () - t[2];
+
+      t[3] = now ();
+      for (i = 0; i < reps; i++)
+	{
+	  copy_forward (hi, lo, size);
+	  USE (hi);
+	}
+      t[3] = now () - t[3];
+
+      t[4] = now ();
+      for (i = 0; i < reps; i++)
+	old_memset (lo, 0, size);
+      t[4] = now () - t[4];
+
+      t[5] = now ();
+      for (i = 0; i < reps; i++)
+	{
+	  fill (lo, 0, size);
+	  USE (lo);
+	}
+      t[5] = now () - t[5];
+
+      t[6] = now ();
+      for (i = 0; i < reps; i++)
+	{
+	  nt_copy (lo, src + 1, size);
+	  USE (lo);
+	}
+      t[6] = now () - t[6];
+
+      printf ("%9ld", size);
+      for (k = 0; k < 7; k++)
+	printf (" %9.0f", size * reps / t[k] / 1e6);
+      printf ("\n");
+    }
+
+  return 0;
+}